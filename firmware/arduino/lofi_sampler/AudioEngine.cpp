@@ -1,33 +1,252 @@
 #include "AudioEngine.h"
 #include "Storage.h"
+#include "SampleBank.h"
+#include "Telemetry.h"
 #include <Adafruit_ZeroTimer.h>
+#if AUDIO_BLOCK_RENDER
+#include <Adafruit_ZeroDMA.h>
+#endif
+#include <math.h>
 #include <string.h>
 
 /*
  * The sampler is now split into two clear personalities:
- *   • service() – runs in the main loop, drains the job queue, streams flash
+ *   • service() – runs in the main loop, handles posted jobs, streams flash
  *     into circular voice buffers, and nudges gain ramps along.
  *   • isr()      – the 22.05 kHz timer interrupt that simply mixes whatever
  *     service() already staged. No filesystem calls, no math surprises.
+ *   • render()   – the block-mode twin of isr(): with AUDIO_BLOCK_RENDER the
+ *     DMAC clocks a ping-pong buffer into both DACs off the same timer, and
+ *     the block-done interrupt mixes the next AUDIO_BLOCK_FRAMES in one go.
+ *     Both paths share Q15 gains and the same master clipper, so they are
+ *     bit-identical for the same voice state (lofi_bench --verify).
+ *
+ * With STEREO_OUT the bus is two channels, interleaved in the accumulators
+ * so one pass over a voice adds it to both: each voice's gain goes through
+ * its pan (constant power, from a small quarter-sine table) once per run,
+ * or per frame while it ramps. The master stage soft-clips the pair with
+ * one gain, from the louder side, and each DAC gets its own channel.
+ *
+ * Timing lives in the mixers too. Every rendered frame ticks sampleClock, and
+ * service() turns jobs into timestamped events (start, gain ramp, stop fade)
+ * kept in a small latest-first list. isr() applies whatever is due before
+ * each frame; render() splits its block at the next event, so a step lands on
+ * its scheduled frame whichever mixer runs and however late the loop was.
+ * Gain ramps step per frame in Q30, which makes fades real sample lengths.
+ *
+ * Voices off 1x (setRate) step a Q16.16 read position instead of one sample
+ * per frame and interpolate between neighbours; a reversed voice streams its
+ * slice from the end. At exactly 1x the mixers take the plain copy loop.
+ *
+ * A voice with effects on (setFx) is read into a scratch run first, put
+ * through its VoiceFx chain a stage at a time, then mixed at its gain; the
+ * chain's state carries from run to run, so isr()'s one-frame runs and
+ * render()'s long ones still come out the same.
+ *
+ * Voices come from a pool. A trigger takes a free voice (or steals the
+ * quietest one) and leaves the row's previous voice alone to fade out on the
+ * start frame, so a choke retrigger is a crossfade rather than a cut.
  *
  * Jobs give us a scratchpad for everything that needs coordination (preloads,
- * fades, diagnostics) without letting the ISR touch slow code paths. The queue
- * is tiny on purpose; if we overflow it, something upstream is spamming work
- * faster than the main loop can keep up and we log it loudly.
+ * fades, diagnostics) without letting the ISR touch slow code paths. They
+ * sit in fixed mailboxes -- one per row and kind, one per voice for
+ * diagnostics -- rather than a queue: a newer request replaces an unhandled
+ * older one of the same kind, which is what the older one would have been
+ * cut short by anyway. Slices travel as SliceIds, so none of this copies or
+ * formats a path.
  */
 
 static Adafruit_ZeroTimer zt = Adafruit_ZeroTimer(3); // TC3/4/5 depend on chip; 3 works on M4
 
 static AudioEngine* s_self = nullptr;
 
+#if AUDIO_BLOCK_RENDER
+// Each DAC channel reads its own ping-pong pair (the same codes in both
+// without STEREO_OUT), beat by beat on TC3 overflow. Only the right channel
+// raises block-done interrupts: it is allocated second, so the DMAC serves
+// it last on each beat and both halves are out before the refill.
+static Adafruit_ZeroDMA dmaL;
+static Adafruit_ZeroDMA dmaR;
+static uint16_t dmaBuf[2][2][AUDIO_BLOCK_FRAMES];   // [channel][half]
+static volatile uint8_t dmaDoneHalf = 0;
+
+static bool setupDacDma(Adafruit_ZeroDMA& dma, uint16_t (*halves)[AUDIO_BLOCK_FRAMES],
+                        volatile uint16_t* dst, dma_callback_t onBlock) {
+  dma.setTrigger(TC3_DMAC_ID_OVF);
+  dma.setAction(DMA_TRIGGER_ACTON_BEAT);
+  if (dma.allocate() != DMA_STATUS_OK) return false;
+  for (uint8_t h = 0; h < 2; ++h) {
+    DmacDescriptor* d = dma.addDescriptor(halves[h], (void*)dst, AUDIO_BLOCK_FRAMES,
+                                          DMA_BEAT_SIZE_HWORD, true, false);
+    if (!d) return false;
+    d->BTCTRL.bit.BLOCKACT = DMA_BLOCK_ACTION_INT;
+  }
+  dma.loop(true);
+  if (onBlock) dma.setCallback(onBlock);
+  return true;
+}
+#endif
+
 namespace {
-static constexpr uint16_t DEFAULT_FADE_FRAMES = 96;
-static constexpr uint16_t STOP_FADE_FRAMES    = 128;
-static constexpr uint32_t STREAM_CHUNK = (AudioEngine::BUF_SAMPLES > 256u)
-                                           ? 256u
-                                           : ((AudioEngine::BUF_SAMPLES > 64u)
-                                                  ? (AudioEngine::BUF_SAMPLES / 2u)
-                                                  : AudioEngine::BUF_SAMPLES);
+static constexpr uint16_t DEFAULT_FADE_FRAMES = 96;   // ≈4.4 ms
+static constexpr uint16_t STOP_FADE_FRAMES    = 128;  // ≈5.8 ms
+
+// Levels come in as floats; the mixer ramps in Q30 and multiplies by the top
+// Q15 bits (vgain >> 15, 32768 = unity).
+inline int32_t gainToQ30(float g) {
+  if (g <= 0.0f) return 0;
+  if (g >= 1.0f) return 1 << 30;
+  return (int32_t)(g * 1073741824.0f + 0.5f);
+}
+
+// Rates come in as floats too; the sign is the direction.
+inline int32_t rateToQ16(float r) {
+  float m = (r < 0.0f) ? -r : r;
+  if (m < 1.0f / RATE_MAX) m = 1.0f / RATE_MAX;
+  if (m > RATE_MAX) m = RATE_MAX;
+  int32_t q = (int32_t)(m * 65536.0f + 0.5f);
+  return (r < 0.0f) ? -q : q;
+}
+
+// How many frames `samples` last at `inc` (Q16.16 samples per frame), and
+// how many samples `frames` take.
+inline uint32_t framesAt(uint32_t samples, uint32_t inc) {
+  return (uint32_t)(((uint64_t)samples << 16) / inc);
+}
+inline uint32_t samplesAt(uint32_t frames, uint32_t inc) {
+  return (uint32_t)(((uint64_t)frames * inc + 0xFFFFu) >> 16);
+}
+
+// Index `k` samples on from `pos` in the direction of play, k <= len.
+inline uint32_t stepIndex(uint32_t pos, uint32_t k, uint32_t len, bool back) {
+  if (back) return (pos >= k) ? pos - k : pos + len - k;
+  pos += k;
+  return (pos >= len) ? pos - len : pos;
+}
+
+// The sample `phase` (Q16) of the way from src[pos] to the next one in the
+// direction of play. Neighbours past what's available repeat the last one;
+// the one behind (4-point only) is whatever the source holds there, which
+// on a voice's first frame the Start fade-in has at zero gain.
+inline int32_t interpolate(const int16_t* src, uint32_t len, uint32_t pos, bool back,
+                           uint32_t avail, uint32_t phase) {
+  int32_t s0 = src[pos];
+  int32_t s1 = (avail > 1) ? src[stepIndex(pos, 1, len, back)] : s0;
+  int32_t x = (int32_t)(phase >> 1);   // Q15, so the products fit
+#if VARISPEED_CUBIC
+  int32_t sm1 = src[stepIndex(pos, len - 1, len, back)];
+  int32_t s2 = (avail > 2) ? src[stepIndex(pos, 2, len, back)] : s1;
+  // Catmull-Rom Hermite, coefficients doubled to stay integer.
+  int32_t c1 = s1 - sm1;
+  int32_t c2 = 2 * sm1 - 5 * s0 + 4 * s1 - s2;
+  int32_t c3 = (s2 - sm1) + 3 * (s0 - s1);
+  int64_t t = (((int64_t)c3 * x) >> 15) + c2;
+  t = ((t * x) >> 15) + c1;
+  t = (t * x) >> 15;
+  int32_t y = s0 + (int32_t)(t >> 1);
+  if (y < -32768) y = -32768;
+  if (y > 32767) y = 32767;
+  return y;
+#else
+  return s0 + (((s1 - s0) * x) >> 15);
+#endif
+}
+
+// Constant-power pan, a quarter sine in Q15: step k of PAN_STEPS puts
+// PAN_LUT[k] on the right and PAN_LUT[PAN_STEPS - k] on the left.
+static constexpr uint8_t PAN_STEPS = 32;
+static const int16_t PAN_LUT[PAN_STEPS + 1] = {
+  0, 1608, 3212, 4808, 6393, 7962, 9512, 11039, 12539, 14010, 15446,
+  16846, 18204, 19519, 20787, 22005, 23170, 24279, 25329, 26319, 27245,
+  28105, 28898, 29621, 30273, 30852, 31356, 31785, 32137, 32412, 32609,
+  32728, 32767,
+};
+
+inline uint8_t panToStep(float p) {
+  if (p < -1.0f) p = -1.0f;
+  if (p > 1.0f) p = 1.0f;
+  return (uint8_t)((p + 1.0f) * (PAN_STEPS / 2) + 0.5f);
+}
+
+// A voice's Q15 gain on one channel: its level through its pan.
+inline int32_t panned(int32_t gain, int32_t pan) {
+#if STEREO_OUT
+  return (gain * pan) >> 15;
+#else
+  (void)pan;
+  return gain;
+#endif
+}
+
+// One sample into a frame's accumulators at its per-channel gains.
+inline void mixInto(int32_t* a, int32_t s, int32_t gainL, int32_t gainR) {
+  a[0] += (s * gainL) >> 15;
+#if STEREO_OUT
+  a[1] += (s * gainR) >> 15;
+#else
+  (void)gainR;
+#endif
+}
+
+// Master soft clip as a gain on the louder channel's level past the knee:
+// CLIP_POINTS + 1 Q15 gains, 1 << CLIP_SHIFT apart, enough to reach the
+// loudest the pool can sum to. In between, interpolated.
+static constexpr int32_t  MIX_FULL_SCALE = 32768;
+static constexpr uint16_t CLIP_POINTS = 256;
+constexpr uint8_t clipShift(uint32_t span, uint8_t shift = 0) {
+  return (span >> shift) <= CLIP_POINTS ? shift : clipShift(span, shift + 1);
+}
+static constexpr uint8_t CLIP_SHIFT = clipShift((uint32_t)VOICE_COUNT * MIX_FULL_SCALE);
+static int32_t clipKnee = MIX_FULL_SCALE;
+static int32_t clipGain[CLIP_POINTS + 1];
+
+// Past the knee the level follows knee + room * tanh(over / room): slope 1
+// where it leaves the straight part, full scale only in the limit.
+void buildClipCurve() {
+  float kneeF = MASTER_KNEE;
+  if (kneeF < 0.1f) kneeF = 0.1f;
+  if (kneeF > 0.95f) kneeF = 0.95f;
+  clipKnee = (int32_t)(kneeF * MIX_FULL_SCALE);
+  float knee = (float)clipKnee;
+  float room = MIX_FULL_SCALE - knee;
+  for (uint16_t i = 0; i <= CLIP_POINTS; ++i) {
+    float m = knee + (float)((uint32_t)i << CLIP_SHIFT);
+    float y = knee + room * tanhf((m - knee) / room);
+    clipGain[i] = (int32_t)(y / m * 32768.0f + 0.5f);
+  }
+}
+
+inline uint16_t dacCode(int32_t x) {
+  if (x < -2047) x = -2047;
+  if (x >  2047) x =  2047;
+  return (uint16_t)(x + 2048); // 0..4095
+}
+
+// Shared by isr() and render() so the two paths can't drift apart. The mix
+// is at 16-bit scale, the DACs take 12.
+inline void dacFromMix(int32_t left, int32_t right, uint16_t& outL, uint16_t& outR) {
+  int32_t m = (left < 0) ? -left : left;
+  int32_t mr = (right < 0) ? -right : right;
+  if (mr > m) m = mr;
+  left >>= 4;
+  right >>= 4;
+  if (m > clipKnee) {
+    uint32_t over = (uint32_t)(m - clipKnee);
+    uint32_t i = over >> CLIP_SHIFT;
+    int32_t g = clipGain[CLIP_POINTS];
+    if (i < CLIP_POINTS) {
+      int32_t frac = (int32_t)(over & ((1u << CLIP_SHIFT) - 1u));
+      g = clipGain[i] + (((clipGain[i + 1] - clipGain[i]) * frac) >> CLIP_SHIFT);
+    }
+    left = (left * g) >> 15;
+    right = (right * g) >> 15;
+  }
+  outL = dacCode(left);
+  outR = dacCode(right);
+}
+
+// Keeps the mailbox payload writes (and reads) on their side of `posted`.
+inline void mailFence() { __sync_synchronize(); }
 }
 
 bool AudioEngine::begin() {
@@ -35,171 +254,594 @@ bool AudioEngine::begin() {
   pinMode(DAC_PIN_L, OUTPUT);
   pinMode(DAC_PIN_R, OUTPUT);
   s_self = this;
+  buildClipCurve();
 
-  jobHead = 0;
-  jobTail = 0;
-  for (uint8_t v = 0; v < 4; ++v) {
+  jobSeq = 0;
+  jobSeqSeen = 0;
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    for (uint8_t k = 0; k < ROW_JOB_KINDS; ++k) rowMail[r][k] = Mailbox();
+  }
+  sampleClock = 0;
+  eventCount = 0;
+  voiceSteals = 0;
+  pumpLastAt = 0;
+  pumpGapPeak = SCHEDULE_AHEAD_FRAMES;
+  readCostQ8 = 0;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
     vavailable[v] = 0;
     vpos[v] = 0;
     vwrite[v] = 0;
+    vrate[v] = RATE_UNITY;
+    vphase[v] = 0;
+    vfx[v].reset(VoiceFx::Params());
+    vpanL[v] = vpanR[v] = PAN_LUT[PAN_STEPS / 2];
     voiceActive[v] = false;
     voicePrimed[v] = false;
     voiceStreaming[v] = false;
     voiceDraining[v] = false;
+    voiceDirect[v] = false;
+    voiceRunning[v] = false;
+    voiceHalted[v] = false;
+    voiceGen[v] = 0;
+    vsrc[v] = vbuf[v];
+    vsrcLen[v] = BUF_SAMPLES;
+    voiceRow[v] = NO_ROW;
+    voiceStartAt[v] = 0;
+    voiceStopAt[v] = 0;
+    voiceReverse[v] = false;
     voiceTotalSamples[v] = 0;
     voiceLoadedSamples[v] = 0;
     voiceDiagPending[v] = false;
-    voiceNeedsFadeIn[v] = false;
-    memset(voicePath[v], 0, MAX_PATH_LEN);
-    vgainCurrent[v] = 0.0f;
-    vgainTarget[v] = 0.9f;
-    vgainDesired[v] = 0.9f;
-    vgainStep[v] = 0.0f;
-    vgainFrames[v] = 0;
+    voiceSlice[v] = NO_SLICE;
+    diagMail[v] = Mailbox();
+    voiceHeldSamples[v] = 0;
+    voiceHeldTotal[v] = 0;
+    voiceHeldGen[v] = 0;
+    voiceStartFrame[v] = 0;
+    vgain[v] = 0;
+    vgainStep[v] = 0;
+    vgainEnd[v] = 0;
+    vgainLeft[v] = 0;
+    vgainStop[v] = false;
+  }
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    rowMode[r] = RowMode::Choke;
+    rowLevel[r] = 0.9f;
+    rowRate[r] = RATE_UNITY;
+    rowFx[r] = VoiceFx::Params();
+    rowPan[r] = PAN_STEPS / 2;
+    shadows[r] = Shadow();
   }
 
   // Configure ZeroTimer to fire at SAMPLE_RATE_HZ
   zt.configure(TC_CLOCK_PRESCALER_DIV1, TC_COUNTER_SIZE_16BIT, TC_WAVE_GENERATION_MATCH_FREQ);
   zt.setCompare(0, (F_CPU / SAMPLE_RATE_HZ) - 1);
-  zt.setCallback(true, TC_CALLBACK_CC_CHANNEL0, (tc_callback_t)onTimerISR);
+#if AUDIO_BLOCK_RENDER
+  // The timer only paces the DMAC; no per-sample interrupt. One analogWrite
+  // per channel lets the core enable the DACs before DMA takes over DATA.
+  zt.setCallback(false, TC_CALLBACK_CC_CHANNEL0, onTimerISR);
+  analogWrite(DAC_PIN_L, 2048);
+  analogWrite(DAC_PIN_R, 2048);
+  static bool dmaReady = false;
+  if (!dmaReady) {
+    dmaReady = setupDacDma(dmaL, dmaBuf[0], &DAC->DATA[0].reg, nullptr) &&
+               setupDacDma(dmaR, dmaBuf[1], &DAC->DATA[1].reg, onDmaBlock);
+  }
+  return dmaReady;
+#else
+  zt.setCallback(true, TC_CALLBACK_CC_CHANNEL0, onTimerISR);
   return true;
+#endif
 }
 
 void AudioEngine::start() {
   running = true;
+#if AUDIO_BLOCK_RENDER
+  // Prime both halves so the DMAC has a full block queued behind the first.
+  render(dmaBuf[0][0], dmaBuf[1][0], AUDIO_BLOCK_FRAMES);
+  render(dmaBuf[0][1], dmaBuf[1][1], AUDIO_BLOCK_FRAMES);
+  dmaDoneHalf = 0;
+  dmaL.startJob();
+  dmaR.startJob();
+#endif
   zt.enable(true);
 }
 
 void AudioEngine::stop() {
   running = false;
   zt.enable(false);
+#if AUDIO_BLOCK_RENDER
+  dmaL.abort();
+  dmaR.abort();
+#endif
+}
+
+bool AudioEngine::idle() const {
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (voiceActive[v]) return false;
+  }
+  return true;
+}
+
+void AudioEngine::setRowMode(uint8_t row, RowMode mode) {
+  if (row >= ROW_COUNT) return;
+  rowMode[row] = mode;
 }
 
-void AudioEngine::setLevel(uint8_t v, float lv) {
-  if (v >= 4) return;
-  vgainDesired[v] = lv;
+void AudioEngine::setPan(uint8_t row, float pan) {
+  if (row >= ROW_COUNT) return;
+  rowPan[row] = panToStep(pan);
+}
+
+void AudioEngine::setLevel(uint8_t row, float lv, uint32_t at) {
+  if (row >= ROW_COUNT) return;
+  rowLevel[row] = lv;
   Job job;
   job.type = JobType::Fade;
-  job.voice = v;
+  job.row = row;
   job.value = lv;
   job.frames = DEFAULT_FADE_FRAMES;
-  if (!enqueueJob(job)) {
-    armGainRamp(v, lv, DEFAULT_FADE_FRAMES);
-  }
+  job.at = at;
+  post(rowMail[row][(uint8_t)JobType::Fade], job);
+}
+
+void AudioEngine::setRate(uint8_t row, float rate, uint32_t at) {
+  if (row >= ROW_COUNT) return;
+  rowRate[row] = rateToQ16(rate);
+  Job job;
+  job.type = JobType::Rate;
+  job.row = row;
+  job.value = rate;
+  job.at = at;
+  post(rowMail[row][(uint8_t)JobType::Rate], job);
+}
+
+void AudioEngine::setFx(uint8_t row, const VoiceFx::Settings& fx, uint32_t at) {
+  if (row >= ROW_COUNT) return;
+  rowFx[row] = VoiceFx::compile(fx);
+  Job job;
+  job.type = JobType::Fx;
+  job.row = row;
+  job.at = at;
+  post(rowMail[row][(uint8_t)JobType::Fx], job);
 }
 
 void AudioEngine::requestDiagnostics(uint8_t voice) {
-  if (voice >= 4) return;
+  if (voice >= VOICE_COUNT) return;
   Job job;
   job.type = JobType::Diagnostics;
-  job.voice = voice;
-  enqueueJob(job);
+  job.row = voice;
+  post(diagMail[voice], job);
 }
 
-bool AudioEngine::preloadAndPlay(uint8_t voice, const char* path) {
+bool AudioEngine::preloadAndPlay(uint8_t row, SliceId slice, uint32_t at) {
   if (!storage) return false;
-  if (voice >= 4 || !path) return false;
+  if (row >= ROW_COUNT || !sliceValid(slice)) return false;
   Job job;
   job.type = JobType::Preload;
-  job.voice = voice;
-  strncpy(job.path, path, MAX_PATH_LEN - 1);
-  job.path[MAX_PATH_LEN - 1] = '\0';
-  return enqueueJob(job);
+  job.row = row;
+  job.slice = slice;
+  job.at = at;
+  post(rowMail[row][(uint8_t)JobType::Preload], job);
+  return true;
 }
 
-void AudioEngine::stopVoice(uint8_t voice) {
-  if (voice >= 4) return;
-  noInterrupts();
-  voiceStreaming[voice] = false;
-  voiceDraining[voice] = true;
-  interrupts();
+bool AudioEngine::prefetch(uint8_t row, SliceId slice) {
+  if (!storage) return false;
+  if (row >= ROW_COUNT || !sliceValid(slice)) return false;
+  Job job;
+  job.type = JobType::Prefetch;
+  job.row = row;
+  job.slice = slice;
+  post(rowMail[row][(uint8_t)JobType::Prefetch], job);
+  return true;
+}
 
+void AudioEngine::stopRow(uint8_t row, uint32_t at) {
+  if (row >= ROW_COUNT) return;
+  // The row's voices keep streaming until the fade lands on `at`; the mixer
+  // flags them halted and service() retires them from there.
+  // Its own slot: a level change posted after it must not replace it.
   Job job;
-  job.type = JobType::Fade;
-  job.voice = voice;
+  job.type = JobType::Stop;
+  job.row = row;
   job.value = 0.0f;
   job.frames = STOP_FADE_FRAMES;
-  if (!enqueueJob(job)) {
-    armGainRamp(voice, 0.0f, STOP_FADE_FRAMES);
-  }
+  job.at = at;
+  post(rowMail[row][(uint8_t)JobType::Stop], job);
 }
 
 void AudioEngine::service() {
-  // The main loop calls this once per frame. We clear the queue first so
-  // freshly scheduled preloads/fades don't stall behind streaming work.
-  Job job;
-  for (uint8_t i = 0; i < JOB_QUEUE_SIZE; ++i) {
-    if (!popJob(job)) break;
-    handleJob(job);
+  TELEMETRY_SCOPE(Service);
+  // The main loop calls this once per frame. We clear the mailboxes first
+  // so freshly scheduled preloads/fades don't stall behind streaming work.
+  // A row's jobs run in the order they were posted: a stop then a trigger
+  // is not a trigger then a stop.
+  uint32_t seq = jobSeq;
+  if (seq != jobSeqSeen) {
+    // Anything posted from here on bumps jobSeq past seq and gets a pass.
+    jobSeqSeen = seq;
+    serviceJobs();
   }
 
-  // After the paperwork, keep the buffers primed and gains gliding.
+  // After the paperwork, keep the buffers primed.
   pumpStreams();
-  pumpGains();
 
-  // Voices that drained out get recycled back to a clean slate.
-  for (uint8_t v = 0; v < 4; ++v) {
+  // Voices that drained out (or whose stop fade landed) get recycled back to
+  // a clean slate and return to the pool.
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (voiceHalted[v]) {
+      noInterrupts();
+      voiceHalted[v] = false;
+      voiceStreaming[v] = false;
+      vavailable[v] = 0;
+      interrupts();
+    }
     cleanupVoice(v);
   }
 }
 
-void AudioEngine::onTimerISR(AudioEngine* self) {
-  if (self) self->isr();
+void AudioEngine::serviceJobs() {
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    Job jobs[ROW_JOB_KINDS];
+    uint8_t n = 0;
+    for (uint8_t k = 0; k < ROW_JOB_KINDS; ++k) {
+      if (!take(rowMail[r][k], jobs[n])) continue;
+      uint8_t i = n++;
+      while (i > 0 && (int32_t)(jobs[i].seq - jobs[i - 1].seq) < 0) {
+        Job t = jobs[i]; jobs[i] = jobs[i - 1]; jobs[i - 1] = t;
+        --i;
+      }
+    }
+    for (uint8_t i = 0; i < n; ++i) handleJob(jobs[i]);
+  }
+  Job job;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (take(diagMail[v], job)) handleJob(job);
+  }
+}
+
+void AudioEngine::onTimerISR() {
+  if (s_self) s_self->isr();
 }
 
+#if AUDIO_BLOCK_RENDER
+void AudioEngine::onDmaBlock(Adafruit_ZeroDMA*) {
+  // The half that just finished playing is free; the DMAC has already moved
+  // on to the other one.
+  uint8_t half = dmaDoneHalf;
+  if (s_self) s_self->render(dmaBuf[0][half], dmaBuf[1][half], AUDIO_BLOCK_FRAMES);
+  dmaDoneHalf = half ^ 1u;
+}
+#endif
+
 void AudioEngine::isr() {
   if (!running) return;
-  int32_t mix = 0;
-  for (uint8_t v = 0; v < 4; ++v) {
-    if (!voicePrimed[v]) continue;
-    uint32_t avail = vavailable[v];
-    if (avail == 0) {
-      if (!voiceStreaming[v]) {
-        voiceActive[v] = false;
+  TELEMETRY_SCOPE(Mix);
+  int32_t left, right;
+  mixFrame(left, right);
+  uint16_t dacL, dacR;
+  dacFromMix(left, right, dacL, dacR);
+  analogWrite(DAC_PIN_L, dacL);
+  analogWrite(DAC_PIN_R, dacR);
+}
+
+void AudioEngine::mixFrame(int32_t& left, int32_t& right) {
+  if (eventCount) applyDueEvents(1);
+  // Banked voices hold still while the flash is programming; the XIP window
+  // reads garbage until it's done.
+  bool bankBusy = bank && bank->busy();
+  int32_t mix[MIX_CHANNELS] = {};
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    int32_t gain = vgain[v] >> 15;
+    bool live = voiceRunning[v] && voicePrimed[v] && !(bankBusy && voiceDirect[v]);
+    if (live && (vrate[v] != RATE_UNITY || vphase[v] || vfx[v].on())) {
+      mixVoice(v, mix, 1);
+    } else if (live) {
+      uint32_t avail = vavailable[v];
+      if (avail == 0) {
+        if (!voiceStreaming[v]) {
+          voiceActive[v] = false;
+        } else {
+          noteStarved(v);
+        }
+      } else {
+        voiceStarved[v] = false;
+        uint32_t readIdx = vpos[v];
+        // Sources are signed 16-bit PCM already in RAM or mapped flash; no
+        // filesystem calls here.
+        int32_t sample = vsrc[v][readIdx];
+        mixInto(mix, sample, panned(gain, vpanL[v]), panned(gain, vpanR[v]));
+        readIdx++;
+        if (readIdx >= vsrcLen[v]) readIdx = 0;
+        vpos[v] = readIdx;
+        vavailable[v] = avail - 1;
+        if ((avail - 1u) == 0u && !voiceStreaming[v]) {
+          voiceActive[v] = false;
+        }
       }
-      continue;
     }
-    uint32_t readIdx = vpos[v];
-    // Buffers are pre-filled with signed 16-bit PCM; no disk reads here.
-    int32_t sample = vbuf[v][readIdx];
-    mix += (int32_t)(sample * vgainCurrent[v]);
-    readIdx++;
-    if (readIdx >= BUF_SAMPLES) readIdx = 0;
-    vpos[v] = readIdx;
-    vavailable[v] = avail - 1;
-    if ((avail - 1u) == 0u && !voiceStreaming[v]) {
+    if (vgainLeft[v]) advanceGain(v, 1);
+  }
+  sampleClock = sampleClock + 1;
+  left = mix[0];
+  right = mix[MIX_CHANNELS - 1];
+}
+
+void AudioEngine::render(uint16_t* outL, uint16_t* outR, uint16_t frames) {
+  TELEMETRY_SCOPE(Mix);
+  while (frames > 0) {
+    uint16_t n = (frames > AUDIO_BLOCK_FRAMES) ? AUDIO_BLOCK_FRAMES : frames;
+    renderBlock(outL, outR, n);
+    outL += n;
+    outR += n;
+    frames -= n;
+  }
+}
+
+void AudioEngine::renderBlock(uint16_t* outL, uint16_t* outR, uint16_t frames) {
+  int32_t acc[AUDIO_BLOCK_FRAMES * MIX_CHANNELS];
+  for (uint16_t i = 0; i < frames * MIX_CHANNELS; ++i) acc[i] = 0;
+
+  if (!running) {
+    for (uint16_t i = 0; i < frames; ++i) outL[i] = outR[i] = 2048;
+    return;
+  }
+
+  // Voice-outer, frame-inner: each voice is one or two contiguous runs of
+  // int16 loads and a multiply-shift into the accumulator, with no flags or
+  // wrap checks inside the inner loop. The block is cut wherever an event is
+  // due, and each voice's run again where its gain ramp ends, so timing and
+  // gains match isr() frame for frame. Free voices cost one flag test.
+  bool bankBusy = bank && bank->busy();
+  uint32_t done = 0;
+  while (done < frames) {
+    uint32_t run = applyDueEvents(frames - done);
+    for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+      bool live = voiceRunning[v] && voicePrimed[v] && !(bankBusy && voiceDirect[v]);
+      if (!live && !vgainLeft[v]) continue;
+      uint32_t pos = 0;
+      while (pos < run) {
+        uint32_t seg = run - pos;
+        uint32_t left = vgainLeft[v];
+        if (left && left < seg) seg = left;
+        if (live) mixVoice(v, acc + (done + pos) * MIX_CHANNELS, seg);
+        if (left) {
+          advanceGain(v, seg);
+          live = live && voiceRunning[v];
+        }
+        pos += seg;
+      }
+    }
+    sampleClock = sampleClock + run;
+    done += run;
+  }
+
+  for (uint16_t i = 0; i < frames; ++i) {
+    const int32_t* a = acc + i * MIX_CHANNELS;
+    dacFromMix(a[0], a[MIX_CHANNELS - 1], outL[i], outR[i]);
+  }
+}
+
+void AudioEngine::mixVoice(uint8_t v, int32_t* acc, uint32_t frames) {
+  if (vrate[v] != RATE_UNITY || vphase[v] || vfx[v].on()) {
+    // Off 1x or through effects: samples into a scratch run, the chain over
+    // that, then the same gain multiply as below.
+    int32_t x[AUDIO_BLOCK_FRAMES];
+    uint32_t n = readVoice(v, x, frames);
+    vfx[v].process(x, n);
+    int32_t g = vgain[v];
+    int32_t step = vgainLeft[v] ? vgainStep[v] : 0;
+    int32_t pl = vpanL[v], pr = vpanR[v];
+    for (uint32_t i = 0; i < n; ++i) {
+      int32_t gain = g >> 15;
+      mixInto(acc + i * MIX_CHANNELS, x[i], panned(gain, pl), panned(gain, pr));
+      g += step;
+    }
+    return;
+  }
+  uint32_t avail = vavailable[v];
+  if (avail < frames && voiceStreaming[v]) {
+    noteStarved(v);
+  } else {
+    voiceStarved[v] = false;
+  }
+  if (avail == 0) {
+    if (!voiceStreaming[v]) {
       voiceActive[v] = false;
     }
+    return;
+  }
+  uint32_t n = (avail < frames) ? avail : frames;
+  const int16_t* src = vsrc[v];
+  uint32_t len = vsrcLen[v];
+  uint32_t readIdx = vpos[v];
+  // Callers never hand us a run past the end of a ramp, so stepping g here
+  // lands exactly where advanceGain() will.
+  int32_t g = vgain[v];
+  int32_t step = vgainLeft[v] ? vgainStep[v] : 0;
+  int32_t pl = vpanL[v], pr = vpanR[v];
+  uint32_t done = 0;
+  while (done < n) {
+    uint32_t run = n - done;
+    if (run > len - readIdx) run = len - readIdx;
+    const int16_t* s = src + readIdx;
+    int32_t* a = acc + done * MIX_CHANNELS;
+    if (step == 0) {
+      int32_t gainL = panned(g >> 15, pl), gainR = panned(g >> 15, pr);
+      for (uint32_t i = 0; i < run; ++i) {
+        mixInto(a + i * MIX_CHANNELS, s[i], gainL, gainR);
+      }
+    } else {
+      for (uint32_t i = 0; i < run; ++i) {
+        int32_t gain = g >> 15;
+        mixInto(a + i * MIX_CHANNELS, s[i], panned(gain, pl), panned(gain, pr));
+        g += step;
+      }
+    }
+    done += run;
+    readIdx += run;
+    if (readIdx >= len) readIdx = 0;
+  }
+  vpos[v] = readIdx;
+  vavailable[v] = avail - n;
+  if ((avail - n) == 0u && !voiceStreaming[v]) {
+    voiceActive[v] = false;
+  }
+}
+
+uint32_t AudioEngine::readVoice(uint8_t v, int32_t* out, uint32_t frames) {
+  uint32_t avail = vavailable[v];
+  if (avail) voiceStarved[v] = false;
+  const int16_t* src = vsrc[v];
+  uint32_t len = vsrcLen[v];
+  uint32_t pos = vpos[v];
+  uint32_t phase = vphase[v];
+  int32_t rate = vrate[v];
+  uint32_t n = 0;
+  if (rate == RATE_UNITY && phase == 0) {
+    n = (avail < frames) ? avail : frames;
+    for (uint32_t i = 0; i < n; ++i) {
+      out[i] = src[pos];
+      if (++pos >= len) pos = 0;
+    }
+    avail -= n;
+  } else {
+    bool back = rate < 0;
+    uint32_t inc = (uint32_t)(back ? -rate : rate);
+    // One frame at a time either way, so isr() (one frame per call) and
+    // render() walk the same positions.
+    for (; n < frames && avail; ++n) {
+      out[n] = interpolate(src, len, pos, back, avail, phase);
+      phase += inc;
+      uint32_t adv = phase >> 16;
+      phase &= 0xFFFFu;
+      if (adv > avail) adv = avail;
+      avail -= adv;
+      pos = stepIndex(pos, adv, len, back);
+    }
+  }
+  if (n < frames && voiceStreaming[v]) noteStarved(v);
+  vpos[v] = pos;
+  vphase[v] = phase;
+  vavailable[v] = avail;
+  if (avail == 0u && !voiceStreaming[v]) {
+    voiceActive[v] = false;
+  }
+  return n;
+}
+
+void AudioEngine::noteStarved(uint8_t v) {
+  // Once per dry spell, however many frames or blocks it lasts.
+  if (voiceStarved[v]) return;
+  voiceStarved[v] = true;
+  TELEMETRY_COUNT(Underruns);
+}
+
+void AudioEngine::advanceGain(uint8_t v, uint32_t frames) {
+  uint32_t left = vgainLeft[v];
+  if (frames < left) {
+    // |step * frames| stays under |end - start|, so no overflow.
+    vgain[v] += vgainStep[v] * (int32_t)frames;
+    vgainLeft[v] = left - frames;
+    return;
+  }
+  vgain[v] = vgainEnd[v];
+  vgainLeft[v] = 0;
+  if (vgainStop[v] && voiceRunning[v]) {
+    voiceRunning[v] = false;
+    voiceActive[v] = false;
+    voiceHalted[v] = true;
+  }
+  vgainStop[v] = false;
+}
+
+uint32_t AudioEngine::applyDueEvents(uint32_t limit) {
+  uint32_t clock = sampleClock;
+  while (eventCount) {
+    const Event& ev = events[eventCount - 1];
+    int32_t wait = (int32_t)(ev.at - clock);
+    if (wait > 0) {
+      return ((uint32_t)wait < limit) ? (uint32_t)wait : limit;
+    }
+    applyEvent(ev);
+    eventCount = eventCount - 1;
   }
+  return limit;
+}
 
-  int32_t out = mix >> 1; // soft gain
-  if (out < -2047) out = -2047;
-  if (out >  2047) out =  2047;
-  uint16_t dac = (uint16_t)(out + 2048); // 0..4095
-  analogWrite(DAC_PIN_L, dac);
-  analogWrite(DAC_PIN_R, dac);
+void AudioEngine::applyEvent(const Event& ev) {
+  uint8_t v = ev.voice;
+  // Restaged (or stolen) since; whatever was posted for the old staging is
+  // moot.
+  if (ev.gen != voiceGen[v]) return;
+  if (ev.type == EventType::Rate) {
+    vrate[v] = ev.target;
+    return;
+  }
+  if (ev.type == EventType::Fx) {
+    vfx[v].set(ev.fx);
+    return;
+  }
+  if (ev.type == EventType::Start) {
+    voiceRunning[v] = true;
+    voiceStartFrame[v] = sampleClock;
+    vgain[v] = 0;
+  }
+  uint16_t frames = ev.frames ? ev.frames : 1;
+  vgainEnd[v] = ev.target;
+  vgainStep[v] = (ev.target - vgain[v]) / (int32_t)frames;
+  vgainLeft[v] = frames;
+  vgainStop[v] = ev.stop;
 }
 
-bool AudioEngine::enqueueJob(const Job& job) {
-  uint8_t next = (jobHead + 1) % JOB_QUEUE_SIZE;
-  if (next == jobTail) {
+void AudioEngine::postEvent(Event ev) {
+  if (ev.at == IMMEDIATE) ev.at = sampleClock;
+  noInterrupts();
+  if (eventCount >= EVENT_SLOTS) {
+    // Better early than lost: a dropped stop would leave a voice droning.
+    applyEvent(ev);
+    interrupts();
+    TELEMETRY_COUNT(EventsFull);
 #if defined(SERIAL_PORT_MONITOR)
-    Serial.println(F("AudioEngine: job queue overflow"));
+    Serial.println(F("AudioEngine: event list full"));
 #endif
-    return false;
+    return;
   }
-  jobQueue[jobHead] = job;
-  jobHead = next;
-  return true;
+  // Slide everything due no later than ev toward the tail; ties keep the
+  // order they were posted in.
+  uint8_t i = eventCount;
+  while (i > 0 && (int32_t)(events[i - 1].at - ev.at) <= 0) {
+    events[i] = events[i - 1];
+    --i;
+  }
+  events[i] = ev;
+  eventCount = eventCount + 1;
+  interrupts();
 }
 
-bool AudioEngine::popJob(Job& jobOut) {
-  if (jobTail == jobHead) {
-    return false;
-  }
-  jobOut = jobQueue[jobTail];
-  jobQueue[jobTail] = Job();
-  jobTail = (jobTail + 1) % JOB_QUEUE_SIZE;
+void AudioEngine::post(Mailbox& box, const Job& job) {
+  uint32_t p = box.posted;
+  if (p != box.taken) TELEMETRY_COUNT(JobsSuperseded);
+  box.posted = p + 1;   // odd: mid-write
+  mailFence();
+  uint32_t seq = jobSeq + 1;
+  box.job = job;
+  box.job.seq = seq;
+  mailFence();
+  box.posted = p + 2;
+  jobSeq = seq;         // last, once the job is whole
+}
+
+bool AudioEngine::take(Mailbox& box, Job& jobOut) {
+  uint32_t p = box.posted;
+  if (p == box.taken || (p & 1u)) return false;
+  mailFence();
+  jobOut = box.job;
+  mailFence();
+  // Overwritten under us: the newer job is handled next pass.
+  if (box.posted != p) return false;
+  box.taken = p;
   return true;
 }
 
@@ -208,190 +850,438 @@ void AudioEngine::handleJob(const Job& job) {
     case JobType::Preload:
       handlePreload(job);
       break;
+    case JobType::Prefetch:
+      handlePrefetch(job);
+      break;
     case JobType::Fade:
+    case JobType::Stop:
+      // A stop is a fade to nothing.
       handleFade(job);
       break;
+    case JobType::Rate:
+      handleRate(job);
+      break;
+    case JobType::Fx:
+      handleFx(job);
+      break;
     case JobType::Diagnostics:
       handleDiagnostics(job);
       break;
-    case JobType::None:
     default:
       break;
   }
 }
 
 void AudioEngine::handlePreload(const Job& job) {
-  uint8_t voice = job.voice;
-  if (voice >= 4 || !storage) return;
+  uint8_t row = job.row;
+  if (row >= ROW_COUNT || !storage) return;
 
-  noInterrupts();
-  vavailable[voice] = 0;
-  vpos[voice] = 0;
-  voiceActive[voice] = false;
-  voicePrimed[voice] = false;
-  voiceStreaming[voice] = false;
-  interrupts();
+  uint8_t voice = allocVoice(job.slice);
+  if (voice >= VOICE_COUNT) {
+#if defined(SERIAL_PORT_MONITOR)
+    Serial.println(F("AudioEngine: no voice to steal"));
+#endif
+    return;
+  }
 
-  vwrite[voice] = 0;
-  voiceLoadedSamples[voice] = 0;
-  voiceTotalSamples[voice] = 0;
-  voiceDiagPending[voice] = false;
-  voiceNeedsFadeIn[voice] = true;
+  uint32_t at = (job.at == IMMEDIATE) ? sampleClock : job.at;
+  if (rowMode[row] == RowMode::Choke) {
+    // The row's previous hit fades out across the new one's fade-in.
+    for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+      if (v != voice && voiceRow[v] == row) {
+        stopVoice(v, at, DEFAULT_FADE_FRAMES);
+      }
+    }
+  }
 
-  strncpy(voicePath[voice], job.path, MAX_PATH_LEN - 1);
-  voicePath[voice][MAX_PATH_LEN - 1] = '\0';
+  resetVoice(voice);
+  voiceRow[voice] = row;
+  voiceStartAt[voice] = at;
+  voiceReverse[voice] = rowRate[row] < 0;
+  vrate[voice] = rowRate[row];
+  vfx[voice].reset(rowFx[row]);
+  vpanL[voice] = PAN_LUT[PAN_STEPS - rowPan[row]];
+  vpanR[voice] = PAN_LUT[rowPan[row]];
+  if (voiceSlice[voice] != job.slice || voiceHeldGen[voice] != storage->generation()) {
+    voiceHeldSamples[voice] = 0;
+  }
+  voiceSlice[voice] = job.slice;
 
-  int32_t total = storage->rawSampleCount(voicePath[voice]);
-  if (total <= 0) {
+  // Banked slices skip the filesystem and the ring buffer entirely; a slice
+  // the ring still holds just rewinds; a prefetched one is copied out of the
+  // row's shadow; anything else starts from its resident head (or, played
+  // backwards, from nothing at its end). Whatever isn't in RAM yet streams
+  // in behind.
+  if (!startDirect(voice) && !startHeld(voice) && !startShadow(voice, row)) {
+    bool back = voiceReverse[voice];
+    uint32_t total = 0;
+    uint32_t head = back ? 0 : storage->readSliceHead(job.slice, vbuf[voice], BUF_SAMPLES, &total);
+    if (head == 0) {
+      int32_t count = storage->rawSampleCount(job.slice);
+      if (count <= 0) {
 #if defined(SERIAL_PORT_MONITOR)
-    Serial.print(F("AudioEngine: missing slice "));
-    Serial.println(voicePath[voice]);
+        Serial.print(F("AudioEngine: missing slice "));
+        Serial.println(slicePath(job.slice));
 #endif
-    voiceNeedsFadeIn[voice] = false;
-    return;
+        return;
+      }
+      total = (uint32_t)count;
+    }
+
+    voiceTotalSamples[voice] = total;
+    voiceLoadedSamples[voice] = head;
+    vwrite[voice] = (back ? total : head) % BUF_SAMPLES;
+    voiceHeldGen[voice] = storage->generation();
+    voiceHeldTotal[voice] = total;
+    voiceHeldSamples[voice] = (total <= BUF_SAMPLES) ? head : 0;
+    voiceStreaming[voice] = head < total;
+    if (head) {
+      noInterrupts();
+      vavailable[voice] = head;
+      voicePrimed[voice] = true;
+      voiceActive[voice] = true;
+      interrupts();
+    } else {
+      // Cold slice: fetch the first chunk now so it's in RAM before the
+      // start frame.
+      if (back) {
+        noInterrupts();
+        vpos[voice] = (total - 1u) % BUF_SAMPLES;
+        interrupts();
+      }
+      pumpStreams();
+    }
   }
 
-  voiceTotalSamples[voice] = (uint32_t)total;
-  vgainCurrent[voice] = 0.0f;
-  armGainRamp(voice, 0.0f, 1);
+  // The voice is staged but silent; the mixer starts it (and fades it in)
+  // on the requested frame.
+  Event ev;
+  ev.at = at;
+  ev.voice = voice;
+  ev.type = EventType::Start;
+  ev.gen = voiceGen[voice];
+  ev.target = gainToQ30(rowLevel[row]);
+  ev.frames = DEFAULT_FADE_FRAMES;
+  postEvent(ev);
+}
 
-  voiceStreaming[voice] = true;
+void AudioEngine::handleFade(const Job& job) {
+  uint8_t row = job.row;
+  if (row >= ROW_COUNT) return;
+  uint32_t at = (job.at == IMMEDIATE) ? sampleClock : job.at;
+  uint16_t frames = job.frames ? job.frames : 1;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (voiceRow[v] != row) continue;
+    if (job.value <= 0.0001f) {
+      // Fading to nothing ends the voice; rowLevel keeps the play level for
+      // the next trigger.
+      stopVoice(v, at, frames);
+    } else if (!voiceDraining[v]) {
+      Event ev;
+      ev.at = at;
+      ev.voice = v;
+      ev.type = EventType::Gain;
+      ev.gen = voiceGen[v];
+      ev.target = gainToQ30(job.value);
+      ev.frames = frames;
+      postEvent(ev);
+    }
+  }
+}
 
-  // Try to immediately seed the buffer so playback starts on the very next tick.
-  pumpStreams();
+void AudioEngine::handleRate(const Job& job) {
+  uint8_t row = job.row;
+  if (row >= ROW_COUNT) return;
+  uint32_t at = (job.at == IMMEDIATE) ? sampleClock : job.at;
+  int32_t rate = rateToQ16(job.value);
+  if (rate < 0) rate = -rate;
+  // Tails bend too; each voice keeps the direction it was triggered in.
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (voiceRow[v] != row) continue;
+    Event ev;
+    ev.at = at;
+    ev.voice = v;
+    ev.type = EventType::Rate;
+    ev.gen = voiceGen[v];
+    ev.target = voiceReverse[v] ? -rate : rate;
+    postEvent(ev);
+  }
 }
 
-void AudioEngine::handleFade(const Job& job) {
-  uint8_t voice = job.voice;
-  if (voice >= 4) return;
-  vgainDesired[voice] = job.value;
-  armGainRamp(voice, job.value, job.frames ? job.frames : 1);
-  if (job.value <= 0.0001f) {
-    voiceDraining[voice] = true;
+void AudioEngine::handleFx(const Job& job) {
+  uint8_t row = job.row;
+  if (row >= ROW_COUNT) return;
+  uint32_t at = (job.at == IMMEDIATE) ? sampleClock : job.at;
+  // The latest settings for the row, whichever setFx() this job was.
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (voiceRow[v] != row) continue;
+    Event ev;
+    ev.at = at;
+    ev.voice = v;
+    ev.type = EventType::Fx;
+    ev.gen = voiceGen[v];
+    ev.fx = rowFx[row];
+    postEvent(ev);
   }
 }
 
+void AudioEngine::stopVoice(uint8_t voice, uint32_t at, uint16_t frames) {
+  if (voiceDraining[voice]) return;
+  if (!voiceRunning[voice] && (int32_t)(at - voiceStartAt[voice]) <= 0) {
+    // Stopped no later than its pending Start: drop the staging and let
+    // cleanupVoice() hand the voice back.
+    resetVoice(voice);
+    return;
+  }
+  voiceDraining[voice] = true;
+  voiceStopAt[voice] = at + frames;
+  Event ev;
+  ev.at = at;
+  ev.voice = voice;
+  ev.type = EventType::Gain;
+  ev.gen = voiceGen[voice];
+  ev.stop = true;
+  ev.target = 0;
+  ev.frames = frames;
+  postEvent(ev);
+}
+
 void AudioEngine::handleDiagnostics(const Job& job) {
-  uint8_t voice = job.voice;
-  if (voice >= 4) return;
+  uint8_t voice = job.row;
+  if (voice >= VOICE_COUNT) return;
 #if defined(SERIAL_PORT_MONITOR)
   Serial.print(F("[AudioEngine] v"));
   Serial.print(voice);
+  Serial.print(F(" row:"));
+  Serial.print((int)(voiceRow[voice] == NO_ROW ? -1 : voiceRow[voice]));
   Serial.print(F(" active:"));
   Serial.print(voiceActive[voice]);
   Serial.print(F(" streaming:"));
   Serial.print(voiceStreaming[voice]);
+  Serial.print(F(" direct:"));
+  Serial.print(voiceDirect[voice]);
+  Serial.print(F(" running:"));
+  Serial.print(voiceRunning[voice]);
   Serial.print(F(" available:"));
   Serial.print((unsigned long)vavailable[voice]);
   Serial.print(F(" loaded:"));
   Serial.print((unsigned long)voiceLoadedSamples[voice]);
   Serial.print(F(" total:"));
-  Serial.println((unsigned long)voiceTotalSamples[voice]);
+  Serial.print((unsigned long)voiceTotalSamples[voice]);
+  Serial.print(F(" steals:"));
+  Serial.println((unsigned long)voiceSteals);
 #endif
-  voiceDiagPending[voice] = false;
 }
 
 void AudioEngine::pumpStreams() {
   if (!storage) return;
-  for (uint8_t v = 0; v < 4; ++v) {
-    if (!voiceStreaming[v]) continue;
+  TELEMETRY_SCOPE(Pump);
 
+  // The slowest recent gap between refills, held and let go slowly: the next
+  // one could be that long again.
+  uint32_t now = sampleClock;
+  uint32_t gap = now - pumpLastAt;
+  pumpLastAt = now;
+  if (gap > BUF_SAMPLES) gap = BUF_SAMPLES;
+  pumpGapPeak = (gap > pumpGapPeak) ? gap : pumpGapPeak - (pumpGapPeak >> 6);
+  uint32_t urgent = pumpGapPeak * 2u + STREAM_CHUNK_MIN;
+  uint32_t want = pumpGapPeak * STREAM_AHEAD_PASSES + STREAM_CHUNK_MIN;
+  if (urgent > BUF_SAMPLES) urgent = BUF_SAMPLES;
+  if (want > BUF_SAMPLES) want = BUF_SAMPLES;
+
+  // Earliest deadline first. A voice's deadline is the frames it can play
+  // from its ring at its rate, plus the wait for its Start if it hasn't
+  // sounded yet. Targets below are in frames too; reads convert back.
+  uint8_t order[VOICE_COUNT];
+  uint32_t lasts[VOICE_COUNT];
+  uint32_t inc[VOICE_COUNT];
+  uint8_t n = 0;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (!voiceStreaming[v]) continue;
     uint32_t avail;
+    int32_t rate;
+    bool runningNow;
     noInterrupts();
     avail = vavailable[v];
+    rate = vrate[v];
+    runningNow = voiceRunning[v];
     interrupts();
-
-    uint32_t freeSpace = BUF_SAMPLES - avail;
-    if (freeSpace == 0) {
-      continue;
-    }
-
-    uint32_t remaining = voiceTotalSamples[v] - voiceLoadedSamples[v];
-    if (remaining == 0) {
+    inc[v] = (uint32_t)(rate < 0 ? -rate : rate);
+    if (voiceTotalSamples[v] == voiceLoadedSamples[v]) {
       voiceStreaming[v] = false;
       continue;
     }
-
-    uint32_t chunk = STREAM_CHUNK;
-    if (chunk > remaining) chunk = remaining;
-    if (chunk > freeSpace) chunk = freeSpace;
-    if (chunk == 0) {
-      continue;
-    }
-
-    // Split the request if we would wrap the circular buffer.
-    uint32_t firstPart = chunk;
-    uint32_t spaceToEnd = BUF_SAMPLES - vwrite[v];
-    if (firstPart > spaceToEnd) {
-      firstPart = spaceToEnd;
+    if (runningNow) telemetry.fill(v, avail);
+    uint32_t d = framesAt(avail, inc[v]);
+    if (!runningNow && (int32_t)(voiceStartAt[v] - now) > 0) d += voiceStartAt[v] - now;
+    uint8_t i = n++;
+    while (i > 0 && lasts[i - 1] > d) {
+      order[i] = order[i - 1];
+      lasts[i] = lasts[i - 1];
+      --i;
     }
+    order[i] = v;
+    lasts[i] = d;
+  }
 
-    uint32_t totalRead = 0;
-    if (firstPart > 0) {
-      // Pull the next slice straight from flash into the buffer tail.
-      int32_t read1 = storage->readRawChunk(voicePath[v], voiceLoadedSamples[v], &vbuf[v][vwrite[v]], firstPart);
-      if (read1 < 0) {
-#if defined(SERIAL_PORT_MONITOR)
-        Serial.print(F("AudioEngine: read fail "));
-        Serial.println(voicePath[v]);
-#endif
-        voiceStreaming[v] = false;
-        continue;
+  // Every voice that could run dry over two more slow passes first gets a
+  // short read, most urgent first, so a voice staged just ahead of its
+  // Start isn't left waiting behind the others' long ones. The second round
+  // brings them all the way to `urgent`. Then each tops up to `want` and
+  // beyond, as far as the read budget buys at the measured rate; past the
+  // budget a voice that isn't urgent waits for the next pass.
+  uint32_t spentUs = 0;
+  for (uint8_t round = 0; round < 3; ++round) {
+    for (uint8_t i = 0; i < n; ++i) {
+      uint8_t v = order[i];
+      if (!voiceStreaming[v]) continue;
+      uint32_t target = round < 2 ? urgent : want;
+      if (voiceDraining[v]) {
+        // Stopping: it only needs what it plays until its fade lands (the
+        // crossfade into the row's next voice, usually).
+        int32_t left = (int32_t)(voiceStopAt[v] - now);
+        if (left < 0) left = 0;
+        if ((uint32_t)left < target) target = (uint32_t)left;
       }
-      totalRead += (uint32_t)read1;
-      voiceLoadedSamples[v] += (uint32_t)read1;
-      vwrite[v] = (vwrite[v] + (uint32_t)read1) % BUF_SAMPLES;
-      if ((uint32_t)read1 < firstPart) {
-        // Hit EOF early.
-        chunk = totalRead;
-      }
-    }
-
-    if (totalRead < chunk) {
-      uint32_t secondPart = chunk - totalRead;
-      if (secondPart > 0) {
-        // Wrap-around case: finish writing at the head of the ring buffer.
-        int32_t read2 = storage->readRawChunk(voicePath[v], voiceLoadedSamples[v], &vbuf[v][vwrite[v]], secondPart);
-        if (read2 > 0) {
-          totalRead += (uint32_t)read2;
-          voiceLoadedSamples[v] += (uint32_t)read2;
-          vwrite[v] = (vwrite[v] + (uint32_t)read2) % BUF_SAMPLES;
+      uint32_t need = (target > lasts[i]) ? samplesAt(target - lasts[i], inc[v]) : 0;
+      uint32_t chunk;
+      if (round < 2 || voiceDraining[v]) {
+        if (need == 0) continue;
+        chunk = (need < STREAM_CHUNK_MIN) ? STREAM_CHUNK_MIN : need;
+        if (round == 0 && chunk > STREAM_CHUNK_MIN * 4u) chunk = STREAM_CHUNK_MIN * 4u;
+      } else {
+        uint32_t leftUs = (spentUs < STREAM_BUDGET_US) ? STREAM_BUDGET_US - spentUs : 0;
+        uint32_t afford = readCostQ8 ? (uint32_t)(((uint64_t)leftUs << 8) / (uint32_t)readCostQ8) : STREAM_CHUNK_MAX;
+        if (afford > STREAM_CHUNK_MAX) afford = STREAM_CHUNK_MAX;
+        chunk = (need > afford) ? need : afford;
+        if (chunk < STREAM_CHUNK_MIN) {
+          if (lasts[i] >= urgent) {
+            TELEMETRY_COUNT(StreamsDeferred);
+            continue;
+          }
+          chunk = STREAM_CHUNK_MIN;
         }
       }
+      uint32_t t0 = micros();
+      uint32_t got = refill(v, chunk);
+      uint32_t tookUs = micros() - t0;
+      spentUs += tookUs;
+      lasts[i] += framesAt(got, inc[v]);
+      if (got >= STREAM_CHUNK_MAX / 2u) {
+        // Microseconds per sample, Q8, smoothed over the last few reads.
+        // Only long reads count: the per-call overhead would make short
+        // ones look slow, and the budget is spent on long ones.
+        int32_t cost = (int32_t)(((uint64_t)tookUs << 8) / got);
+        readCostQ8 += (cost - readCostQ8) / 8;
+      }
     }
+  }
+}
 
-    if (totalRead > 0) {
-      noInterrupts();
-      vavailable[v] += totalRead;
-      voicePrimed[v] = true;
-      voiceActive[v] = true;
-      interrupts();
+uint32_t AudioEngine::refill(uint8_t v, uint32_t chunk) {
+  uint32_t avail;
+  noInterrupts();
+  avail = vavailable[v];
+  interrupts();
+  uint32_t freeSpace = BUF_SAMPLES - avail;
+#if VARISPEED_CUBIC
+  // The 4-point curve reads one sample behind the read position; leave it.
+  if (freeSpace) freeSpace--;
+#endif
+  uint32_t remaining = voiceTotalSamples[v] - voiceLoadedSamples[v];
+  if (chunk > remaining) chunk = remaining;
+  if (chunk > freeSpace) chunk = freeSpace;
+  if (chunk == 0) {
+    return 0;
+  }
 
-      if (voiceNeedsFadeIn[v]) {
-        voiceNeedsFadeIn[v] = false;
-        armGainRamp(v, vgainDesired[v], DEFAULT_FADE_FRAMES);
+  uint32_t totalRead = 0;
+  if (voiceReverse[v]) {
+    // Backwards: each read fills the run just below vwrite, slice sample k
+    // on ring slot k % BUF_SAMPLES as it would be going forwards; a chunk
+    // that crosses slot 0 finishes at the top of the ring.
+    while (totalRead < chunk) {
+      uint32_t top = vwrite[v] ? vwrite[v] : BUF_SAMPLES;
+      uint32_t part = chunk - totalRead;
+      if (part > top) part = top;
+      uint32_t offset = voiceTotalSamples[v] - voiceLoadedSamples[v] - part;
+      int32_t got = storage->readRawChunk(voiceSlice[v], offset, &vbuf[v][top - part], part);
+      if (got != (int32_t)part) {
+        // Short of the end of the file, so anything short is a failure.
+        streamFailed(v);
+        break;
       }
+      totalRead += part;
+      voiceLoadedSamples[v] += part;
+      vwrite[v] = top - part;
     }
+    chunk = 0;
+  }
 
-    if (voiceLoadedSamples[v] >= voiceTotalSamples[v]) {
-      voiceStreaming[v] = false;
+  // Split the request if we would wrap the circular buffer.
+  uint32_t firstPart = chunk;
+  uint32_t spaceToEnd = BUF_SAMPLES - vwrite[v];
+  if (firstPart > spaceToEnd) {
+    firstPart = spaceToEnd;
+  }
+
+  if (firstPart > 0) {
+    // Pull the next slice straight from flash into the buffer tail.
+    int32_t read1 = storage->readRawChunk(voiceSlice[v], voiceLoadedSamples[v], &vbuf[v][vwrite[v]], firstPart);
+    if (read1 < 0) {
+      streamFailed(v);
+      return 0;
+    }
+    totalRead += (uint32_t)read1;
+    voiceLoadedSamples[v] += (uint32_t)read1;
+    vwrite[v] = (vwrite[v] + (uint32_t)read1) % BUF_SAMPLES;
+    if ((uint32_t)read1 < firstPart) {
+      // Hit EOF early.
+      chunk = totalRead;
     }
   }
-}
 
-void AudioEngine::pumpGains() {
-  for (uint8_t v = 0; v < 4; ++v) {
-    if (vgainFrames[v] > 0) {
-      vgainCurrent[v] += vgainStep[v];
-      vgainFrames[v]--;
-      if (vgainFrames[v] == 0) {
-        vgainCurrent[v] = vgainTarget[v];
-        vgainStep[v] = 0.0f;
+  if (totalRead < chunk) {
+    uint32_t secondPart = chunk - totalRead;
+    if (secondPart > 0) {
+      // Wrap-around case: finish writing at the head of the ring buffer.
+      int32_t read2 = storage->readRawChunk(voiceSlice[v], voiceLoadedSamples[v], &vbuf[v][vwrite[v]], secondPart);
+      if (read2 > 0) {
+        totalRead += (uint32_t)read2;
+        voiceLoadedSamples[v] += (uint32_t)read2;
+        vwrite[v] = (vwrite[v] + (uint32_t)read2) % BUF_SAMPLES;
       }
-    } else {
-      vgainCurrent[v] = vgainTarget[v];
     }
   }
+
+  if (totalRead > 0) {
+    noInterrupts();
+    vavailable[v] += totalRead;
+    voicePrimed[v] = true;
+    voiceActive[v] = true;
+    interrupts();
+
+    // Slices that fit the ring never wrap, so everything loaded so far is
+    // still there for a rewind (backwards, once it's all there).
+    if (voiceTotalSamples[v] <= BUF_SAMPLES &&
+        (!voiceReverse[v] || voiceLoadedSamples[v] == voiceTotalSamples[v])) {
+      voiceHeldSamples[v] = voiceLoadedSamples[v];
+    }
+  }
+
+  if (voiceLoadedSamples[v] >= voiceTotalSamples[v]) {
+    voiceStreaming[v] = false;
+  }
+  return totalRead;
+}
+
+void AudioEngine::streamFailed(uint8_t v) {
+#if defined(SERIAL_PORT_MONITOR)
+  Serial.print(F("AudioEngine: read fail "));
+  Serial.println(slicePath(voiceSlice[v]));
+#endif
+  TELEMETRY_COUNT(ReadFails);
+  voiceStreaming[v] = false;
 }
 
 void AudioEngine::cleanupVoice(uint8_t voice) {
@@ -406,41 +1296,192 @@ void AudioEngine::cleanupVoice(uint8_t voice) {
     if (voicePrimed[voice]) {
       voicePrimed[voice] = false;
     }
-    voiceNeedsFadeIn[voice] = false;
     voiceLoadedSamples[voice] = 0;
     voiceTotalSamples[voice] = 0;
     vwrite[voice] = 0;
-    vgainCurrent[voice] = 0.0f;
-    vgainTarget[voice] = vgainDesired[voice];
-    vgainStep[voice] = 0.0f;
-    vgainFrames[voice] = 0;
     voiceDraining[voice] = false;
+    voiceRow[voice] = NO_ROW;
 
     noInterrupts();
     vpos[voice] = 0;
+    vphase[voice] = 0;
+    voiceDirect[voice] = false;
+    voiceRunning[voice] = false;
+    vgain[voice] = 0;
+    vgainLeft[voice] = 0;
+    vgainStop[voice] = false;
+    vsrc[voice] = vbuf[voice];
+    vsrcLen[voice] = BUF_SAMPLES;
     interrupts();
 
+    // Once per retirement; the next preload re-arms it.
     if (!voiceDiagPending[voice]) {
       voiceDiagPending[voice] = true;
-      Job job;
-      job.type = JobType::Diagnostics;
-      job.voice = voice;
-      if (!enqueueJob(job)) {
-        voiceDiagPending[voice] = false;
-      }
+      requestDiagnostics(voice);
     }
   }
 }
 
-void AudioEngine::armGainRamp(uint8_t voice, float target, uint16_t frames) {
-  if (voice >= 4) return;
-  vgainTarget[voice] = target;
-  if (frames == 0) {
-    vgainCurrent[voice] = target;
-    vgainStep[voice] = 0.0f;
-    vgainFrames[voice] = 0;
+uint8_t AudioEngine::allocVoice(SliceId slice) {
+  // A free voice whose ring still holds this slice rewinds it; otherwise
+  // take a free voice, sparing ones that hold something.
+  uint8_t pick = VOICE_COUNT;
+  uint32_t gen = storage->generation();
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (voiceRow[v] != NO_ROW) continue;
+    if (voiceHeldSamples[v] && voiceHeldGen[v] == gen && voiceSlice[v] == slice) {
+      return v;
+    }
+    if (pick == VOICE_COUNT || (voiceHeldSamples[pick] && !voiceHeldSamples[v])) pick = v;
+  }
+  if (pick < VOICE_COUNT) return pick;
+
+  // Pool's dry: steal the quietest sounding voice. One already fading out
+  // counts at a quarter of its level; ties go to the oldest. Voices still
+  // waiting on their Start are left alone.
+  int32_t quietest = 0;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (!voiceRunning[v]) continue;
+    int32_t level = vgain[v];
+    if (voiceDraining[v]) level >>= 2;
+    if (pick == VOICE_COUNT || level < quietest ||
+        (level == quietest && (int32_t)(voiceStartFrame[v] - voiceStartFrame[pick]) < 0)) {
+      pick = v;
+      quietest = level;
+    }
+  }
+  if (pick < VOICE_COUNT) voiceSteals++;
+  return pick;
+}
+
+void AudioEngine::resetVoice(uint8_t voice) {
+  noInterrupts();
+  vavailable[voice] = 0;
+  vpos[voice] = 0;
+  vrate[voice] = RATE_UNITY;
+  vphase[voice] = 0;
+  voiceActive[voice] = false;
+  voicePrimed[voice] = false;
+  voiceStreaming[voice] = false;
+  voiceDirect[voice] = false;
+  voiceRunning[voice] = false;
+  voiceHalted[voice] = false;
+  voiceGen[voice] = voiceGen[voice] + 1;
+  vsrc[voice] = vbuf[voice];
+  vsrcLen[voice] = BUF_SAMPLES;
+  vgain[voice] = 0;
+  vgainLeft[voice] = 0;
+  vgainStop[voice] = false;
+  voiceStarved[voice] = false;
+  interrupts();
+
+  vwrite[voice] = 0;
+  voiceLoadedSamples[voice] = 0;
+  voiceTotalSamples[voice] = 0;
+  voiceDraining[voice] = false;
+  voiceReverse[voice] = false;
+  voiceDiagPending[voice] = false;
+}
+
+bool AudioEngine::startDirect(uint8_t voice) {
+  if (!bank || !bank->ready()) return false;
+  SampleBank::Slice slice;
+  SliceId id = voiceSlice[voice];
+  if (!sliceValid(id) || !bank->slice(sliceRow(id), sliceIndex(id), slice)) return false;
+
+  voiceTotalSamples[voice] = slice.samples;
+  voiceLoadedSamples[voice] = slice.samples;
+
+  // The whole slice is "available" the moment the pointer is set.
+  noInterrupts();
+  vsrc[voice] = slice.data;
+  vsrcLen[voice] = slice.samples;
+  vpos[voice] = (voiceReverse[voice] && slice.samples) ? slice.samples - 1u : 0;
+  vavailable[voice] = slice.samples;
+  voiceDirect[voice] = true;
+  voiceStreaming[voice] = false;
+  voicePrimed[voice] = true;
+  voiceActive[voice] = true;
+  interrupts();
+  return true;
+}
+
+bool AudioEngine::startHeld(uint8_t voice) {
+  uint32_t held = voiceHeldSamples[voice];
+  if (held == 0) return false;
+  uint32_t total = voiceHeldTotal[voice];
+  // Backwards needs the end, so only a slice held whole rewinds.
+  bool back = voiceReverse[voice];
+  if (back && held < total) return false;
+
+  voiceTotalSamples[voice] = total;
+  voiceLoadedSamples[voice] = held;
+  vwrite[voice] = held % BUF_SAMPLES;
+  voiceStreaming[voice] = held < total;
+
+  noInterrupts();
+  vpos[voice] = back ? total - 1u : 0;
+  vavailable[voice] = held;
+  voicePrimed[voice] = true;
+  voiceActive[voice] = true;
+  interrupts();
+  return true;
+}
+
+bool AudioEngine::startShadow(uint8_t voice, uint8_t row) {
+  const Shadow& sh = shadows[row];
+  if (voiceReverse[voice] || !sh.ready || sh.gen != storage->generation() || sh.slice != voiceSlice[voice]) {
+    return false;
+  }
+  uint32_t n = sh.samples;
+  memcpy(vbuf[voice], vshadow[row], n * sizeof(int16_t));
+  voiceTotalSamples[voice] = sh.total;
+  voiceLoadedSamples[voice] = n;
+  vwrite[voice] = n % BUF_SAMPLES;
+  voiceHeldGen[voice] = sh.gen;
+  voiceHeldTotal[voice] = sh.total;
+  voiceHeldSamples[voice] = (sh.total <= BUF_SAMPLES) ? n : 0;
+  voiceStreaming[voice] = n < sh.total;
+
+  noInterrupts();
+  vavailable[voice] = n;
+  voicePrimed[voice] = true;
+  voiceActive[voice] = true;
+  interrupts();
+  return true;
+}
+
+void AudioEngine::handlePrefetch(const Job& job) {
+  uint8_t row = job.row;
+  if (row >= ROW_COUNT || !storage) return;
+  Shadow& sh = shadows[row];
+  if (sh.ready && sh.gen == storage->generation() && sh.slice == job.slice) {
     return;
   }
-  vgainFrames[voice] = frames;
-  vgainStep[voice] = (target - vgainCurrent[voice]) / (float)frames;
+  // A head is no use to a row playing backwards.
+  if (rowRate[row] < 0) return;
+  // Banked slices play straight from mapped flash; nothing to stage.
+  SampleBank::Slice slice;
+  if (bank && bank->ready() && bank->slice(sliceRow(job.slice), sliceIndex(job.slice), slice)) return;
+
+  sh.ready = false;
+  uint32_t total = 0;
+  uint32_t n = storage->readSliceHead(job.slice, vshadow[row], PREFETCH_SAMPLES, &total);
+  if (n == 0) {
+    int32_t count = storage->rawSampleCount(job.slice);
+    if (count <= 0) return;
+    total = (uint32_t)count;
+  }
+  while (n < PREFETCH_SAMPLES && n < total) {
+    int32_t got = storage->readRawChunk(job.slice, n, vshadow[row] + n, PREFETCH_SAMPLES - n);
+    if (got <= 0) break;
+    n += (uint32_t)got;
+  }
+  if (n == 0) return;
+
+  sh.samples = n;
+  sh.total = total;
+  sh.gen = storage->generation();
+  sh.slice = job.slice;
+  sh.ready = true;
 }
@@ -1,98 +1,330 @@
-
 #pragma once
 #include <Arduino.h>
 #include "Config.h"
+#include "SliceId.h"
+#include "VoiceFx.h"
 
 // Forward decl for Storage read
 class Storage;
+class SampleBank;
+class Adafruit_ZeroDMA;
 
 // AudioEngine is the mixer + transport glue. The main loop calls service()
-// to shovel jobs and buffers around; the ISR only mixes ready samples.
+// to shovel jobs and buffers around; the ISR (or, in block mode, the DMA
+// block-done interrupt) only mixes ready samples.
+//
+// Rows (0..ROW_COUNT-1) don't own voices. Every trigger takes a voice from a
+// pool of VOICE_COUNT; a choke row fades its previous voice out across the
+// new one's fade-in, a poly row lets it ring. When the pool is dry the
+// quietest voice is stolen.
+//
+// Starts, stops and level changes take an optional sample-clock timestamp
+// (see now()). The mixer applies each one on exactly that frame, so voices
+// triggered for the same step start together however late service() ran.
+//
+// Requests don't queue. Each row has one pending slot per kind (preload,
+// prefetch, level, stop, rate, effects), and posting overwrites whatever
+// that slot held, so a burst of calls before service() runs leaves only the
+// latest of each kind -- nothing to overflow.
 class AudioEngine {
 public:
+  // Timestamp meaning "next frame the mixer renders".
+  static constexpr uint32_t IMMEDIATE = 0xFFFFFFFFu;
+  // Playback rate, Q16.16 slice samples per frame.
+  static constexpr int32_t RATE_UNITY = 1 << 16;
+
+  // One slice of a full-length take (MAX_RECORD_SAMPLES chopped into 8,
+  // rounded up).
+  static constexpr uint32_t SLICE_SAMPLES = (MAX_RECORD_SAMPLES + 7u) / 8u;
+  // Per-voice ring. The pool splits what four whole-slice buffers used to
+  // take, so past four voices a long slice streams through its ring
+  // instead of sitting in it whole. A streaming recorder has no capture
+  // buffer, so the rings get that RAM too.
+#if RECORD_STREAM_TO_FLASH
+  static constexpr uint32_t BUF_SAMPLES = SLICE_SAMPLES * 8u / VOICE_COUNT;
+#else
+  static constexpr uint32_t BUF_SAMPLES = SLICE_SAMPLES * 4u / VOICE_COUNT;
+#endif
+  static_assert(BUF_SAMPLES >= PREFETCH_SAMPLES, "voice ring smaller than a prefetched head");
+  static_assert(BUF_SAMPLES >= STREAM_CHUNK_MAX, "voice ring smaller than a stream chunk");
+
+  enum class RowMode : uint8_t {
+    Choke,   // a retrigger crossfades out whatever the row was playing
+    Poly,    // retriggers overlap until the pool runs out
+  };
+
   bool begin();
   void attachStorage(Storage* s) { storage = s; }
+  // Optional: slices found in the bank play straight from mapped flash.
+  void attachSampleBank(SampleBank* b) { bank = b; }
   void start();
   void stop();
 
-  // schedule to play a raw slice file (e.g., "/A/A1.raw") on a voice (0..3)
-  bool preloadAndPlay(uint8_t voice, const char* path);
+  // Frames mixed since begin(); wraps after ~54 h, compare with signed deltas.
+  uint32_t now() const { return sampleClock; }
+  // No voice is playing or waiting to, so nothing reads flash.
+  bool idle() const;
+
+  void setRowMode(uint8_t row, RowMode mode);
+  // Row pan for its next triggers, -1 left .. 1 right (STEREO_OUT); a
+  // sounding voice stays where it started.
+  void setPan(uint8_t row, float pan);
+
+  // schedule to play a slice (e.g., sliceId(0, 0) for /A/A1.raw) on a row
+  // (0..3), starting on frame `at`; replaces any preload still pending there
+  bool preloadAndPlay(uint8_t row, SliceId slice, uint32_t at = IMMEDIATE);
+
+  // Stage the head of the slice a row will play next into its shadow
+  // buffer, so the trigger copies it from RAM instead of reading flash.
+  bool prefetch(uint8_t row, SliceId slice);
 
-  // stop a voice
-  void stopVoice(uint8_t voice);
+  // stop every voice on a row (fade out starting on frame `at`)
+  void stopRow(uint8_t row, uint32_t at = IMMEDIATE);
 
   // service to refill timing (called from loop)
   void service();
 
-  // debug level
-  void setLevel(uint8_t voice, float level);
+  // Row level; ramps the row's sounding voices and sets the next trigger's.
+  void setLevel(uint8_t row, float level, uint32_t at = IMMEDIATE);
 
-  // Request a state dump for a voice (queued to avoid ISR clashes).
+  // Row playback rate: 1 as recorded, 2 an octave up, negative backwards
+  // (magnitude clamped to 1/RATE_MAX..RATE_MAX). Sounding voices change
+  // speed on frame `at`; the direction applies from the row's next trigger.
+  void setRate(uint8_t row, float rate, uint32_t at = IMMEDIATE);
+
+  // Row effects chain (see VoiceFx.h). Sounding voices switch on frame
+  // `at`, so a change posted with a step lands with it; the next trigger
+  // starts with it.
+  void setFx(uint8_t row, const VoiceFx::Settings& fx, uint32_t at = IMMEDIATE);
+
+  // Request a state dump for a pool voice (posted to avoid ISR clashes).
   void requestDiagnostics(uint8_t voice);
 
 private:
-  static constexpr uint8_t  JOB_QUEUE_SIZE = 8;
-  static constexpr uint8_t  MAX_PATH_LEN   = 32;
-  static void onTimerISR(AudioEngine* self);
+  static constexpr uint8_t  EVENT_SLOTS    = 32;
+  static constexpr uint8_t  NO_ROW         = 0xFF;
+  // Accumulators per frame, interleaved L/R in stereo.
+  static constexpr uint8_t  MIX_CHANNELS   = STEREO_OUT ? 2 : 1;
+  // ZeroTimer callbacks take no arguments; the ISR finds us through s_self.
+  static void onTimerISR();
   void isr();
+  // One frame's left and right mix (the same twice in mono).
+  void mixFrame(int32_t& left, int32_t& right);
+
+  // Block-done interrupt for the DAC ping-pong (AUDIO_BLOCK_RENDER).
+  static void onDmaBlock(Adafruit_ZeroDMA* dma);
+  // Mix `frames` DAC codes per channel into outL/outR; same math as isr().
+  void render(uint16_t* outL, uint16_t* outR, uint16_t frames);
+  void renderBlock(uint16_t* outL, uint16_t* outR, uint16_t frames);
+
+#if defined(LOFI_HOST_BUILD)
+  // The host bench times private hot paths (isr/pumpStreams) directly.
+  friend struct AudioEngineProbe;
+#endif
 
+  // All but Diagnostics index a row's mailboxes.
   enum class JobType : uint8_t {
-    None,
     Preload,
+    Prefetch,
     Fade,
+    Stop,
+    Rate,
+    Fx,
     Diagnostics,
   };
+  static constexpr uint8_t ROW_JOB_KINDS = 6;
 
   struct Job {
-    // Lightweight payload: enough to describe a preload path, target gain, etc.
-    JobType type = JobType::None;
-    uint8_t voice = 0;
-    char path[MAX_PATH_LEN] = {0};
+    // Lightweight payload: enough to describe a preload, target gain, etc.
+    JobType type = JobType::Preload;
+    uint8_t row = 0;      // Diagnostics: the pool voice
+    SliceId slice = NO_SLICE;
     float value = 0.0f;
     uint16_t frames = 0;
+    uint32_t at = IMMEDIATE;
+    uint32_t seq = 0;     // post order, so a row's jobs run as they were asked
+  };
+
+  // One pending job, single producer (the loop's calls) and single consumer
+  // (service()), no locks. `posted` is the producer's alone: odd while it
+  // writes the payload, even once it's whole. `taken` is the consumer's: the
+  // last `posted` it handled. A job rewritten while service() copies it is
+  // left for the next pass, which picks up the newer one.
+  struct Mailbox {
+    volatile uint32_t posted = 0;
+    uint32_t taken = 0;
+    Job job;
   };
 
-  bool enqueueJob(const Job& job);
-  bool popJob(Job& jobOut);
+  // What service() hands the mixer: the timed half of a job. Start arms a
+  // staged voice and fades it in; Gain ramps the level and, with stop set,
+  // silences the voice when the ramp lands; Rate sets its playback rate and
+  // Fx its effects.
+  enum class EventType : uint8_t {
+    Start,
+    Gain,
+    Rate,
+    Fx,
+  };
+
+  struct Event {
+    uint32_t at = 0;
+    uint8_t voice = 0;
+    EventType type = EventType::Gain;
+    uint8_t gen = 0;      // the staging it belongs to; stale ones are dropped
+    bool stop = false;
+    int32_t target = 0;   // Q30 gain, or Q16.16 rate
+    uint16_t frames = 0;
+    VoiceFx::Params fx;
+  };
+
+  void post(Mailbox& box, const Job& job);
+  bool take(Mailbox& box, Job& jobOut);
+  void serviceJobs();
   void handleJob(const Job& job);
   void handlePreload(const Job& job);
+  void handlePrefetch(const Job& job);
   void handleFade(const Job& job);
+  void handleRate(const Job& job);
+  void handleFx(const Job& job);
   void handleDiagnostics(const Job& job);
   void pumpStreams();
-  void pumpGains();
+  // Read up to `chunk` more of a streaming voice into its ring; returns
+  // samples read.
+  uint32_t refill(uint8_t voice, uint32_t chunk);
+  // A read failed: the voice plays out what it has.
+  void streamFailed(uint8_t voice);
   void cleanupVoice(uint8_t voice);
-  void armGainRamp(uint8_t voice, float target, uint16_t frames);
+  uint8_t allocVoice(SliceId slice);
+  void resetVoice(uint8_t voice);
+  bool startDirect(uint8_t voice);
+  bool startHeld(uint8_t voice);
+  bool startShadow(uint8_t voice, uint8_t row);
+  // Fade one voice out from `at`; a voice whose Start is still pending
+  // after that is simply unstaged.
+  void stopVoice(uint8_t voice, uint32_t at, uint16_t frames);
+
+  // Loop side: insert into the time-ordered event list.
+  void postEvent(Event ev);
+  // Mixer side: apply everything due at sampleClock; returns frames until
+  // the next pending event (capped at `limit`).
+  uint32_t applyDueEvents(uint32_t limit);
+  void applyEvent(const Event& ev);
+  void advanceGain(uint8_t voice, uint32_t frames);
+  // Mixer side: count a streaming voice's ring running dry (telemetry).
+  void noteStarved(uint8_t voice);
+  // Adds `frames` of a voice to acc (MIX_CHANNELS per frame).
+  void mixVoice(uint8_t voice, int32_t* acc, uint32_t frames);
+  // Up to `frames` (<= AUDIO_BLOCK_FRAMES) of a voice's samples at its rate,
+  // interpolated off 1x, forwards or backwards; returns how many it had.
+  // For voices mixVoice() can't take straight from the ring.
+  uint32_t readVoice(uint8_t voice, int32_t* out, uint32_t frames);
 
   Storage* storage = nullptr;
+  SampleBank* bank = nullptr;
   volatile bool running = false;
 
-  Job jobQueue[JOB_QUEUE_SIZE];
-  volatile uint8_t jobHead = 0;
-  volatile uint8_t jobTail = 0;
+  Mailbox rowMail[ROW_COUNT][ROW_JOB_KINDS];
+  Mailbox diagMail[VOICE_COUNT];
+  // Seq of the last finished post; service() skips the scan while it hasn't
+  // moved.
+  volatile uint32_t jobSeq = 0;
+  uint32_t jobSeqSeen = 0;
+
+  volatile uint32_t sampleClock = 0;
+  // Sorted latest-first, so the mixer pops the next due event off the end.
+  Event events[EVENT_SLOTS];
+  volatile uint8_t eventCount = 0;
+
+  int16_t  vbuf[VOICE_COUNT][BUF_SAMPLES];
+  volatile uint32_t vavailable[VOICE_COUNT] = {};
+  volatile uint32_t vpos[VOICE_COUNT] = {};
+  uint32_t vwrite[VOICE_COUNT] = {};
+  // Playback rate (Q16.16, negative plays backwards) and the read position's
+  // fraction past vpos (Q16). Staged by the loop, the mixer's once running.
+  volatile int32_t vrate[VOICE_COUNT] = {};
+  uint32_t vphase[VOICE_COUNT] = {};
+  // Effects chain and its state; staged by the loop, then the mixer's.
+  VoiceFx  vfx[VOICE_COUNT];
+  // Pan gains, Q15 (constant power), set when the voice is staged.
+  int16_t  vpanL[VOICE_COUNT] = {};
+  int16_t  vpanR[VOICE_COUNT] = {};
 
-  // Simple per-voice RAM buffer for current slice. Big enough to slurp an entire
-  // recorded slice (MAX_RECORD_SAMPLES chopped into 8 pieces, rounded up).
-  static constexpr uint32_t BUF_SAMPLES = (MAX_RECORD_SAMPLES + 7u) / 8u;
-  int16_t  vbuf[4][BUF_SAMPLES];
-  volatile uint32_t vavailable[4] = {0,0,0,0};
-  volatile uint32_t vpos[4] = {0,0,0,0};
-  uint32_t vwrite[4] = {0,0,0,0};
+  // Where the ISR reads each voice from: vbuf[v] (ring of BUF_SAMPLES) for
+  // streamed slices, or the slice itself in mapped flash for banked ones.
+  const int16_t* volatile vsrc[VOICE_COUNT] = {};
+  volatile uint32_t vsrcLen[VOICE_COUNT] = {};
 
   // Flags touch both the ISR and service(); keep them volatile and tidy.
-  volatile bool voiceActive[4] = {false,false,false,false};
-  volatile bool voicePrimed[4] = {false,false,false,false};
-  volatile bool voiceStreaming[4] = {false,false,false,false};
-  volatile bool voiceDraining[4] = {false,false,false,false};
-
-  uint32_t voiceTotalSamples[4] = {0,0,0,0};
-  uint32_t voiceLoadedSamples[4] = {0,0,0,0};
-  bool     voiceDiagPending[4] = {false,false,false,false};
-  bool     voiceNeedsFadeIn[4] = {false,false,false,false};
-  char     voicePath[4][MAX_PATH_LEN];
-
-  volatile float vgainCurrent[4] = {0.0f,0.0f,0.0f,0.0f};
-  float    vgainTarget[4] = {0.9f,0.9f,0.9f,0.9f};
-  float    vgainDesired[4] = {0.9f,0.9f,0.9f,0.9f};
-  float    vgainStep[4]   = {0,0,0,0};
-  uint16_t vgainFrames[4] = {0,0,0,0};
+  volatile bool voiceActive[VOICE_COUNT] = {};
+  volatile bool voicePrimed[VOICE_COUNT] = {};
+  volatile bool voiceStreaming[VOICE_COUNT] = {};
+  volatile bool voiceDraining[VOICE_COUNT] = {};
+  volatile bool voiceDirect[VOICE_COUNT] = {};
+  // Set by a Start event; the mixer skips staged voices until then.
+  volatile bool voiceRunning[VOICE_COUNT] = {};
+  // Set by the mixer when a stop fade lands; service() retires the voice.
+  volatile bool voiceHalted[VOICE_COUNT] = {};
+  // Bumped on every staging so a superseded Start can't fire.
+  volatile uint8_t voiceGen[VOICE_COUNT] = {};
+
+  // Loop side: the row a voice was allocated to, NO_ROW while it's free.
+  uint8_t  voiceRow[VOICE_COUNT];
+  uint32_t voiceStartAt[VOICE_COUNT];   // frame its Start is posted for
+  uint32_t voiceStopAt[VOICE_COUNT];    // draining: frame its stop fade lands
+  // Plays backwards: streams from the end, voiceLoadedSamples counting
+  // from there, vwrite one past the lowest sample loaded.
+  bool     voiceReverse[VOICE_COUNT] = {};
+  uint32_t voiceTotalSamples[VOICE_COUNT] = {};
+  uint32_t voiceLoadedSamples[VOICE_COUNT] = {};
+  bool     voiceDiagPending[VOICE_COUNT] = {};
+  SliceId  voiceSlice[VOICE_COUNT];
+  // What vbuf[v] still holds of voiceSlice[v] from sample 0 on, untouched by
+  // wrap-around, and the Storage generation it was read under. Survives
+  // cleanup, so a free voice that still holds a retriggered slice gets
+  // picked and rewinds instead of reloading.
+  uint32_t voiceHeldSamples[VOICE_COUNT] = {};
+  uint32_t voiceHeldTotal[VOICE_COUNT] = {};
+  uint32_t voiceHeldGen[VOICE_COUNT] = {};
+
+  // pumpStreams() pacing: the frame it last ran on, the slowest recent gap
+  // between runs (frames), and the measured flash cost, us per sample in Q8.
+  uint32_t pumpLastAt = 0;
+  uint32_t pumpGapPeak = SCHEDULE_AHEAD_FRAMES;
+  int32_t  readCostQ8 = 0;
+
+  // Mixer-owned ramp state, Q30 (1 << 30 = unity) so short ramps don't
+  // round to nothing; the mix itself uses the top Q15 bits. Stepped once
+  // per rendered frame.
+  int32_t  vgain[VOICE_COUNT]     = {};
+  int32_t  vgainStep[VOICE_COUNT] = {};
+  int32_t  vgainEnd[VOICE_COUNT]  = {};
+  uint32_t vgainLeft[VOICE_COUNT] = {};
+  bool     vgainStop[VOICE_COUNT] = {};
+  // Frame the last Start landed on (stealing tiebreak, diagnostics, bench).
+  volatile uint32_t voiceStartFrame[VOICE_COUNT] = {};
+  // Mixer-owned: the voice's ring is dry mid-stream, already counted.
+  bool     voiceStarved[VOICE_COUNT] = {};
+  uint32_t voiceSteals = 0;
+
+  // Per row: trigger policy, the level the next Start fades in to, the
+  // rate it plays at, its effects and where it sits.
+  RowMode  rowMode[ROW_COUNT];
+  float    rowLevel[ROW_COUNT];
+  uint8_t  rowPan[ROW_COUNT];    // PAN_LUT step, the next Start's
+  int32_t  rowRate[ROW_COUNT];   // Q16.16, the next Start's
+  VoiceFx::Params rowFx[ROW_COUNT];
+
+  // Prefetched heads, one per row. A trigger copies the matching one into
+  // its voice's ring; the shadow stays valid, so a roll reuses it.
+  struct Shadow {
+    bool     ready = false;
+    uint32_t samples = 0;
+    uint32_t total = 0;
+    uint32_t gen = 0;          // Storage generation it was read under
+    SliceId  slice = NO_SLICE;
+  };
+
+  int16_t  vshadow[ROW_COUNT][PREFETCH_SAMPLES];
+  Shadow   shadows[ROW_COUNT];
 };
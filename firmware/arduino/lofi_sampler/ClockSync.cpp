@@ -0,0 +1,170 @@
+#include "ClockSync.h"
+
+namespace {
+// Frames per clock at `bpm`, Q16.
+inline uint32_t periodFor(uint32_t bpm) {
+  return (uint32_t)(((uint64_t)SAMPLE_RATE_HZ * 60u << 16) / ((uint64_t)bpm * MIDI_PPQN));
+}
+const uint32_t PERIOD_MIN = periodFor(300);
+const uint32_t PERIOD_MAX = periodFor(20);
+}
+
+ClockSync::ClockSync() : period(periodFor(CLOCK_INTERNAL_BPM)) {}
+
+void ClockSync::midiStart() {
+  // The first clock after Start is step 0's downbeat; until it arrives there
+  // is no phase to predict from.
+  running = true;
+  anchored = false;
+  clock = 0;
+  stepClock = 0;
+  prefetched = false;
+  curStep = STEPS_PER_BAR - 1;
+}
+
+void ClockSync::midiContinue() {
+  // Carry on counting from where Stop left us; the next clock re-anchors.
+  running = true;
+  anchored = false;
+}
+
+void ClockSync::midiStop() {
+  running = false;
+}
+
+void ClockSync::startInternal(uint32_t now) {
+  running = true;
+  src = Source::Internal;
+  clock = 0;
+  stepClock = 0;
+  prefetched = false;
+  curStep = STEPS_PER_BAR - 1;
+  acquiring = false;
+  outliers = 0;
+  // Far enough out for step 0 to be staged and scheduled like any other.
+  nextAt = now + SCHEDULE_AHEAD_FRAMES;
+  nextFrac = 0;
+  anchored = true;
+}
+
+void ClockSync::midiClock(uint32_t t) {
+  lastAt = t;
+  if (src != Source::External) {
+    // Back from freewheeling: this is whichever coasted clock it's nearest.
+    if (anchored && (int32_t)(t - timeOf(clock - 1)) < (int32_t)(period >> 17)) clock--;
+    src = Source::External;
+    anchored = false;
+  }
+  if (!anchored) {
+    anchor(t);
+    return;
+  }
+  if (acquiring) {
+    // Straight average since the anchor; this clock is exactly on time.
+    uint32_t n = clock - acqClock;
+    period = (uint32_t)(((uint64_t)(t - acqAt) << 16) / n);
+    clampPeriod();
+    nextAt = t;
+    nextFrac = 0;
+    if (n >= CLOCK_ACQUIRE_CLOCKS) {
+      acquiring = false;
+      haveTempo = true;
+    }
+    advance();
+    return;
+  }
+  int64_t err = (int64_t)(int32_t)(t - nextAt) * 65536 - nextFrac;
+  int64_t half = period / 2;
+  if (err > half || err < -half) {
+    if (++outliers >= 3) {
+      // Not jitter: the tempo jumped or we're a clock out. Start over here.
+      anchor(t);
+      acquiring = true;
+      return;
+    }
+  } else {
+    outliers = 0;
+  }
+  // A read that sat behind a stalled loop pass looks late; cap its say.
+  int64_t cap = period / 4;
+  if (err > cap) err = cap;
+  if (err < -cap) err = -cap;
+  nudge(err >> 4);
+  period += (int32_t)(err >> 8);
+  clampPeriod();
+  advance();
+}
+
+void ClockSync::anchor(uint32_t t) {
+  nextAt = t;
+  nextFrac = 0;
+  acqAt = t;
+  acqClock = clock;
+  acquiring = !haveTempo;
+  outliers = 0;
+  anchored = true;
+  advance();
+}
+
+void ClockSync::advance() {
+  uint32_t f = (uint32_t)nextFrac + period;
+  nextAt += f >> 16;
+  nextFrac = (uint16_t)f;
+  clock++;
+}
+
+void ClockSync::nudge(int64_t errQ16) {
+  int64_t f = (int64_t)nextFrac + errQ16;
+  nextAt += (int32_t)(f >> 16);
+  nextFrac = (uint16_t)(f & 0xFFFF);
+}
+
+uint32_t ClockSync::timeOf(uint32_t c) const {
+  int64_t q = (int64_t)(int32_t)(c - clock) * period + nextFrac;
+  return nextAt + (uint32_t)(int32_t)(q >> 16);
+}
+
+void ClockSync::clampPeriod() {
+  if (period < PERIOD_MIN) period = PERIOD_MIN;
+  if (period > PERIOD_MAX) period = PERIOD_MAX;
+}
+
+uint16_t ClockSync::bpmX10() const {
+  return (uint16_t)(((uint64_t)SAMPLE_RATE_HZ * 600u << 16) / ((uint64_t)period * MIDI_PPQN));
+}
+
+ClockSync::Tick ClockSync::poll(uint32_t now) {
+  Tick tick;
+  // A late clock is still the one we're waiting for, so an external clock
+  // only predicts ahead; a host quiet for CLOCK_DROPOUT_CLOCKS is gone, and
+  // from there the internal clock ticks through them itself.
+  if (anchored && src == Source::External &&
+      (int32_t)(now - lastAt) > (int32_t)((period >> 16) * CLOCK_DROPOUT_CLOCKS)) {
+    src = Source::Internal;
+    acquiring = false;
+  }
+  if (anchored && src == Source::Internal) {
+    while ((int32_t)(now - nextAt) >= 0) advance();
+  }
+  if (!running) return tick;
+
+  uint8_t step = (uint8_t)((stepClock / CLOCKS_PER_STEP) % STEPS_PER_BAR);
+  if (!prefetched && (!anchored || (int32_t)(now - timeOf(stepClock - PREFETCH_CLOCKS)) >= 0)) {
+    prefetched = true;
+    tick.type = TickType::Prefetch;
+    tick.step = step;
+    return tick;
+  }
+  if (!anchored) return tick;
+  uint32_t at = timeOf(stepClock);
+  if ((int32_t)(now + SCHEDULE_AHEAD_FRAMES - at) < 0) return tick;
+  // Late (a stalled pass, a phase snap): as soon as possible.
+  if ((int32_t)(at - now) < 0) at = now;
+  tick.type = TickType::Step;
+  tick.step = step;
+  tick.at = at;
+  curStep = step;
+  stepClock += CLOCKS_PER_STEP;
+  prefetched = false;
+  return tick;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+
+// MIDI clock recovery. Each 0xF8 is stamped with the engine's sample clock
+// when the loop reads it, which puts USB polling and loop stalls into the
+// stamp; a PLL smooths that out and predicts where the coming clocks, and so
+// the coming step boundaries, will land. The loop polls for due ticks and
+// schedules each step on its predicted frame, SCHEDULE_AHEAD_FRAMES ahead,
+// instead of reacting to whenever the twelfth clock byte showed up.
+//
+// The first CLOCK_ACQUIRE_CLOCKS after a (re)anchor set the period from their
+// plain average; after that an alpha-beta filter (1/16 phase, 1/256 period,
+// near critically damped) tracks it, with each correction clamped so one
+// stalled read can't yank the phase. Three arrivals in a row more than half
+// a period off (a tempo jump, a lost clock) re-anchor and re-acquire.
+//
+// A late clock is waited for, not skipped. After CLOCK_DROPOUT_CLOCKS of
+// silence the transport freewheels on the internal clock at the last tempo;
+// startInternal() runs it from CLOCK_INTERNAL_BPM when there's no host at
+// all. Clocks arriving again take over on the next one.
+//
+// Times are sample-clock frames (wrapping, compared with signed deltas);
+// the phase and period carry a Q16 fraction.
+class ClockSync {
+public:
+  enum class Source : uint8_t {
+    Stopped,
+    External,  // following MIDI clock
+    Internal,  // no host, or the host went quiet mid-song
+  };
+
+  enum class TickType : uint8_t {
+    None,
+    Prefetch,  // stage `step`'s slices now
+    Step,      // play `step` on frame `at`
+  };
+
+  struct Tick {
+    TickType type = TickType::None;
+    uint8_t  step = 0;
+    uint32_t at = 0;
+  };
+
+  ClockSync();
+
+  // MIDI realtime; midiClock() takes the frame the byte was read on.
+  void midiClock(uint32_t t);
+  void midiStart();
+  void midiContinue();
+  void midiStop();
+
+  // Play from the internal clock, step 0 first, starting around `now`.
+  void startInternal(uint32_t now);
+
+  // The next tick due by `now`, or None; call until None each loop pass.
+  Tick poll(uint32_t now);
+
+  bool    playing() const { return running; }
+  // The step last handed out (STEPS_PER_BAR - 1 right after a start).
+  uint8_t step() const { return curStep; }
+  Source  source() const { return running ? src : Source::Stopped; }
+  // Following an external clock on an acquired tempo.
+  bool    locked() const { return src == Source::External && anchored && !acquiring; }
+  // Tempo estimate in tenths of a BPM.
+  uint16_t bpmX10() const;
+  // Frames per MIDI clock, Q16.
+  uint32_t periodQ16() const { return period; }
+
+private:
+  void anchor(uint32_t t);
+  void advance();
+  void nudge(int64_t errQ16);
+  uint32_t timeOf(uint32_t clock) const;
+  void clampPeriod();
+
+  bool     running = false;
+  Source   src = Source::Internal;
+  bool     anchored = false;   // phase hangs off a real (or internal) clock
+  bool     acquiring = true;
+  bool     haveTempo = false;  // acquired from a host at least once
+  uint32_t period;             // frames per clock, Q16
+  uint32_t clock = 0;          // index the next arrival is matched to
+  uint32_t nextAt = 0;         // its predicted frame...
+  uint16_t nextFrac = 0;       // ...and Q16 fraction
+  uint32_t acqAt = 0;          // anchor frame and index while acquiring
+  uint32_t acqClock = 0;
+  uint32_t lastAt = 0;         // frame the last clock was read on
+  uint8_t  outliers = 0;       // arrivals in a row > half a period off
+  uint32_t stepClock = 0;      // clock index of the next step boundary
+  bool     prefetched = false;
+  uint8_t  curStep = STEPS_PER_BAR - 1;
+};
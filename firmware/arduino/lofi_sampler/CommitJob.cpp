@@ -0,0 +1,263 @@
+#include "CommitJob.h"
+#include "Storage.h"
+#include "SampleBank.h"
+#include "Slicer.h"
+
+extern Storage storage;
+extern SampleBank sampleBank;
+
+bool CommitJob::beginTake(uint8_t r, const int16_t* samples, uint32_t n, const OnsetDetector* detector) {
+  return start(Kind::Take, r, samples, n, detector);
+}
+
+bool CommitJob::beginRecorded(uint8_t r, const OnsetDetector* detector) {
+  return start(Kind::Recorded, r, nullptr, 0, detector);
+}
+
+bool CommitJob::beginReslice(uint8_t r) {
+  return start(Kind::Reslice, r, nullptr, 0, nullptr);
+}
+
+bool CommitJob::start(Kind k, uint8_t r, const int16_t* samples, uint32_t n, const OnsetDetector* detector) {
+  if (busy() || r >= 4) return false;
+  char rowL = (char)('A' + r);
+  snprintf(src, sizeof(src), "/%c/source.raw", rowL);
+  if (k == Kind::Take) {
+    if (!samples || n == 0) return false;
+  } else {
+    int32_t c = storage.rawSampleCount(src);
+    if (c <= 0) return false;
+    n = (uint32_t)c;
+  }
+  kind = k;
+  jobRow = r;
+  take = samples;
+  count = n;
+  moved = 0;
+  lastFailed = false;
+  haveCuts = false;
+  haveOnsets = detector != nullptr;
+  if (detector) {
+    onsets = *detector;
+  } else {
+    onsets.reset();
+  }
+  muting = k != Kind::Reslice || !VIRTUAL_SLICES;
+  // Any voice still streaming this row's old files must reopen them.
+  if (muting) storage.invalidateRow(rowL);
+  total = 0;
+  for (uint8_t p = (uint8_t)Phase::Clean; p < (uint8_t)Phase::Done; ++p) {
+    Phase ph = (Phase)p;
+    if (skip(ph)) continue;
+    if (ph == Phase::Detect || ph == Phase::Source || ph == Phase::Slices) total += count;
+    if (ph == Phase::Bank && kind == Kind::Take && count <= SampleBank::SLOT_SAMPLES) total += count;
+  }
+  phase = Phase::Idle;
+  next();
+  return true;
+}
+
+bool CommitJob::skip(Phase p) const {
+  switch (p) {
+    case Phase::Clean:  return VIRTUAL_SLICES && kind != Kind::Take;
+    case Phase::Detect: return Slicer::cutMode() != Slicer::CutMode::Onsets || haveOnsets;
+    case Phase::Source: return kind != Kind::Take;
+    case Phase::Slices: return VIRTUAL_SLICES;
+    case Phase::Table:  return !VIRTUAL_SLICES;
+    case Phase::Bank:   return !sampleBank.ready();
+    default:            return false;
+  }
+}
+
+void CommitJob::next() {
+  unit = 0;
+  offset = 0;
+  opened = false;
+  do {
+    phase = (Phase)((uint8_t)phase + 1);
+  } while (phase != Phase::Done && skip(phase));
+  if (phase == Phase::Done) {
+    phase = Phase::Idle;
+    return;
+  }
+  // Everything from here on needs the cuts; Detect (if any) is behind us.
+  if (phase >= Phase::Slices && !haveCuts) {
+    Slicer::cuts(count, haveOnsets ? &onsets : nullptr, sliceStart, sliceLen);
+    haveCuts = true;
+  }
+}
+
+void CommitJob::fail() {
+  cancel();
+  lastFailed = true;
+}
+
+void CommitJob::cancel() {
+  if (opened && (phase == Phase::Source || phase == Phase::Slices)) storage.endAppend();
+  if (opened && phase == Phase::Bank) sampleBank.clearRow(jobRow);
+  opened = false;
+  phase = Phase::Idle;
+}
+
+int32_t CommitJob::readTake(uint32_t at, int16_t* dst, uint32_t n) {
+  if (take) {
+    memcpy(dst, take + at, n * sizeof(int16_t));
+    return (int32_t)n;
+  }
+  return storage.readRawChunk(src, at, dst, n);
+}
+
+bool CommitJob::service(uint32_t budgetMicros) {
+  if (!busy()) return false;
+  uint32_t t0 = micros();
+  do {
+    step();
+  } while (busy() && micros() - t0 < budgetMicros);
+  return busy();
+}
+
+uint8_t CommitJob::progress() const {
+  if (!busy()) return 100;
+  if (total == 0) return 0;
+  return (uint8_t)((uint64_t)moved * 100u / total);
+}
+
+void CommitJob::step() {
+  char rowL = (char)('A' + jobRow);
+  int16_t page[RECORD_FLUSH_SAMPLES];
+  switch (phase) {
+    case Phase::Clean: {
+#if VIRTUAL_SLICES
+      // Files from a materialized cut are dead weight once the table exists.
+      char path[16];
+      snprintf(path, sizeof(path), "/%c/%c%d.raw", rowL, rowL, unit + 1);
+      storage.remove(path);
+      if (++unit == 8) next();
+#else
+      storage.clearSliceTable(rowL);
+      next();
+#endif
+      break;
+    }
+    case Phase::Detect: {
+      uint32_t n = count - offset;
+      if (n > RECORD_FLUSH_SAMPLES) n = RECORD_FLUSH_SAMPLES;
+      int32_t got = readTake(offset, page, n);
+      if (got <= 0) {
+        fail();
+        return;
+      }
+      onsets.push(page, (uint32_t)got);
+      offset += (uint32_t)got;
+      moved += (uint32_t)got;
+      if (offset >= count) {
+        haveOnsets = true;
+        next();
+      }
+      break;
+    }
+    case Phase::Source: {
+      if (!opened) {
+        if (!storage.beginAppend(src)) {
+          fail();
+          return;
+        }
+        opened = true;
+      }
+      uint32_t n = count - offset;
+      if (n > RECORD_FLUSH_SAMPLES) n = RECORD_FLUSH_SAMPLES;
+      if (!storage.append(take + offset, n)) {
+        fail();
+        return;
+      }
+      offset += n;
+      moved += n;
+      if (offset >= count) {
+        storage.endAppend();
+        next();
+      }
+      break;
+    }
+    case Phase::Slices: {
+      if (unit == 8) {
+        storage.warmRowHeads(rowL);
+        next();
+        break;
+      }
+      if (!opened) {
+        char path[16];
+        snprintf(path, sizeof(path), "/%c/%c%d.raw", rowL, rowL, unit + 1);
+        if (!storage.beginAppend(path, storage.getSliceFormat())) {
+          fail();
+          return;
+        }
+        opened = true;
+      }
+      uint32_t n = sliceLen[unit] - offset;
+      if (n > RECORD_FLUSH_SAMPLES) n = RECORD_FLUSH_SAMPLES;
+      if (n) {
+        if (readTake(sliceStart[unit] + offset, page, n) != (int32_t)n || !storage.append(page, n)) {
+          fail();
+          return;
+        }
+        offset += n;
+        moved += n;
+      }
+      if (offset >= sliceLen[unit]) {
+        storage.endAppend();
+        opened = false;
+        offset = 0;
+        unit++;
+      }
+      break;
+    }
+    case Phase::Table:
+      if (!storage.writeSliceTable(rowL, sliceStart, sliceLen, count)) {
+        fail();
+        return;
+      }
+      next();
+      break;
+    case Phase::Bank: {
+      // The bank mirrors the files; if it can't take the row, the row just
+      // streams from LittleFS.
+      if (kind == Kind::Reslice) {
+        sampleBank.setSlices(jobRow, sliceStart, sliceLen);
+        next();
+        break;
+      }
+      if (kind == Kind::Recorded || count > SampleBank::SLOT_SAMPLES) {
+        sampleBank.clearRow(jobRow);
+        next();
+        break;
+      }
+      // The old take stays published until the new one is swapped in, so
+      // a write that fails has to unpublish it.
+      if (!opened) {
+        if (!sampleBank.beginRow(jobRow)) {
+          sampleBank.clearRow(jobRow);
+          next();
+          break;
+        }
+        opened = true;
+      }
+      uint32_t n = count - offset;
+      if (n > RECORD_FLUSH_SAMPLES) n = RECORD_FLUSH_SAMPLES;
+      if (!sampleBank.writeRowChunk(jobRow, offset, take + offset, n)) {
+        sampleBank.clearRow(jobRow);
+        next();
+        break;
+      }
+      offset += n;
+      moved += n;
+      if (offset >= count) {
+        if (!sampleBank.publishRow(jobRow, count, sliceStart, sliceLen)) sampleBank.clearRow(jobRow);
+        next();
+      }
+      break;
+    }
+    default:
+      phase = Phase::Idle;
+      break;
+  }
+}
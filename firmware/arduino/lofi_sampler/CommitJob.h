@@ -0,0 +1,73 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+#include "OnsetDetector.h"
+
+// Writing a take out (source.raw, slices or slice table, sample bank) as a
+// job the loop advances a little at a time, so MIDI, the engine's stream
+// refills and the other rows keep going while it runs. Each unit of work is
+// one flash page (RECORD_FLUSH_SAMPLES) or one small metadata write;
+// service() does units until its time budget is spent. One job at a time.
+//
+// While a take or recording commits, its row is muted (mutes()) since its
+// files are being rewritten; the loop stops it at the next step and skips
+// its triggers until the job is done. A reslice with VIRTUAL_SLICES leaves
+// the audio alone, so the row keeps playing its old cuts until the new
+// table lands in the last unit.
+class CommitJob {
+public:
+  // A take in RAM; samples must stay put until the job is done. Writes
+  // source.raw and the slices the way Slicer::writeEight() would.
+  bool beginTake(uint8_t row, const int16_t* samples, uint32_t count, const OnsetDetector* onsets);
+  // A take already in /<Row>/source.raw (streamed while recording): cuts it
+  // and drops the row's bank slot, which only takes what fits in RAM.
+  bool beginRecorded(uint8_t row, const OnsetDetector* onsets);
+  // Re-cut a row's source.raw in the current cut mode. With VIRTUAL_SLICES
+  // only the slice table and the bank header's slice list are rewritten.
+  bool beginReslice(uint8_t row);
+  // Abandon the job, leaving the row as far as it got.
+  void cancel();
+
+  // Work for up to budgetMicros (at least one unit). True while still busy.
+  bool service(uint32_t budgetMicros);
+
+  bool busy() const { return phase != Phase::Idle; }
+  int8_t row() const { return busy() ? (int8_t)jobRow : -1; }
+  bool mutes(uint8_t r) const { return busy() && r == jobRow && muting; }
+  // 0..100, by samples moved.
+  uint8_t progress() const;
+  // The last job stopped short on a failed read or write.
+  bool failed() const { return lastFailed; }
+
+private:
+  enum class Kind : uint8_t { Take, Recorded, Reslice };
+  enum class Phase : uint8_t { Idle, Clean, Detect, Source, Slices, Table, Bank, Done };
+
+  bool start(Kind k, uint8_t r, const int16_t* samples, uint32_t count, const OnsetDetector* detector);
+  void step();
+  void next();
+  bool skip(Phase p) const;
+  void fail();
+  // n samples of the take at offset, from RAM or source.raw.
+  int32_t readTake(uint32_t offset, int16_t* dst, uint32_t n);
+
+  Phase    phase = Phase::Idle;
+  Kind     kind = Kind::Take;
+  uint8_t  jobRow = 0;
+  bool     muting = false;
+  bool     lastFailed = false;
+  const int16_t* take = nullptr;   // Take only
+  uint32_t count = 0;
+  char     src[16] = {0};
+  // Cursor within the phase: unit/slice index and sample offset.
+  uint8_t  unit = 0;
+  uint32_t offset = 0;
+  bool     opened = false;        // an append (or bank row) is in progress
+  uint32_t moved = 0;
+  uint32_t total = 0;
+  bool     haveOnsets = false;
+  bool     haveCuts = false;
+  OnsetDetector onsets;
+  uint32_t sliceStart[8] = {0};
+  uint32_t sliceLen[8] = {0};
+};
@@ -8,10 +8,155 @@ static const uint8_t  BEATS_PER_BAR    = 4;
 static const uint8_t  MIDI_PPQN        = 24;         // USB MIDI Clock
 static const uint8_t  CLOCKS_PER_STEP  = (MIDI_PPQN * BEATS_PER_BAR) / STEPS_PER_BAR; // 12
 
+// ---------- Clock ----------
+// MIDI clocks are stamped on the engine's sample clock and tracked by a PLL
+// (ClockSync.h); steps land on its predicted boundaries. A host that goes
+// quiet for CLOCK_DROPOUT_CLOCKS is freewheeled over at its last tempo, and
+// with no USB host at all CLOCK_HOST_WAIT_MS after boot the sequencer runs
+// on its own at CLOCK_INTERNAL_BPM.
+static const uint16_t CLOCK_INTERNAL_BPM   = 120;
+static const uint8_t  CLOCK_ACQUIRE_CLOCKS = 8;    // plain average before tracking
+static const uint8_t  CLOCK_DROPOUT_CLOCKS = 24;   // one beat
+static const uint16_t CLOCK_HOST_WAIT_MS   = 2000;
+
+// ---------- Audio render ----------
+// 1: the DMAC feeds both DACs from a ping-pong buffer and AudioEngine::render()
+//    mixes AUDIO_BLOCK_FRAMES at a time from the block-done interrupt.
+// 0: legacy path, a timer ISR mixes and writes one sample per tick.
+// Latency is two blocks (64 frames ≈ 2.9 ms each).
+#ifndef AUDIO_BLOCK_RENDER
+#define AUDIO_BLOCK_RENDER 1
+#endif
+static const uint16_t AUDIO_BLOCK_FRAMES = 64;   // 32..128
+// Steps are scheduled this far ahead on the engine's sample clock so the
+// preload has time to stage before the mixer starts the voices.
+static const uint16_t SCHEDULE_AHEAD_FRAMES = 128; // ≈5.8 ms
+// The next step's gated slices are staged PREFETCH_CLOCKS MIDI clocks early
+// into a per-row shadow buffer; the trigger copies it into its voice's ring
+// and streams the rest behind it. The shadow has to cover the loop's worst
+// stall after the start frame (4 * 2 * N bytes of RAM).
+static const uint8_t  PREFETCH_CLOCKS  = 3;      // of CLOCKS_PER_STEP
+static const uint16_t PREFETCH_SAMPLES = 512;    // ≈23 ms, 4 KiB total
+
+// ---------- Output ----------
+// 1: stereo bus. Each voice sits where its row's pan put it when it was
+//    triggered (AudioEngine::setPan, constant power), and A0 plays the left
+//    channel, A1 the right.
+// 0: mono bus mirrored to both DACs, pans ignored; half the mix multiplies.
+#ifndef STEREO_OUT
+#define STEREO_OUT 1
+#endif
+// The master bus maps a full-scale voice at unity to full scale on the DACs.
+// It is straight up to MASTER_KNEE of full scale, then bends smoothly into
+// it; both channels take the louder one's gain, so a peak on one side
+// squashes the pair without pulling the image over.
+static const float MASTER_KNEE = 0.5f;   // ≈-6 dBFS
+// CC 10 on channel 1..4 pans row A..D for its next triggers.
+static const uint8_t MIDI_CC_PAN = 10;
+
+// ---------- Voices ----------
+// Rows allocate a voice per trigger from a pool of VOICE_COUNT. The voice
+// rings share the RAM four whole-slice buffers used to (see BUF_SAMPLES in
+// AudioEngine.h), so more voices means shorter rings, not more RAM.
+static const uint8_t  ROW_COUNT     = 4;
+static const uint8_t  VOICE_COUNT   = 8;   // 4..16
+// Rows whose retriggers overlap (bit 0 = A); the rest choke, crossfading
+// out the previous hit.
+static const uint8_t  ROW_POLY_MASK = 0x00;
+
+// ---------- Streaming ----------
+// pumpStreams() tops up the voice closest to running dry first. Each read
+// is at least enough to outlast STREAM_AHEAD_PASSES of the slowest recent
+// loop pass, and up to STREAM_CHUNK_MAX while the pass has read for less
+// than STREAM_BUDGET_US (at the flash rate it measures). Past the budget,
+// voices that would last two more passes wait for the next one.
+static const uint16_t STREAM_CHUNK_MIN    = 64;
+static const uint16_t STREAM_CHUNK_MAX    = 1024;
+static const uint8_t  STREAM_AHEAD_PASSES = 3;
+static const uint16_t STREAM_BUDGET_US    = 1500;
+
+// ---------- Varispeed ----------
+// Each row plays at its own rate (AudioEngine::setRate): the mixer steps
+// through the slice by a Q16.16 increment per frame, backwards when the
+// rate is negative. Off 1x it interpolates between neighbouring samples,
+// linearly, or with a 4-point Hermite curve when VARISPEED_CUBIC is set
+// (cleaner highs, about twice the mixer time). The pump streams ahead at
+// the voice's rate, so 2x takes twice the flash bandwidth.
+#ifndef VARISPEED_CUBIC
+#define VARISPEED_CUBIC 0
+#endif
+static const float   RATE_MAX            = 4.0f;   // either way; slowest 1/RATE_MAX
+// Pitch bend on MIDI channel 1..4 bends row A..D by up to this much, and
+// CC MIDI_CC_REVERSE at 64 or more plays the row's next triggers backwards.
+static const uint8_t RATE_BEND_SEMITONES = 12;
+static const uint8_t MIDI_CC_REVERSE     = 85;
+
+// ---------- Voice effects ----------
+// Each row's voices run through a lo-fi chain (VoiceFx.h): sample-and-hold
+// decimation, bit crush, a state-variable filter and drive, in fixed point
+// over whole mixer runs. These CCs on channel 1..4 edit row A..D's; an edit
+// lands on the row's next step frame.
+static const uint8_t MIDI_CC_FX_RESONANCE = 71;
+static const uint8_t MIDI_CC_FX_CUTOFF    = 74;  // 40 Hz .. ~10 kHz
+static const uint8_t MIDI_CC_FX_BITS      = 75;  // 0 = 1 bit .. 127 = 16
+static const uint8_t MIDI_CC_FX_HOLD      = 76;  // 0 = every frame .. 127 = every 32nd
+static const uint8_t MIDI_CC_FX_FILTER    = 77;  // off, low-, band-, high-pass by quarters
+static const uint8_t MIDI_CC_FX_DRIVE     = 78;  // 0 = off
+
 // ---------- Recording ----------
+// 1: takes stream through a small ring into /<Row>/source.raw while recording
+//    and are sliced from the file afterwards. Length is bounded by flash
+//    (MAX_STREAM_RECORD_SECONDS, or until LittleFS fills up), and the RAM a
+//    capture buffer would take goes to the voice rings instead.
+// 0: takes are captured whole into RAM, MAX_RECORD_SECONDS at most.
+#ifndef RECORD_STREAM_TO_FLASH
+#define RECORD_STREAM_TO_FLASH 1
+#endif
 // 2.6 s ≈ 114.7 KB capture + 57.3 KB of voice buffers ≈ 172.0 KB audio RAM
+// (streaming: 114.7 KB of voice buffers + a 16 KB ring ≈ 130.7 KB). Also
+// sizes the voice rings and the sample bank slots.
 static const float    MAX_RECORD_SECONDS = 2.6f;
 static const uint32_t MAX_RECORD_SAMPLES = (uint32_t)(SAMPLE_RATE_HZ * MAX_RECORD_SECONDS);
+// Streaming: the ring rides out loop stalls (a slow flash write, a reslice);
+// the loop drains it in page-sized writes.
+static const float    MAX_STREAM_RECORD_SECONDS = 60.0f;   // ≈2.6 MB of source.raw
+static const uint32_t MAX_STREAM_RECORD_SAMPLES = (uint32_t)(SAMPLE_RATE_HZ * MAX_STREAM_RECORD_SECONDS);
+static const uint32_t RECORD_RING_SAMPLES  = 8192;         // ≈370 ms, 16 KiB
+static const uint16_t RECORD_FLUSH_SAMPLES = 128;          // one 256-byte flash page
+// Committing a take (or a reslice) runs in the loop a page at a time, for
+// at most this long per pass; the rest of the pass is MIDI and refills.
+static const uint16_t COMMIT_BUDGET_US     = 2000;
+// 1: a timer starts every ADC conversion and the DMAC moves the results into
+//    a double buffer of RECORD_DMA_FRAMES halves. The loop only converts
+//    finished halves, so capture stays on the sample clock however slow a
+//    pass is, as long as it comes back within one half.
+// 0: legacy path, service() polls micros() and does one analogRead per pass.
+#ifndef RECORD_DMA_CAPTURE
+#define RECORD_DMA_CAPTURE 1
+#endif
+static const uint16_t RECORD_DMA_FRAMES = 256;             // ≈11.6 ms per half
+
+// ---------- Slicing ----------
+// 1: takes are cut at their strongest onsets, found while recording (see
+//    OnsetDetector.h), each cut snapped back to a zero crossing.
+// 0: equal eighths. Either way Slicer::setCutMode() switches at runtime.
+#ifndef SLICE_AT_ONSETS
+#define SLICE_AT_ONSETS 1
+#endif
+static const uint16_t ONSET_HOP_SAMPLES     = 128;   // ≈5.8 ms level window
+static const uint16_t ONSET_MIN_GAP_SAMPLES = 1323;  // ≈60 ms between cuts
+static const uint16_t ONSET_FLOOR           = 128;   // mean |x|; ≈-48 dBFS, quieter never cuts
+static const uint8_t  ONSET_CANDIDATES      = 16;
+
+// ---------- Telemetry ----------
+// 1: the mixer, service(), stream pump, flash reads, UI draw and the loop
+//    pass are timed against their deadlines, and underruns counted (see
+//    Telemetry.h). About two cycle-counter reads per probe; 't' on the
+//    Serial monitor dumps it, 'T' dumps and clears.
+// 0: the probes compile away.
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED 1
+#endif
 
 // ---------- Pins ----------
 #define DAC_PIN_L      A0
@@ -33,6 +178,9 @@ static const RGB ROW_COLOR[4] = {
 static const float BRIGHT_OFF = 0.06f;
 static const float BRIGHT_ON  = 0.35f;
 static const float BRIGHT_STEP= 0.7f;
+// TrellisUI redraws at most this often and only pushes the strip when a
+// pad changed (≈60 Hz).
+static const uint8_t UI_FRAME_MS = 16;
 
 // ---------- Storage ----------
 #define FS_LABEL       "NTM4"
@@ -40,3 +188,36 @@ static const float BRIGHT_STEP= 0.7f;
 #define PATH_B         "/B"
 #define PATH_C         "/C"
 #define PATH_D         "/D"
+
+// 1: a row's slices are ranges of its source.raw, listed in /<Row>/slices.tbl;
+//    a take is written once and a reslice only rewrites the table.
+// 0: every slice is its own /<Row>/<Row>N.raw file next to source.raw.
+#ifndef VIRTUAL_SLICES
+#define VIRTUAL_SLICES 1
+#endif
+
+// First SLICE_HEAD_SAMPLES of every slice (A1..D8) stay resident in RAM so a
+// trigger starts without waiting on flash: 32 * 2 * N bytes (8 KiB at 128).
+static const uint16_t SLICE_HEAD_SAMPLES = 128;  // ≈5.8 ms
+
+// 1: Slicer writes slices as 4-bit IMA ADPCM (~4:1), decoded as they stream.
+//    Quarter the flash traffic per voice, at some hiss on quiet material.
+//    With VIRTUAL_SLICES that means source.raw itself (recordings too);
+//    the sample bank stays 16-bit PCM either way.
+#ifndef SLICE_ADPCM
+#define SLICE_ADPCM 0
+#endif
+
+// ---------- Sample bank (optional XIP region) ----------
+// A slot per row plus a pre-erased spare for the next take (and two header
+// sectors) at the top of QSPI flash, outside LittleFS, that the ISR reads
+// straight through the memory-mapped window. FlashFS stops below the region
+// (flash size - SAMPLE_BANK_BYTES) whether or not the bank is on; slice
+// files stay the source of truth and the bank is rebuilt on every commit.
+#ifndef SAMPLE_BANK_ENABLED
+#define SAMPLE_BANK_ENABLED 0
+#endif
+static const uint32_t SAMPLE_BANK_SECTOR     = 4096;
+static const uint32_t SAMPLE_BANK_SLOT_BYTES =
+    ((MAX_RECORD_SAMPLES * 2u) + SAMPLE_BANK_SECTOR - 1u) / SAMPLE_BANK_SECTOR * SAMPLE_BANK_SECTOR;
+static const uint32_t SAMPLE_BANK_BYTES      = 2u * SAMPLE_BANK_SECTOR + 5u * SAMPLE_BANK_SLOT_BYTES;
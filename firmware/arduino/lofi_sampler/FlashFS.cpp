@@ -0,0 +1,160 @@
+#include "FlashFS.h"
+#include <Adafruit_SPIFlash.h>
+#include <string.h>
+
+FlashFS::FlashFS(Adafruit_SPIFlash& f) : Adafruit_LittleFS(&cfg), flash(f) {
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.context = this;
+  cfg.read = blockRead;
+  cfg.prog = blockProg;
+  cfg.erase = blockErase;
+  cfg.sync = blockSync;
+  cfg.read_size = 256;
+  cfg.prog_size = 256;
+  cfg.block_size = BLOCK_BYTES;
+  cfg.lookahead = 256;
+  memset(blank, 0, sizeof(blank));
+  memset(used, 0, sizeof(used));
+}
+
+bool FlashFS::begin() {
+  setGeometry();
+  uint32_t stored = storedBlockCount();
+  if (stored && stored != cfg.block_count && stored <= flash.size() / BLOCK_BYTES) {
+    // LittleFS doesn't check the count it's given against the one it was
+    // formatted with, so mount with the drive's own.
+    legacy = stored > cfg.block_count;
+    cfg.block_count = stored;
+  }
+  return Adafruit_LittleFS::begin();
+}
+
+bool FlashFS::format() {
+  setGeometry();
+  return Adafruit_LittleFS::format();
+}
+
+void FlashFS::setGeometry() {
+  // The bank sits at the top (SampleBank::begin()). Its region stays out
+  // even with the bank off, so turning it on never needs a reformat and
+  // service() never erases under it.
+  uint32_t bytes = flash.size();
+  bytes = bytes > SAMPLE_BANK_BYTES ? (bytes - SAMPLE_BANK_BYTES) : 0;
+  cfg.block_count = bytes / BLOCK_BYTES;
+  legacy = false;
+  superblock = false;
+  // Nothing is known about the blocks until service() has looked.
+  memset(blank, 0, sizeof(blank));
+  usedValid = false;
+}
+
+bool FlashFS::service() {
+  if (legacy) return false;
+  if (!usedValid) {
+    memset(used, 0, sizeof(used));
+    if (lfs_traverse(_getFS(), markUsed, this) < 0) return false;
+    usedValid = true;
+    scanned = 0;
+    return true;
+  }
+  uint32_t n = cfg.block_count < POOL_BLOCKS ? cfg.block_count : POOL_BLOCKS;
+  for (; scanned < n; ++scanned) {
+    uint32_t b = cursor;
+    cursor = cursor + 1 < n ? cursor + 1 : 0;
+    if (test(used, b) || test(blank, b)) continue;
+    // Freed blocks are often blank already (a fresh format, or a file that
+    // never got that far); reading is cheap next to an erase.
+    if (!isBlank(b)) {
+      if (!flash.eraseSector(b)) return false;
+      counters.prepared++;
+    }
+    set(blank, b);
+    ++scanned;
+    return true;
+  }
+  return false;
+}
+
+uint32_t FlashFS::storedBlockCount() {
+  // littlefs v1 opens both halves of the superblock pair with the directory
+  // header (rev, size, tail[2]), then the superblock entry: type, three
+  // lengths, root[2], block_size, block_count, version, "littlefs".
+  uint32_t best = 0, bestRev = 0;
+  bool found = false;
+  for (lfs_block_t b = 0; b < 2; ++b) {
+    uint8_t d[48];
+    if (flash.readBuffer(b * BLOCK_BYTES, d, sizeof(d)) != sizeof(d)) continue;
+    if (d[16] != 0x2E || memcmp(d + 40, "littlefs", 8) != 0) continue;
+    superblock = true;
+    uint32_t rev, blockSize, blockCount;
+    memcpy(&rev, d, 4);
+    memcpy(&blockSize, d + 28, 4);
+    memcpy(&blockCount, d + 32, 4);
+    if (blockSize != BLOCK_BYTES) continue;
+    if (!found || (int32_t)(rev - bestRev) > 0) {
+      best = blockCount;
+      bestRev = rev;
+      found = true;
+    }
+  }
+  return best;
+}
+
+uint32_t FlashFS::blankBlocks() const {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < sizeof(blank); ++i) {
+    for (uint8_t m = blank[i]; m; m &= (uint8_t)(m - 1)) n++;
+  }
+  return n;
+}
+
+bool FlashFS::isBlank(lfs_block_t block) {
+  uint32_t page[64];
+  uint32_t addr = block * BLOCK_BYTES;
+  for (uint32_t off = 0; off < BLOCK_BYTES; off += sizeof(page)) {
+    if (flash.readBuffer(addr + off, (uint8_t*)page, sizeof(page)) != sizeof(page)) return false;
+    for (uint32_t i = 0; i < 64; ++i) {
+      if (page[i] != 0xFFFFFFFFu) return false;
+    }
+  }
+  return true;
+}
+
+int FlashFS::blockRead(const lfs_config* c, lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size) {
+  FlashFS* fs = (FlashFS*)c->context;
+  uint32_t addr = block * BLOCK_BYTES + off;
+  return fs->flash.readBuffer(addr, (uint8_t*)buffer, size) == size ? 0 : LFS_ERR_IO;
+}
+
+int FlashFS::blockProg(const lfs_config* c, lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size) {
+  FlashFS* fs = (FlashFS*)c->context;
+  fs->usedValid = false;
+  if (block < POOL_BLOCKS) clear(fs->blank, block);
+  uint32_t addr = block * BLOCK_BYTES + off;
+  return fs->flash.writeBuffer(addr, (const uint8_t*)buffer, size) == size ? 0 : LFS_ERR_IO;
+}
+
+int FlashFS::blockErase(const lfs_config* c, lfs_block_t block) {
+  FlashFS* fs = (FlashFS*)c->context;
+  // Every allocation comes through here, so the free list is stale now.
+  fs->usedValid = false;
+  fs->counters.erasesAsked++;
+  if (block < POOL_BLOCKS && test(fs->blank, block)) {
+    clear(fs->blank, block);
+    return 0;
+  }
+  fs->counters.erasesDone++;
+  return fs->flash.eraseSector(block) ? 0 : LFS_ERR_IO;
+}
+
+int FlashFS::blockSync(const lfs_config* c) {
+  FlashFS* fs = (FlashFS*)c->context;
+  fs->flash.waitUntilReady();
+  return 0;
+}
+
+int FlashFS::markUsed(void* self, lfs_block_t block) {
+  FlashFS* fs = (FlashFS*)self;
+  if (block < POOL_BLOCKS) set(fs->used, block);
+  return 0;
+}
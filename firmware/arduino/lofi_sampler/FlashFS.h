@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <Adafruit_LittleFS.h>
+#include "Config.h"
+
+class Adafruit_SPIFlash;
+
+// LittleFS on the QSPI flash below the sample bank's region, with
+// the block device in the sketch so its erases can be done ahead of time.
+//
+// LittleFS erases every block it allocates right before programming it, and
+// a 4 KiB erase is ~45 ms on the board: a new source.raw, slice file or
+// slice table pays one per block, in the middle of a take or a commit.
+// Here the erase hook skips any block known to be blank (erased and not
+// programmed since), and service() tops that pool up: it finds the free
+// blocks (lfs_traverse) and erases them, one per call, while the loop has
+// nothing better to do.
+class FlashFS : public Adafruit_LittleFS {
+public:
+  static constexpr uint32_t BLOCK_BYTES = 4096;
+  // Blocks the blank pool can track (8 MiB); any past that erase inline.
+  static constexpr uint32_t POOL_BLOCKS = 2048;
+
+  explicit FlashFS(Adafruit_SPIFlash& flash);
+
+  // Size the filesystem to the flash (call after flash.begin()) and mount.
+  // A drive formatted to another size (older firmware used the whole chip)
+  // is mounted as it is rather than left to fail and be reformatted.
+  bool begin();
+  // Lays the drive out fresh, below the bank; this wipes it.
+  bool format();
+  // The mounted drive reaches into the sample bank's region: the bank must
+  // stay off, and service() does nothing, until it's reformatted.
+  bool overlapsBank() const { return legacy; }
+  // begin() found a LittleFS superblock, so a failed mount isn't a blank
+  // drive and shouldn't be formatted over.
+  bool formatted() const { return superblock; }
+
+  // Ready one free block: skip it if it reads blank, erase it otherwise.
+  // After any filesystem write the first call re-learns which blocks are
+  // free instead. Blocks for the erase, so only call it when nothing reads
+  // flash; false once every free block is ready.
+  bool service();
+
+  struct Stats {
+    uint32_t erasesAsked = 0;   // erase hook calls from LittleFS
+    uint32_t erasesDone = 0;    // ...that had to erase
+    uint32_t prepared = 0;      // blocks service() erased
+  };
+  const Stats& stats() const { return counters; }
+  void resetStats() { counters = Stats(); }
+  // Free blocks known blank right now.
+  uint32_t blankBlocks() const;
+
+private:
+  static int blockRead(const lfs_config* c, lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size);
+  static int blockProg(const lfs_config* c, lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size);
+  static int blockErase(const lfs_config* c, lfs_block_t block);
+  static int blockSync(const lfs_config* c);
+  static int markUsed(void* self, lfs_block_t block);
+
+  void setGeometry();
+  // Block count from the superblock LittleFS left in block 0 or 1, or 0.
+  uint32_t storedBlockCount();
+  bool isBlank(lfs_block_t block);
+  static bool test(const uint8_t* map, uint32_t b) { return map[b >> 3] & (1u << (b & 7u)); }
+  static void set(uint8_t* map, uint32_t b) { map[b >> 3] |= (uint8_t)(1u << (b & 7u)); }
+  static void clear(uint8_t* map, uint32_t b) { map[b >> 3] &= (uint8_t)~(1u << (b & 7u)); }
+
+  Adafruit_SPIFlash& flash;
+  lfs_config cfg;
+  uint8_t blank[POOL_BLOCKS / 8];   // erased, not programmed since
+  uint8_t used[POOL_BLOCKS / 8];    // from the last traverse
+  bool usedValid = false;           // no write since that traverse
+  uint32_t cursor = 0;              // next block service() looks at
+  uint32_t scanned = 0;             // blocks looked at since the traverse
+  bool legacy = false;              // mounted past the bank's start
+  bool superblock = false;          // begin() saw one on flash
+  Stats counters;
+};
@@ -0,0 +1,98 @@
+#include "ImaAdpcm.h"
+
+namespace {
+
+const int16_t STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767
+};
+
+const int8_t INDEX_TABLE[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+inline void put16(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+inline uint32_t get16(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8); }
+inline uint32_t get32(const uint8_t* p) { return get16(p) | (get16(p + 2) << 16); }
+
+// Encode one sample against the running state, leaving `s` exactly where the
+// decoder will be after the returned nibble.
+uint8_t encodeSample(ImaAdpcm::State& s, int16_t x) {
+  int32_t step = STEP_TABLE[s.index];
+  int32_t diff = (int32_t)x - s.predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) { nibble = 8; diff = -diff; }
+  if (diff >= step) { nibble |= 4; diff -= step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 2; diff -= step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 1; }
+  ImaAdpcm::decodeNibble(s, nibble);
+  return nibble;
+}
+
+} // namespace
+
+namespace ImaAdpcm {
+
+void writeFileHeader(uint8_t* out, uint32_t totalSamples) {
+  put32(out, MAGIC);
+  put32(out + 4, totalSamples);
+  put16(out + 8, BLOCK_BYTES);
+  put16(out + 10, SAMPLES_PER_BLOCK);
+  put32(out + 12, 0);
+}
+
+int32_t parseFileHeader(const uint8_t* hdr, uint32_t fileSize) {
+  if (get32(hdr) != MAGIC) return -1;
+  if (get16(hdr + 8) != BLOCK_BYTES || get16(hdr + 10) != SAMPLES_PER_BLOCK) return -1;
+  uint32_t total = get32(hdr + 4);
+  // A PCM slice could open with the magic by chance; it won't also have
+  // exactly the size the header implies.
+  if (fileBytes(total) != fileSize) return -1;
+  return (int32_t)total;
+}
+
+void encodeBlock(State& s, const int16_t* pcm, uint32_t samples, uint8_t* out, int16_t* recon) {
+  memset(out, 0, BLOCK_BYTES);
+  if (samples == 0) return;
+  if (samples > SAMPLES_PER_BLOCK) samples = SAMPLES_PER_BLOCK;
+  s.predictor = pcm[0];
+  put16(out, (uint16_t)s.predictor);
+  out[2] = s.index;
+  if (recon) recon[0] = s.predictor;
+  uint8_t* data = out + BLOCK_HEADER_BYTES;
+  for (uint32_t i = 1; i < samples; ++i) {
+    uint8_t nibble = encodeSample(s, pcm[i]);
+    uint32_t k = i - 1;
+    data[k >> 1] |= (k & 1u) ? (uint8_t)(nibble << 4) : nibble;
+    if (recon) recon[i] = s.predictor;
+  }
+}
+
+int16_t beginBlock(State& s, const uint8_t* hdr) {
+  s.predictor = (int16_t)get16(hdr);
+  s.index = hdr[2] > 88 ? 88 : hdr[2];
+  return s.predictor;
+}
+
+int16_t decodeNibble(State& s, uint8_t nibble) {
+  int32_t step = STEP_TABLE[s.index];
+  int32_t diff = step >> 3;
+  if (nibble & 4) diff += step;
+  if (nibble & 2) diff += step >> 1;
+  if (nibble & 1) diff += step >> 2;
+  int32_t p = s.predictor + ((nibble & 8) ? -diff : diff);
+  if (p > 32767) p = 32767;
+  if (p < -32768) p = -32768;
+  s.predictor = (int16_t)p;
+  int32_t idx = (int32_t)s.index + INDEX_TABLE[nibble & 7];
+  s.index = (uint8_t)(idx < 0 ? 0 : (idx > 88 ? 88 : idx));
+  return s.predictor;
+}
+
+} // namespace ImaAdpcm
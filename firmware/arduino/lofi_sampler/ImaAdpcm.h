@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+
+// 4-bit IMA ADPCM for slice files, in blocks laid out like WAV's mono IMA:
+// each BLOCK_BYTES block opens with a 4-byte header (first sample as int16,
+// step index, a zero pad byte) and packs the other SAMPLES_PER_BLOCK - 1
+// samples two to a byte, low nibble first. Every block restarts the
+// predictor from its header, so a reader can seek to any block.
+//
+// A file is a FILE_HEADER_BYTES header (magic, total samples, block bytes,
+// samples per block, all little-endian) followed by whole blocks; the last
+// one is zero-padded. Slices keep their ".raw" names; Storage tells the two
+// formats apart by the header.
+namespace ImaAdpcm {
+  static constexpr uint32_t MAGIC             = 0x34414D49u; // "IMA4"
+  static constexpr uint32_t FILE_HEADER_BYTES = 16;
+  static constexpr uint32_t BLOCK_BYTES       = 256;
+  static constexpr uint32_t BLOCK_HEADER_BYTES = 4;
+  static constexpr uint32_t SAMPLES_PER_BLOCK = (BLOCK_BYTES - BLOCK_HEADER_BYTES) * 2u + 1u; // 505
+
+  struct State {
+    int16_t predictor = 0;
+    uint8_t index = 0;
+  };
+
+  inline uint32_t blockCount(uint32_t samples) {
+    return (samples + SAMPLES_PER_BLOCK - 1u) / SAMPLES_PER_BLOCK;
+  }
+  inline uint32_t fileBytes(uint32_t samples) {
+    return FILE_HEADER_BYTES + blockCount(samples) * BLOCK_BYTES;
+  }
+
+  void writeFileHeader(uint8_t* out, uint32_t totalSamples);
+  // Returns the sample count, or -1 if hdr isn't a header matching fileSize.
+  int32_t parseFileHeader(const uint8_t* hdr, uint32_t fileSize);
+
+  // Encode up to SAMPLES_PER_BLOCK samples into one BLOCK_BYTES block. The
+  // step index carries over in `s`. If recon is given it receives what the
+  // decoder will reproduce.
+  void encodeBlock(State& s, const int16_t* pcm, uint32_t samples, uint8_t* out, int16_t* recon = nullptr);
+
+  // Start a block from its 4-byte header; returns its first sample.
+  int16_t beginBlock(State& s, const uint8_t* hdr);
+  int16_t decodeNibble(State& s, uint8_t nibble);
+}
@@ -0,0 +1,84 @@
+#include "OnsetDetector.h"
+
+void OnsetDetector::endHop() {
+  uint32_t level = acc / ONSET_HOP_SAMPLES;
+  uint32_t slow = slowQ4 >> 4;
+  acc = 0;
+  hopFill = 0;
+  // A rise to 1.5x the recent level, still climbing, and above the floor.
+  if (level >= ONSET_FLOOR && level * 2u >= slow * 3u && level > prevLevel) {
+    consider(hopZc, level - slow);
+  }
+  // ~8-hop average; its lag is what lets the attack stand out.
+  slowQ4 += (int32_t)((level << 4) - slowQ4) >> 3;
+  prevLevel = level;
+  // The next hop opens at pos; an attack in it is cut at the crossing just
+  // before, or right at pos if the signal has sat on one side for a while.
+  hopZc = (pos - lastZc <= ONSET_HOP_SAMPLES) ? lastZc : pos;
+}
+
+void OnsetDetector::consider(uint32_t at, uint32_t strength) {
+  // Slice 1 already starts at 0.
+  if (at < ONSET_MIN_GAP_SAMPLES) return;
+  // An attack spread over a few hops is one onset: keep its first cut and
+  // its biggest rise.
+  for (uint8_t i = 0; i < used; ++i) {
+    if (at - cand[i].pos < ONSET_MIN_GAP_SAMPLES) {
+      if (strength > cand[i].strength) cand[i].strength = strength;
+      return;
+    }
+  }
+  if (used < ONSET_CANDIDATES) {
+    cand[used++] = {at, strength};
+    return;
+  }
+  uint8_t weakest = 0;
+  for (uint8_t i = 1; i < used; ++i) {
+    if (cand[i].strength < cand[weakest].strength) weakest = i;
+  }
+  if (strength > cand[weakest].strength) cand[weakest] = {at, strength};
+}
+
+void OnsetDetector::cuts(uint32_t count, uint32_t* sliceStart, uint32_t* sliceLen) const {
+  // Strongest first, skipping any that would leave a sliver at the end.
+  Candidate best[ONSET_CANDIDATES];
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < used; ++i) {
+    if (cand[i].pos + ONSET_MIN_GAP_SAMPLES <= count) best[n++] = cand[i];
+  }
+  for (uint8_t i = 1; i < n; ++i) {
+    for (uint8_t j = i; j > 0 && best[j].strength > best[j - 1].strength; --j) {
+      Candidate t = best[j]; best[j] = best[j - 1]; best[j - 1] = t;
+    }
+  }
+  if (n > 7) n = 7;
+  sliceStart[0] = 0;
+  for (uint8_t i = 0; i < n; ++i) sliceStart[i + 1] = best[i].pos;
+  uint8_t slices = n + 1;
+  // Time order.
+  for (uint8_t i = 2; i < slices; ++i) {
+    for (uint8_t j = i; j > 1 && sliceStart[j] < sliceStart[j - 1]; --j) {
+      uint32_t t = sliceStart[j]; sliceStart[j] = sliceStart[j - 1]; sliceStart[j - 1] = t;
+    }
+  }
+  // Too few onsets (a pad, a drone): halve the longest slice until there
+  // are eight.
+  while (slices < 8) {
+    uint8_t longest = 0;
+    uint32_t longestLen = 0;
+    for (uint8_t i = 0; i < slices; ++i) {
+      uint32_t end = (i + 1 < slices) ? sliceStart[i + 1] : count;
+      if (end - sliceStart[i] > longestLen) {
+        longestLen = end - sliceStart[i];
+        longest = i;
+      }
+    }
+    for (uint8_t i = slices; i > longest + 1; --i) sliceStart[i] = sliceStart[i - 1];
+    sliceStart[longest + 1] = sliceStart[longest] + longestLen / 2;
+    slices++;
+  }
+  for (uint8_t i = 0; i < 8; ++i) {
+    uint32_t end = (i < 7) ? sliceStart[i + 1] : count;
+    sliceLen[i] = end - sliceStart[i];
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+
+// Finds slice points in a take as it is captured, so they are ready the
+// moment recording stops. All integer: each sample adds its magnitude to an
+// ONSET_HOP_SAMPLES window and notes zero crossings; at the end of a window
+// its mean level is compared against a slow running average, and a sharp
+// enough rise becomes a candidate cut at the last zero crossing before the
+// window opened. Only the ONSET_CANDIDATES strongest are kept, at least
+// ONSET_MIN_GAP_SAMPLES apart.
+class OnsetDetector {
+public:
+  void reset() { *this = OnsetDetector(); }
+
+  void push(int16_t s) {
+    acc += (uint32_t)(s < 0 ? -(int32_t)s : s);
+    if ((s < 0) != (prev < 0)) lastZc = pos;
+    prev = s;
+    pos++;
+    if (++hopFill == ONSET_HOP_SAMPLES) endHop();
+  }
+  void push(const int16_t* src, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) push(src[i]);
+  }
+
+  // Eight slices over the first count samples: slice 1 starts at 0, the
+  // others at the seven strongest onsets in time order. Short of seven,
+  // the longest slices are halved until there are eight.
+  void cuts(uint32_t count, uint32_t* sliceStart, uint32_t* sliceLen) const;
+  uint8_t onsets() const { return used; }
+
+private:
+  struct Candidate {
+    uint32_t pos;
+    uint32_t strength;
+  };
+
+  void endHop();
+  void consider(uint32_t at, uint32_t strength);
+
+  uint32_t pos = 0;        // samples seen
+  uint32_t acc = 0;        // sum of |x| over the current hop
+  uint16_t hopFill = 0;
+  int16_t  prev = 0;
+  uint32_t lastZc = 0;     // last sign change
+  uint32_t hopZc = 0;      // cut point for an onset in the current hop
+  uint32_t slowQ4 = 0;     // running level, Q4
+  uint32_t prevLevel = 0;
+  Candidate cand[ONSET_CANDIDATES];
+  uint8_t  used = 0;
+};
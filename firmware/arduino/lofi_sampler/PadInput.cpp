@@ -12,6 +12,8 @@ void ModifierTracker::reset() {
   for (uint8_t i = 0; i < 4; ++i) {
     altState[i] = false;
     shiftState[i] = false;
+    shiftTapClean[i] = false;
+    altShiftTap[i] = false;
   }
 }
 
@@ -23,8 +25,10 @@ bool ModifierTracker::handlePress(uint8_t row, uint8_t col) {
   }
   if (col == COL_SHIFT) {
     shiftState[row] = true;
+    shiftTapClean[row] = altState[row];
     return true;
   }
+  shiftTapClean[row] = false;
   return false;
 }
 
@@ -32,10 +36,13 @@ bool ModifierTracker::handleRelease(uint8_t row, uint8_t col) {
   if (row >= 4) return false;
   if (col == COL_ALT) {
     altState[row] = false;
+    shiftTapClean[row] = false;
     return true;
   }
   if (col == COL_SHIFT) {
     shiftState[row] = false;
+    if (shiftTapClean[row]) altShiftTap[row] = true;
+    shiftTapClean[row] = false;
     return true;
   }
   return false;
@@ -50,6 +57,12 @@ PadModifiers ModifierTracker::modifiersFor(uint8_t row) const {
   return mods;
 }
 
+bool ModifierTracker::takeAltShiftTap(uint8_t row) {
+  if (row >= 4 || !altShiftTap[row]) return false;
+  altShiftTap[row] = false;
+  return true;
+}
+
 void resetPadActionRegistry() {
   for (uint8_t i = 0; i < MAX_PAD_ACTIONS; ++i) {
     registry[i] = nullptr;
@@ -27,10 +27,15 @@ public:
   bool handlePress(uint8_t row, uint8_t col);
   bool handleRelease(uint8_t row, uint8_t col);
   PadModifiers modifiersFor(uint8_t row) const;
+  // True once after Shift is tapped on a row that held Alt throughout, with
+  // no pad pressed in between (so Shift+Alt combos don't count).
+  bool takeAltShiftTap(uint8_t row);
 
 private:
   bool altState[4] = {false, false, false, false};
   bool shiftState[4] = {false, false, false, false};
+  bool shiftTapClean[4] = {false, false, false, false};
+  bool altShiftTap[4] = {false, false, false, false};
 };
 
 typedef PadActionResult (*PadComboAction)(uint8_t row, uint8_t col, const PadModifiers& mods);
@@ -1,5 +1,85 @@
 
 #include "RecorderADC.h"
+#if RECORD_DMA_CAPTURE
+#include <Adafruit_ZeroTimer.h>
+#include <Adafruit_ZeroDMA.h>
+
+// TC3 paces the DACs; capture gets its own timer so recording doesn't hang
+// off the engine being started.
+static Adafruit_ZeroTimer captureTimer = Adafruit_ZeroTimer(2);
+static Adafruit_ZeroDMA captureDma;
+static uint16_t captureBuf[2][RECORD_DMA_FRAMES];
+// Halves the DMAC has filled since start(); half n % 2 holds block n.
+static volatile uint32_t captureBlocks = 0;
+
+static void onCaptureBlock(Adafruit_ZeroDMA*) {
+  captureBlocks = captureBlocks + 1;
+}
+
+#if defined(LOFI_HOST_BUILD)
+#include "HostSim.h"
+// HostSim stands in for the event routing: TC2 converts into ADC0 each tick.
+static volatile uint16_t* adcResult(int) { return &ADC0->RESULT.reg; }
+static uint8_t adcTrigger(int) { return ADC0_DMAC_ID_RESRDY; }
+static void routeTimerToAdc(int pin) { HostSim::routeTimerToAdc(2, pin); }
+#else
+static Adc* adcFor(int pin) {
+  return (g_APinDescription[pin].ulPinAttribute & PIN_ATTR_ANALOG_ALT) ? ADC1 : ADC0;
+}
+static volatile uint16_t* adcResult(int pin) { return &adcFor(pin)->RESULT.reg; }
+static uint8_t adcTrigger(int pin) {
+  return adcFor(pin) == ADC1 ? ADC1_DMAC_ID_RESRDY : ADC0_DMAC_ID_RESRDY;
+}
+
+static const uint8_t CAPTURE_EVSYS_CHANNEL = 0;
+
+// TC2 overflow -> EVSYS -> ADC START. Same settings analogRead() would use
+// (12-bit, 4x averaging), but each conversion is started by the event
+// instead of software.
+static void routeTimerToAdc(int pin) {
+  Adc* adc = adcFor(pin);
+  // One analogRead() muxes the pin and brings up the ADC's clock for us.
+  analogRead(pin);
+  adc->CTRLA.bit.ENABLE = 0;
+  while (adc->SYNCBUSY.bit.ENABLE);
+  adc->CTRLA.bit.PRESCALER = ADC_CTRLA_PRESCALER_DIV16_Val;  // 4 conversions fit a period
+  adc->INPUTCTRL.reg = ADC_INPUTCTRL_MUXPOS(g_APinDescription[pin].ulADCChannelNumber) |
+                       ADC_INPUTCTRL_MUXNEG_GND;
+  adc->CTRLB.bit.RESSEL = ADC_CTRLB_RESSEL_16BIT_Val;
+  adc->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM_4 | ADC_AVGCTRL_ADJRES(2);
+  adc->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+  while (adc->SYNCBUSY.reg);
+  adc->CTRLA.bit.ENABLE = 1;
+  while (adc->SYNCBUSY.bit.ENABLE);
+
+  MCLK->APBBMASK.reg |= MCLK_APBBMASK_EVSYS;
+  EVSYS->Channel[CAPTURE_EVSYS_CHANNEL].CHANNEL.reg =
+      EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_TC2_OVF) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS;
+  EVSYS->USER[adc == ADC1 ? EVSYS_ID_USER_ADC1_START : EVSYS_ID_USER_ADC0_START].reg =
+      EVSYS_USER_CHANNEL(CAPTURE_EVSYS_CHANNEL + 1);
+  // EVCTRL is enable-protected; ZeroTimer leaves the TC off until enable().
+  TC2->COUNT16.EVCTRL.reg |= TC_EVCTRL_OVFEO;
+}
+#endif
+
+static bool setupCapture(int pin) {
+  captureTimer.configure(TC_CLOCK_PRESCALER_DIV1, TC_COUNTER_SIZE_16BIT, TC_WAVE_GENERATION_MATCH_FREQ);
+  captureTimer.setCompare(0, (F_CPU / SAMPLE_RATE_HZ) - 1);
+  routeTimerToAdc(pin);
+  captureDma.setTrigger(adcTrigger(pin));
+  captureDma.setAction(DMA_TRIGGER_ACTON_BEAT);
+  if (captureDma.allocate() != DMA_STATUS_OK) return false;
+  for (uint8_t h = 0; h < 2; ++h) {
+    DmacDescriptor* d = captureDma.addDescriptor((void*)adcResult(pin), captureBuf[h], RECORD_DMA_FRAMES,
+                                                 DMA_BEAT_SIZE_HWORD, false, true);
+    if (!d) return false;
+    d->BTCTRL.bit.BLOCKACT = DMA_BLOCK_ACTION_INT;
+  }
+  captureDma.loop(true);
+  captureDma.setCallback(onCaptureBlock);
+  return true;
+}
+#endif
 
 bool RecorderADC::begin() {
   buf = (int16_t*)malloc(CAP * sizeof(int16_t));
@@ -9,23 +89,76 @@ bool RecorderADC::begin() {
   analogReadAveraging(4);
   // Stay explicit about the reference so 0..4095 maps to 0..3.3 V bias network.
   analogReference(AR_DEFAULT);
+#if RECORD_DMA_CAPTURE
+  // The pin is baked into the routing; setInputPin() has to come first.
+  if (!setupCapture(analogPin)) return false;
+#endif
   return buf != nullptr;
 }
 
 void RecorderADC::start() {
   if (!buf) return;
   idx = 0;
+  drained = 0;
+  dropped = 0;
+  detector.reset();
   rec = true;
+#if RECORD_DMA_CAPTURE
+  captureBlocks = 0;
+  handled = 0;
+  captureDma.startJob();
+  captureTimer.enable(true);
+#else
   nextMicros = micros();
+#endif
 }
 
 uint32_t RecorderADC::stop() {
-  rec = false;
+  // Keep the halves that finished; the one in flight is dropped.
+  service();
+  halt();
   return idx;
 }
 
+void RecorderADC::halt() {
+  rec = false;
+#if RECORD_DMA_CAPTURE
+  captureTimer.enable(false);
+  captureDma.abort();
+#endif
+}
+
+void RecorderADC::push(int16_t s) {
+  if (idx >= LIMIT) {
+    halt();
+  } else if (idx - drained >= CAP) {
+    dropped++;   // ring full: the loop hasn't drained in time
+  } else {
+    buf[idx % CAP] = s;
+    idx++;
+    detector.push(s);
+  }
+}
+
 uint32_t RecorderADC::service() {
   if (!rec) return idx;
+#if RECORD_DMA_CAPTURE
+  uint32_t done = captureBlocks;
+  while (handled != done && rec) {
+    if (done - handled > 1) {
+      // The DMAC has lapped this half while the loop was away.
+      dropped += RECORD_DMA_FRAMES;
+      handled++;
+      continue;
+    }
+    const uint16_t* raw = captureBuf[handled & 1u];
+    for (uint16_t i = 0; i < RECORD_DMA_FRAMES; ++i) {
+      // 12-bit centered, scaled to 16-bit
+      push((int16_t)(((int)raw[i] - 2048) << 4));
+    }
+    handled++;
+  }
+#else
   // naive timed sampling; good enough for short takes
   uint32_t period = 1000000UL / SAMPLE_RATE_HZ;
   uint32_t now = micros();
@@ -33,9 +166,22 @@ uint32_t RecorderADC::service() {
     nextMicros += period;
     int v = analogRead(analogPin) - 2048; // 12-bit centered
     // scale 12-bit to 16-bit
-    int16_t s = (int16_t)(v << 4);
-    if (idx < CAP) buf[idx++] = s;
-    else rec = false;
+    push((int16_t)(v << 4));
   }
+#endif
   return idx;
 }
+
+uint32_t RecorderADC::drain(int16_t* dst, uint32_t maxSamples) {
+  if (!buf || !dst) return 0;
+  uint32_t n = idx - drained;
+  if (n > maxSamples) n = maxSamples;
+  // Copy in up to two runs around the wrap.
+  uint32_t at = drained % CAP;
+  uint32_t first = CAP - at;
+  if (first > n) first = n;
+  memcpy(dst, buf + at, first * sizeof(int16_t));
+  memcpy(dst + first, buf, (n - first) * sizeof(int16_t));
+  drained += n;
+  return n;
+}
@@ -1,27 +1,51 @@
-
 #pragma once
 #include <Arduino.h>
 #include "Config.h"
+#include "OnsetDetector.h"
 
+// Captures line-in at SAMPLE_RATE_HZ. With RECORD_DMA_CAPTURE a timer
+// triggers the ADC and the DMAC fills a double buffer; service() just
+// converts the finished halves. With RECORD_STREAM_TO_FLASH the samples
+// land in a RECORD_RING_SAMPLES ring that the loop drain()s to flash as it
+// goes; otherwise the whole take sits in a MAX_RECORD_SAMPLES buffer until
+// stop().
 class RecorderADC {
 public:
   bool begin();
+  // Before begin(): DMA capture routes the pin once.
   void setInputPin(int pin) { analogPin = pin; }
   void start();
   uint32_t stop(); // returns samples recorded
   bool isRecording() const { return rec; }
   // call frequently during recording; returns samples currently in buffer
   uint32_t service();
-  const int16_t* data() const { return buf; }
-  // Expose a writable view so reslice routines can reuse the capture buffer as
-  // scratch RAM once recording is idle (no extra heap grab on SAMD51).
-  int16_t* mutableData() { return buf; }
+  // RAM mode only (nullptr when streaming).
+  const int16_t* data() const { return streaming ? nullptr : buf; }
+
+  // Streaming: samples captured but not yet drained, and a copy-out that
+  // frees them. Keep draining after stop() until pending() is 0.
+  uint32_t pending() const { return idx - drained; }
+  uint32_t drain(int16_t* dst, uint32_t maxSamples);
+  // Samples lost because the loop fell behind: the ring was full, or the
+  // DMAC lapped a half before service() got to it.
+  uint32_t overruns() const { return dropped; }
+  // Onsets of the current (or last) take, positions in captured samples.
+  const OnsetDetector& onsets() const { return detector; }
 
 private:
+  void push(int16_t s);
+  void halt();
+
   volatile bool rec = false;
   int analogPin = ANALOG_IN_PIN;
-  static const uint32_t CAP = MAX_RECORD_SAMPLES;
+  static const bool     streaming = RECORD_STREAM_TO_FLASH;
+  static const uint32_t CAP = RECORD_STREAM_TO_FLASH ? RECORD_RING_SAMPLES : MAX_RECORD_SAMPLES;
+  static const uint32_t LIMIT = RECORD_STREAM_TO_FLASH ? MAX_STREAM_RECORD_SAMPLES : MAX_RECORD_SAMPLES;
   int16_t* buf = nullptr;
-  uint32_t idx = 0;
+  uint32_t idx = 0;       // samples captured this take
+  uint32_t drained = 0;   // streaming: samples handed to drain()
+  uint32_t dropped = 0;
+  uint32_t handled = 0;   // DMA halves converted so far
   uint32_t nextMicros = 0;
+  OnsetDetector detector;
 };
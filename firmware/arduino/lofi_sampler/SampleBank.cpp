@@ -0,0 +1,295 @@
+#include "SampleBank.h"
+#include <Adafruit_SPIFlash.h>
+#include <string.h>
+
+extern Adafruit_SPIFlash flash;
+
+#if defined(LOFI_HOST_BUILD)
+// The host flash stand-in is already an mmap'd array; its base is the window.
+static const uint8_t* xipWindow() { return HostFlash::xipBase(); }
+static void armXip() {}
+#else
+static const uint8_t* xipWindow() { return (const uint8_t*)QSPI_AHB; }
+
+// Leave the QSPI controller in memory-mode quad reads (0x6B, 8 dummy cycles)
+// so plain loads from QSPI_AHB fetch flash. Adafruit's transport rewrites
+// INSTRFRAME for commands, hence re-arming after every flash operation.
+static void armXip() {
+  QSPI->INSTRCTRL.reg = QSPI_INSTRCTRL_INSTR(0x6B);
+  QSPI->INSTRFRAME.reg = QSPI_INSTRFRAME_WIDTH_QUAD_OUTPUT |
+                         QSPI_INSTRFRAME_ADDRLEN_24BITS |
+                         QSPI_INSTRFRAME_INSTREN |
+                         QSPI_INSTRFRAME_ADDREN |
+                         QSPI_INSTRFRAME_DATAEN |
+                         QSPI_INSTRFRAME_TFRTYPE_READMEMORY |
+                         QSPI_INSTRFRAME_DUMMYLEN(8);
+  (void)QSPI->INSTRFRAME.reg; // sync before the first AHB access
+}
+#endif
+
+bool SampleBank::begin() {
+  mapped = false;
+  uint32_t flashBytes = flash.size();
+  if (flashBytes < SAMPLE_BANK_BYTES) return false;
+  baseAddr = (flashBytes - SAMPLE_BANK_BYTES) / SAMPLE_BANK_SECTOR * SAMPLE_BANK_SECTOR;
+
+  // Headers are written to alternate sectors; a torn write leaves the older
+  // copy valid.
+  Header other;
+  flash.readBuffer(headerAddr(0), (uint8_t*)&header, sizeof(header));
+  flash.readBuffer(headerAddr(1), (uint8_t*)&other, sizeof(other));
+  bool ok0 = headerValid(header), ok1 = headerValid(other);
+  if (ok1 && (!ok0 || other.seq > header.seq)) {
+    header = other;
+    live = 1;
+  } else if (ok0) {
+    live = 0;
+  } else {
+    // Blank or stale bank: start empty and let the next commit fill it.
+    resetHeader();
+    live = 1;
+  }
+  spare = SLOTS - 1;
+  for (uint8_t s = 0; s < SLOTS; ++s) {
+    bool used = false;
+    for (uint8_t r = 0; r < 4; ++r) used = used || header.slot[r] == s;
+    if (!used) spare = s;
+  }
+  // Nothing is known about the spare yet; service() skips what's blank.
+  headerErased = false;
+  spareWritten = spareErased = 0;
+  writingRow = NO_ROW;
+
+  armXip();
+  const uint8_t* base = xipWindow();
+  if (!base) return false;
+  window = base + baseAddr;
+  mapped = true;
+  return true;
+}
+
+bool SampleBank::writeRow(uint8_t row, const int16_t* samples, uint32_t count,
+                          const uint32_t* sliceStart, const uint32_t* sliceLen) {
+  if (!mapped || row >= 4 || !samples || !sliceStart || !sliceLen) return false;
+  if (count > SLOT_SAMPLES) return false;
+  beginFlashOp();
+  bool ok = beginRow(row) && writeRowChunk(row, 0, samples, count) &&
+            publishRow(row, count, sliceStart, sliceLen);
+  endFlashOp();
+  return ok;
+}
+
+bool SampleBank::beginRow(uint8_t row) {
+  if (!mapped || row >= 4) return false;
+  // The row keeps playing its published slot; the take goes to the spare.
+  // Whatever an abandoned take left there has to be erased again.
+  if (spareWritten) spareWritten = spareErased = 0;
+  writingRow = row;
+  return true;
+}
+
+bool SampleBank::writeRowChunk(uint8_t row, uint32_t offsetSamples, const int16_t* samples, uint32_t count) {
+  if (!mapped || row != writingRow || !samples) return false;
+  if (offsetSamples > SLOT_SAMPLES || count > SLOT_SAMPLES - offsetSamples) return false;
+  uint32_t addr = slotAddr(spare);
+  uint32_t begin = offsetSamples * 2u;
+  uint32_t end = begin + count * 2u;
+  beginFlashOp();
+  bool ok = true;
+  // Sectors that start inside this chunk haven't been touched yet; only
+  // those service() didn't reach still need erasing.
+  uint32_t sector = (begin + SAMPLE_BANK_SECTOR - 1u) / SAMPLE_BANK_SECTOR * SAMPLE_BANK_SECTOR;
+  for (; ok && sector < end; sector += SAMPLE_BANK_SECTOR) {
+    if (sector < spareErased) continue;
+    ok = flash.eraseSector((addr + sector) / SAMPLE_BANK_SECTOR);
+    if (ok) spareErased = sector + SAMPLE_BANK_SECTOR;
+  }
+  if (ok && end > begin) {
+    ok = flash.writeBuffer(addr + begin, (const uint8_t*)samples, end - begin) == end - begin;
+  }
+  if (end > spareWritten) spareWritten = end;
+  endFlashOp();
+  return ok;
+}
+
+bool SampleBank::publishRow(uint8_t row, uint32_t count, const uint32_t* sliceStart, const uint32_t* sliceLen) {
+  if (!mapped || row != writingRow || !sliceStart || !sliceLen || count > SLOT_SAMPLES) return false;
+  beginFlashOp();
+  RowEntry prev = header.row[row];
+  uint8_t old = header.slot[row];
+  RowEntry& e = header.row[row];
+  e.samples = count;
+  for (uint8_t i = 0; i < 8; ++i) {
+    e.sliceStart[i] = sliceStart[i];
+    e.sliceLen[i] = sliceLen[i];
+  }
+  header.slot[row] = spare;
+  bool ok = writeHeader();
+  if (ok) {
+    // The old take is the next spare; it's erased once nothing plays it.
+    spare = old;
+    spareWritten = spareErased = 0;
+    writingRow = NO_ROW;
+  } else {
+    e = prev;
+    header.slot[row] = old;
+  }
+  endFlashOp();
+  return ok;
+}
+
+void SampleBank::clearRow(uint8_t row) {
+  if (!mapped || row >= 4) return;
+  if (row == writingRow) {
+    // An abandoned take: the spare gets erased from the top again.
+    writingRow = NO_ROW;
+    spareWritten = spareErased = 0;
+  }
+  if (header.row[row].samples == 0) return;
+  beginFlashOp();
+  memset(&header.row[row], 0, sizeof(RowEntry));
+  writeHeader();
+  endFlashOp();
+}
+
+bool SampleBank::setSlices(uint8_t row, const uint32_t* sliceStart, const uint32_t* sliceLen) {
+  if (!mapped || row >= 4 || !sliceStart || !sliceLen) return false;
+  RowEntry& e = header.row[row];
+  if (e.samples == 0) return false;
+  for (uint8_t i = 0; i < 8; ++i) {
+    if (sliceStart[i] + sliceLen[i] > e.samples) return false;
+  }
+  beginFlashOp();
+  for (uint8_t i = 0; i < 8; ++i) {
+    e.sliceStart[i] = sliceStart[i];
+    e.sliceLen[i] = sliceLen[i];
+  }
+  bool ok = writeHeader();
+  endFlashOp();
+  return ok;
+}
+
+bool SampleBank::lookup(const char* path, Slice& out) const {
+  // Slice paths are "/<Row>/<Row><1..8>.raw".
+  if (!path || path[0] != '/' || path[2] != '/') return false;
+  char row = path[1];
+  if (row < 'A' || row > 'D' || path[3] != row) return false;
+  char idx = path[4];
+  if (idx < '1' || idx > '8' || strcmp(path + 5, ".raw") != 0) return false;
+  return slice((uint8_t)(row - 'A'), (uint8_t)(idx - '1'), out);
+}
+
+bool SampleBank::slice(uint8_t row, uint8_t idx, Slice& out) const {
+  if (!mapped || busy() || row >= 4 || idx >= 8) return false;
+  const RowEntry& e = header.row[row];
+  if (e.samples == 0) return false;
+  uint32_t start = e.sliceStart[idx];
+  uint32_t len = e.sliceLen[idx];
+  if (len == 0 || start + len > e.samples) return false;
+  out.data = (const int16_t*)(window + (slotAddr(header.slot[row]) - baseAddr)) + start;
+  out.samples = len;
+  return true;
+}
+
+bool SampleBank::service() {
+  if (!mapped || busy()) return false;
+  if (!headerErased) {
+    headerErased = prepareSector(headerAddr(live ^ 1u));
+    return true;
+  }
+  if (writingRow == NO_ROW && spareErased < SAMPLE_BANK_SLOT_BYTES) {
+    if (prepareSector(slotAddr(spare) + spareErased)) spareErased += SAMPLE_BANK_SECTOR;
+    return true;
+  }
+  return false;
+}
+
+void SampleBank::beginFlashOp() {
+  noInterrupts();
+  busyDepth++;
+  interrupts();
+}
+
+void SampleBank::endFlashOp() {
+  if (busyDepth == 0) return;
+  if (busyDepth == 1) {
+    flash.waitUntilReady();
+    armXip();
+  }
+  noInterrupts();
+  busyDepth--;
+  interrupts();
+}
+
+bool SampleBank::writeHeader() {
+  uint8_t next = live ^ 1u;
+  uint32_t addr = headerAddr(next);
+  if (!headerErased && !flash.eraseSector(addr / SAMPLE_BANK_SECTOR)) return false;
+  headerErased = false;
+  header.seq++;
+  header.crc = headerCrc(header);
+  if (flash.writeBuffer(addr, (const uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+    header.seq--;
+    return false;
+  }
+  live = next;
+  return true;
+}
+
+bool SampleBank::headerValid(const Header& h) {
+  if (h.magic != MAGIC || h.version != VERSION || h.rows != 4 ||
+      h.slotBytes != SAMPLE_BANK_SLOT_BYTES || h.crc != headerCrc(h)) {
+    return false;
+  }
+  for (uint8_t r = 0; r < 4; ++r) {
+    if (h.slot[r] >= SLOTS) return false;
+    for (uint8_t q = 0; q < r; ++q) {
+      if (h.slot[q] == h.slot[r]) return false;
+    }
+  }
+  return true;
+}
+
+uint32_t SampleBank::headerCrc(const Header& h) {
+  // CRC-32 (reflected, 0xEDB88320) over everything but the crc field.
+  const uint8_t* p = (const uint8_t*)&h;
+  uint32_t n = (uint32_t)offsetof(Header, crc);
+  uint32_t crc = 0xFFFFFFFFu;
+  for (uint32_t i = 0; i < n; ++i) {
+    crc ^= p[i];
+    for (uint8_t b = 0; b < 8; ++b) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t SampleBank::headerAddr(uint8_t copy) const {
+  return baseAddr + (uint32_t)copy * SAMPLE_BANK_SECTOR;
+}
+
+uint32_t SampleBank::slotAddr(uint8_t slot) const {
+  return baseAddr + 2u * SAMPLE_BANK_SECTOR + (uint32_t)slot * SAMPLE_BANK_SLOT_BYTES;
+}
+
+bool SampleBank::prepareSector(uint32_t addr) {
+  // Reading is cheap next to an erase, and most of a fresh or short-take
+  // slot is blank already.
+  const uint32_t* p = (const uint32_t*)(window + (addr - baseAddr));
+  uint32_t i = 0;
+  while (i < SAMPLE_BANK_SECTOR / 4u && p[i] == 0xFFFFFFFFu) ++i;
+  if (i == SAMPLE_BANK_SECTOR / 4u) return true;
+  beginFlashOp();
+  bool ok = flash.eraseSector(addr / SAMPLE_BANK_SECTOR);
+  endFlashOp();
+  return ok;
+}
+
+void SampleBank::resetHeader() {
+  memset(&header, 0, sizeof(header));
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.rows = 4;
+  header.slotBytes = SAMPLE_BANK_SLOT_BYTES;
+  for (uint8_t r = 0; r < 4; ++r) header.slot[r] = r;
+}
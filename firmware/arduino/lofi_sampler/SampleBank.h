@@ -0,0 +1,103 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+
+// SampleBank is the zero-copy playback path. It owns a contiguous region at
+// the top of QSPI flash (outside LittleFS): two header sectors holding the
+// slice table in turn, then one fixed-size slot per row holding the whole
+// take plus a spare. The QSPI controller maps that region into the address
+// space, so a banked slice is just a pointer the ISR can read — no LittleFS,
+// no copy into vbuf.
+//
+// A take is written into the spare and published by swapping it with the
+// row's slot, so the old take stays intact until the new table lands. The
+// spare and the idle header sector are erased ahead of time by service(),
+// which leaves a commit nothing to do but program pages.
+//
+// Flash can't be read while it programs or erases, so every write (ours and
+// Storage's) is bracketed with beginFlashOp()/endFlashOp(); the ISR holds
+// banked voices in place while busy() is true.
+class SampleBank {
+public:
+  struct Slice {
+    const int16_t* data;
+    uint32_t samples;
+  };
+
+  // Locate the region, load and validate the header table, arm XIP.
+  // Call after Storage::begin() has brought the flash up.
+  bool begin();
+  bool ready() const { return mapped; }
+
+  // Copy a sliced take into the row's slot and publish its slice table.
+  bool writeRow(uint8_t row, const int16_t* samples, uint32_t count,
+                const uint32_t* sliceStart, const uint32_t* sliceLen);
+  // writeRow() in pieces, for a commit spread over loop passes: beginRow()
+  // starts a take in the spare, writeRowChunk() programs it in order (erasing
+  // inline only past what service() got to), publishRow() swaps it in.
+  bool beginRow(uint8_t row);
+  bool writeRowChunk(uint8_t row, uint32_t offsetSamples, const int16_t* samples, uint32_t count);
+  bool publishRow(uint8_t row, uint32_t count, const uint32_t* sliceStart, const uint32_t* sliceLen);
+  static constexpr uint32_t SLOT_SAMPLES = SAMPLE_BANK_SLOT_BYTES / 2u;
+  // Unpublish a row (the slot itself is left for the next writeRow); also
+  // drops a take begun for it.
+  void clearRow(uint8_t row);
+  // Re-cut a published row without touching its slot (one header write).
+  bool setSlices(uint8_t row, const uint32_t* sliceStart, const uint32_t* sliceLen);
+
+  // Resolve a "/A/A3.raw" style slice path to its mapped samples.
+  bool lookup(const char* path, Slice& out) const;
+  bool slice(uint8_t row, uint8_t idx, Slice& out) const;
+
+  // Erase one sector of the next take's spare (or the idle header sector)
+  // if it isn't blank already. Blocks for the erase, ~45 ms on the board,
+  // so only call it when no voice reads the bank. False once all is ready.
+  bool service();
+
+  bool busy() const { return busyDepth != 0; }
+  void beginFlashOp();
+  void endFlashOp();
+
+private:
+  static constexpr uint32_t MAGIC   = 0x4B4E4253u; // "SBNK"
+  static constexpr uint16_t VERSION = 2;
+  static constexpr uint8_t SLOTS    = 5;     // one per row plus the spare
+  static constexpr uint8_t NO_ROW   = 0xFF;
+
+  struct RowEntry {
+    uint32_t samples;
+    uint32_t sliceStart[8];
+    uint32_t sliceLen[8];
+  };
+
+  struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rows;
+    uint32_t slotBytes;
+    uint32_t seq;                    // the newer of the two copies wins
+    uint8_t slot[4];                 // row -> slot; the missing one is spare
+    RowEntry row[4];
+    uint32_t crc;
+  };
+
+  bool writeHeader();
+  static uint32_t headerCrc(const Header& h);
+  static bool headerValid(const Header& h);
+  uint32_t headerAddr(uint8_t copy) const;
+  uint32_t slotAddr(uint8_t slot) const;
+  bool prepareSector(uint32_t addr);
+  void resetHeader();
+
+  Header header;
+  uint8_t live = 0;                  // header sector holding `header`
+  bool headerErased = false;         // the other one is blank
+  uint8_t spare = 4;
+  uint32_t spareWritten = 0;         // bytes of the take in the spare
+  uint32_t spareErased = 0;          // [spareWritten, spareErased) is blank
+  uint8_t writingRow = NO_ROW;
+  uint32_t baseAddr = 0;             // flash offset of the bank
+  const uint8_t* window = nullptr;   // bank start inside the XIP window
+  bool mapped = false;
+  volatile uint8_t busyDepth = 0;
+};
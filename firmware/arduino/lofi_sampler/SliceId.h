@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+
+// A slice by position rather than by path: row * 8 + slice, 0..31, the
+// same numbering Storage keeps its resident heads under. Cheap to copy and
+// compare, so the engine and the step code never format or copy paths;
+// slicePath() turns one back into "/B/B3.raw" from a fixed table wherever
+// a file really has to be opened.
+typedef uint8_t SliceId;
+
+static const uint8_t SLICE_IDS = ROW_COUNT * 8;
+static const SliceId NO_SLICE  = 0xFF;
+
+inline SliceId sliceId(uint8_t row, uint8_t slice) { return (SliceId)(row * 8u + slice); }
+inline uint8_t sliceRow(SliceId id) { return id >> 3; }
+inline uint8_t sliceIndex(SliceId id) { return id & 7u; }
+inline bool    sliceValid(SliceId id) { return id < SLICE_IDS; }
+
+// "/A/A1.raw" .. "/D/D8.raw"; nullptr for anything else. Defined in
+// Storage.cpp.
+const char* slicePath(SliceId id);
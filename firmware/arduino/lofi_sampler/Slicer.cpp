@@ -2,10 +2,18 @@
 #include "Slicer.h"
 #include "Storage.h"
 #include "Config.h"
+#include "SampleBank.h"
+#include "OnsetDetector.h"
 #include <Adafruit_LittleFS.h>
 using namespace Adafruit_LittleFS_Namespace;
 
 extern Storage storage;
+extern SampleBank sampleBank;
+
+static Slicer::CutMode mode = SLICE_AT_ONSETS ? Slicer::CutMode::Onsets : Slicer::CutMode::Equal;
+
+void Slicer::setCutMode(CutMode m) { mode = m; }
+Slicer::CutMode Slicer::cutMode() { return mode; }
 
 static String makePath(char row, uint8_t idx) {
   String p = "/";
@@ -17,32 +25,57 @@ static String makePath(char row, uint8_t idx) {
   return p;
 }
 
-bool Slicer::writeEight(const char* rowLetter, const int16_t* samples, uint32_t count) {
+// Eight equal cuts of count samples; the last one takes the remainder.
+static void equalCuts(uint32_t count, uint32_t* sliceStart, uint32_t* sliceLen) {
+  uint32_t seg = count / 8;
+  for (uint8_t i=0; i<8; i++) {
+    sliceStart[i] = seg * i;
+    sliceLen[i] = (i == 7) ? count - seg * 7 : seg;
+  }
+}
+
+void Slicer::cuts(uint32_t count, const OnsetDetector* onsets, uint32_t* sliceStart, uint32_t* sliceLen) {
+  if (mode == CutMode::Onsets && onsets) {
+    onsets->cuts(count, sliceStart, sliceLen);
+  } else {
+    equalCuts(count, sliceStart, sliceLen);
+  }
+}
+
+bool Slicer::writeEight(const char* rowLetter, const int16_t* samples, uint32_t count, const OnsetDetector* onsets) {
   if (!rowLetter || !rowLetter[0]) return false;
   if (!samples) return false;
   char row = rowLetter[0];
-  // Base slice length; the final segment scoops up any remainder so nothing is lost.
-  uint32_t seg = count / 8;
-  uint32_t remainder = count - (seg * 8);
-  uint32_t offset = 0;
+  // Any voice still streaming this row's old slices must reopen them.
+  storage.invalidateRow(row);
+  String src = String("/") + row + "/source.raw";
+  uint32_t sliceStart[8];
+  uint32_t sliceLen[8];
+  OnsetDetector local;
+  if (mode == CutMode::Onsets && !onsets) {
+    local.push(samples, count);
+    onsets = &local;
+  }
+  cuts(count, onsets, sliceStart, sliceLen);
+#if VIRTUAL_SLICES
+  // One write of the take; the slices are just its table.
+  // Files from a materialized cut are dead weight once the table exists;
+  // free the flash.
+  for (uint8_t i=0; i<8; i++) {
+    storage.remove(makePath(row, i+1).c_str());
+  }
+  if (!storage.writeSource(src.c_str(), samples, count)) return false;
+  if (!storage.writeSliceTable(row, sliceStart, sliceLen, count)) return false;
+#else
+  storage.clearSliceTable(row);
+  // The cuts tile the take; the final slice scoops up any remainder so nothing is lost.
   uint32_t totalWritten = 0;
   for (uint8_t i=0; i<8; i++) {
     String path = makePath(row, i+1);
-    uint32_t segLen = seg;
-    if (i == 7) {
-      segLen += remainder;
-    }
-    if (offset >= count) {
-      segLen = 0;
-    } else if (segLen > (count - offset)) {
-      segLen = count - offset;
-    }
-    const int16_t* start = samples + offset;
-    if (!storage.writeRaw(path.c_str(), start, segLen)) {
+    if (!storage.writeSlice(path.c_str(), samples + sliceStart[i], sliceLen[i])) {
       return false;
     }
-    offset += segLen;
-    totalWritten += segLen;
+    totalWritten += sliceLen[i];
   }
 #ifdef SLICER_DEBUG_TRACE
   Serial.print(F("Slicer wrote "));
@@ -56,7 +89,13 @@ bool Slicer::writeEight(const char* rowLetter, const int16_t* samples, uint32_t
   Serial.println();
 #endif
   // also write source.raw
-  String src = String("/") + row + "/source.raw";
   storage.writeRaw(src.c_str(), samples, count);
+#endif
+  // Mirror the take into the XIP bank so playback can skip LittleFS. The
+  // files above stay authoritative; a failed bank write just means this row
+  // streams from the filesystem.
+  if (sampleBank.ready()) {
+    sampleBank.writeRow((uint8_t)(row - 'A'), samples, count, sliceStart, sliceLen);
+  }
   return true;
 }
@@ -2,7 +2,29 @@
 #pragma once
 #include <Arduino.h>
 
+class OnsetDetector;
+
 namespace Slicer {
-  // Slice 'samples' into 8 equal segments and write to /<Row>/<Row>1.raw..8.raw
-  bool writeEight(const char* rowLetter, const int16_t* samples, uint32_t count);
+  // Where the 8 cuts go: the take's strongest onsets (SLICE_AT_ONSETS), or
+  // equal eighths.
+  enum class CutMode : uint8_t {
+    Equal,
+    Onsets,
+  };
+  void setCutMode(CutMode m);
+  CutMode cutMode();
+  // The 8 cuts of a count-sample take in the current mode; equal eighths
+  // without a detector.
+  void cuts(uint32_t count, const OnsetDetector* onsets, uint32_t* sliceStart, uint32_t* sliceLen);
+
+  // Slice 'samples' into 8 segments. With VIRTUAL_SLICES the take is
+  // written once as /<Row>/source.raw (in Storage's source format) plus a
+  // slice table; otherwise each segment goes to /<Row>/<Row>1.raw..8.raw in
+  // the slice format, next to a PCM source.raw. Pass the recorder's
+  // detector to use the onsets it found while capturing; without one,
+  // Onsets mode makes its own pass over the samples.
+  bool writeEight(const char* rowLetter, const int16_t* samples, uint32_t count,
+                  const OnsetDetector* onsets = nullptr);
+  // Takes already on flash and reslices are cut by CommitJob, through
+  // cuts() above.
 }
@@ -1,78 +1,360 @@
 
 #include "Storage.h"
 #include "Config.h"
+#include "FlashFS.h"
+#include "SampleBank.h"
+#include "Telemetry.h"
 #include <Adafruit_SPIFlash.h>
 #include <Adafruit_LittleFS.h>
 using namespace Adafruit_LittleFS_Namespace;
 
 Adafruit_FlashTransport_QSPI flashTransport;
 Adafruit_SPIFlash flash(&flashTransport);
-LittleFS_QSPIFlash lfs(flash);
+FlashFS lfs(flash);
 
 bool Storage::begin() {
   if (!flash.begin()) {
     return false;
   }
+  closeStreams();
+  for (uint8_t i = 0; i < SLICE_HEADS; ++i) heads[i].valid = false;
+  contentGen++;
   if (!lfs.begin()) {
-    // try to format
+    // Only a blank (or foreign) drive gets formatted; one with a LittleFS
+    // superblock holds someone's kits.
+    if (lfs.formatted()) return false;
     if (!lfs.format()) return false;
     if (!lfs.begin()) return false;
   }
   mounted = true;
   ensureTree();
+  loadSliceTables();
   return true;
 }
 
 int32_t Storage::readRawInto(const char* path, int16_t* dst, uint32_t maxSamples) {
+  int8_t slot = sliceSlot(path);
+  if (slot >= 0 && tables[slot / 8].valid) {
+    return readStreamInto(path, dst, maxSamples);
+  }
   File f = lfs.open(path, FILE_O_READ);
   if (!f) return -1;
+  if (probeAdpcm(f) >= 0) {
+    // Compressed: go through the stream decoder instead.
+    f.close();
+    return readStreamInto(path, dst, maxSamples);
+  }
   // bytes to samples
   uint32_t avail = f.size() / 2;
   if (avail > maxSamples) avail = maxSamples;
-  int32_t nread = f.read((uint8_t*)dst, avail*2);
+  // File::read takes a 16-bit byte count, so a full capture has to be pulled
+  // in pieces or the length silently wraps.
+  uint8_t* out = (uint8_t*)dst;
+  uint32_t want = avail * 2u;
+  uint32_t nread = 0;
+  while (nread < want) {
+    uint32_t piece = want - nread;
+    if (piece > 32768u) piece = 32768u;
+    int got = f.read(out + nread, (uint16_t)piece);
+    if (got <= 0) break;
+    nread += (uint32_t)got;
+  }
   f.close();
-  return nread/2;
+  return (int32_t)(nread / 2);
+}
+
+int32_t Storage::readStreamInto(const char* path, int16_t* dst, uint32_t maxSamples) {
+  uint32_t total = 0;
+  while (total < maxSamples) {
+    int32_t got = readRawChunk(path, total, dst + total, maxSamples - total);
+    if (got <= 0) break;
+    total += (uint32_t)got;
+  }
+  return (int32_t)total;
 }
 
 int32_t Storage::readRawChunk(const char* path, uint32_t offsetSamples, int16_t* dst, uint32_t maxSamples) {
-  File f = lfs.open(path, FILE_O_READ);
-  if (!f) return -1;
-  uint32_t totalSamples = f.size() / 2;
+  TELEMETRY_SCOPE(ReadChunk);
+  StreamHandle* h = acquireStream(path);
+  if (!h) return -1;
+  uint32_t totalSamples = h->sizeSamples;
   if (offsetSamples >= totalSamples) {
-    f.close();
     return 0;
   }
   uint32_t remaining = totalSamples - offsetSamples;
   if (remaining > maxSamples) remaining = maxSamples;
-  if (!f.seek(offsetSamples * 2u)) {
-    f.close();
-    return -1;
+  // Where that is in the file (virtual slices start partway into source.raw).
+  uint32_t at = h->base + offsetSamples;
+  if (h->adpcm) {
+    int32_t got = readAdpcm(*h, at, dst, remaining);
+    if (got < 0) {
+      releaseStream(*h);
+      return -1;
+    }
+    if (offsetSamples == 0 && got > 0) {
+      int8_t slot = sliceSlot(path);
+      if (slot >= 0 && !heads[slot].valid) {
+        storeHead(slot, dst, (uint32_t)got, totalSamples);
+      }
+    }
+    return got;
+  }
+  // Voices stream front to back, so the seek is usually skipped entirely.
+  if (h->posSamples != at) {
+    if (!h->file.seek(at * 2u)) {
+      releaseStream(*h);
+      return -1;
+    }
+    h->posSamples = at;
   }
   // AudioEngine pulls in bite-sized chunks; keep it tight and synchronous.
-  int32_t nread = f.read((uint8_t*)dst, remaining * 2u);
-  f.close();
+  // File::read takes a 16-bit byte count, so a bigger ask (readStreamInto)
+  // gets 32 KiB and comes back for the rest.
+  if (remaining > 16384u) remaining = 16384u;
+  int32_t nread = h->file.read((uint8_t*)dst, (uint16_t)(remaining * 2u));
+  if (nread < 0) {
+    releaseStream(*h);
+    return -1;
+  }
+  h->posSamples += (uint32_t)nread / 2u;
+  if (offsetSamples == 0 && nread > 0) {
+    // First chunk of a slice we haven't cached yet: keep its head.
+    int8_t slot = sliceSlot(path);
+    if (slot >= 0 && !heads[slot].valid) {
+      storeHead(slot, dst, (uint32_t)nread / 2u, totalSamples);
+    }
+  }
   return nread / 2;
 }
 
 int32_t Storage::rawSampleCount(const char* path) {
-  File f = lfs.open(path, FILE_O_READ);
-  if (!f) return -1;
-  int32_t samples = f.size() / 2;
-  f.close();
-  return samples;
+  int8_t slot = sliceSlot(path);
+  if (slot >= 0 && heads[slot].valid) {
+    return (int32_t)heads[slot].total;
+  }
+  // Goes through the stream cache so the preload's size probe leaves the
+  // handle open for the chunks that follow.
+  StreamHandle* h = acquireStream(path);
+  if (!h) return -1;
+  return (int32_t)h->sizeSamples;
 }
 
 bool Storage::writeRaw(const char* path, const int16_t* src, uint32_t samples) {
+  invalidatePath(path);
+  if (bank) bank->beginFlashOp();
   File f = lfs.open(path, FILE_O_WRITE | FILE_O_TRUNCATE | FILE_O_CREAT);
-  if (!f) return false;
+  if (!f) {
+    if (bank) bank->endFlashOp();
+    return false;
+  }
   uint32_t bytes = samples * 2;
   uint32_t wr = f.write((const uint8_t*)src, bytes);
   f.close();
+  if (bank) bank->endFlashOp();
+  if (wr != bytes) return false;
+  // The data is already in RAM; no need to read the head back.
+  int8_t slot = sliceSlot(path);
+  if (slot >= 0) storeHead(slot, src, samples, samples);
+  return true;
+}
+
+bool Storage::writeSlice(const char* path, const int16_t* src, uint32_t samples) {
+  if (sliceFormat == SliceFormat::Adpcm) return writeAdpcm(path, src, samples);
+  return writeRaw(path, src, samples);
+}
+
+bool Storage::writeAdpcm(const char* path, const int16_t* src, uint32_t samples) {
+  invalidatePath(path);
+  if (bank) bank->beginFlashOp();
+  File f = lfs.open(path, FILE_O_WRITE | FILE_O_TRUNCATE | FILE_O_CREAT);
+  if (!f) {
+    if (bank) bank->endFlashOp();
+    return false;
+  }
+  uint8_t block[ImaAdpcm::BLOCK_BYTES];
+  ImaAdpcm::writeFileHeader(block, samples);
+  bool ok = f.write(block, ImaAdpcm::FILE_HEADER_BYTES) == ImaAdpcm::FILE_HEADER_BYTES;
+  // The head cache has to hold what a read will decode, not the source.
+  int16_t head[ImaAdpcm::SAMPLES_PER_BLOCK];
+  ImaAdpcm::State st;
+  for (uint32_t off = 0; ok && off < samples; off += ImaAdpcm::SAMPLES_PER_BLOCK) {
+    uint32_t n = samples - off;
+    if (n > ImaAdpcm::SAMPLES_PER_BLOCK) n = ImaAdpcm::SAMPLES_PER_BLOCK;
+    ImaAdpcm::encodeBlock(st, src + off, n, block, off == 0 ? head : nullptr);
+    ok = f.write(block, ImaAdpcm::BLOCK_BYTES) == ImaAdpcm::BLOCK_BYTES;
+  }
+  f.close();
+  if (bank) bank->endFlashOp();
+  if (!ok) return false;
+  int8_t slot = sliceSlot(path);
+  if (slot >= 0) storeHead(slot, head, samples, samples);
+  return true;
+}
+
+bool Storage::writeSource(const char* path, const int16_t* src, uint32_t samples) {
+  if (sourceFormat() == SliceFormat::Adpcm) return writeAdpcm(path, src, samples);
+  return writeRaw(path, src, samples);
+}
+
+bool Storage::beginAppend(const char* path, SliceFormat format) {
+  endAppend();
+  invalidatePath(path);
+  if (bank) bank->beginFlashOp();
+  appendFile = lfs.open(path, FILE_O_WRITE | FILE_O_TRUNCATE | FILE_O_CREAT);
+  appending = (bool)appendFile;
+  appendAdpcm = appending && format == SliceFormat::Adpcm;
+  appendPending = 0;
+  appendTotal = 0;
+  appendState = ImaAdpcm::State();
+  if (appendAdpcm) {
+    // Placeholder; endAppend() writes the real count.
+    uint8_t hdr[ImaAdpcm::FILE_HEADER_BYTES];
+    ImaAdpcm::writeFileHeader(hdr, 0);
+    appending = appendFile.write(hdr, sizeof(hdr)) == sizeof(hdr);
+  }
+  if (bank) bank->endFlashOp();
+  return appending;
+}
+
+bool Storage::append(const int16_t* src, uint32_t samples) {
+  if (!appending) return false;
+  if (appendAdpcm) {
+    while (samples) {
+      uint32_t n = ImaAdpcm::SAMPLES_PER_BLOCK - appendPending;
+      if (n > samples) n = samples;
+      memcpy(appendPcm + appendPending, src, n * sizeof(int16_t));
+      appendPending += n;
+      appendTotal += n;
+      src += n;
+      samples -= n;
+      if (appendPending == ImaAdpcm::SAMPLES_PER_BLOCK && !flushAppendBlock()) return false;
+    }
+    return true;
+  }
+  uint32_t bytes = samples * 2u;
+  if (bank) bank->beginFlashOp();
+  uint32_t wr = appendFile.write((const uint8_t*)src, bytes);
+  if (bank) bank->endFlashOp();
+  appendTotal += samples;
   return wr == bytes;
 }
 
+bool Storage::flushAppendBlock() {
+  uint8_t block[ImaAdpcm::BLOCK_BYTES];
+  ImaAdpcm::encodeBlock(appendState, appendPcm, appendPending, block);
+  appendPending = 0;
+  if (bank) bank->beginFlashOp();
+  bool ok = appendFile.write(block, sizeof(block)) == sizeof(block);
+  if (bank) bank->endFlashOp();
+  return ok;
+}
+
+void Storage::endAppend() {
+  if (!appending) return;
+  if (appendAdpcm) {
+    if (appendPending) flushAppendBlock();
+    uint8_t hdr[ImaAdpcm::FILE_HEADER_BYTES];
+    ImaAdpcm::writeFileHeader(hdr, appendTotal);
+    if (bank) bank->beginFlashOp();
+    if (appendFile.seek(0)) appendFile.write(hdr, sizeof(hdr));
+    if (bank) bank->endFlashOp();
+  }
+  if (bank) bank->beginFlashOp();
+  appendFile.close();
+  if (bank) bank->endFlashOp();
+  appending = false;
+  // Anything that read the file while it grew saw an older size.
+  contentGen++;
+}
+
+int32_t Storage::probeAdpcm(File& f) {
+  uint32_t size = f.size();
+  // Cheap size test first so PCM files rarely pay for the header read.
+  if (size >= ImaAdpcm::FILE_HEADER_BYTES &&
+      (size - ImaAdpcm::FILE_HEADER_BYTES) % ImaAdpcm::BLOCK_BYTES == 0) {
+    uint8_t hdr[ImaAdpcm::FILE_HEADER_BYTES];
+    if (f.read(hdr, sizeof(hdr)) == (int)sizeof(hdr)) {
+      int32_t total = ImaAdpcm::parseFileHeader(hdr, size);
+      if (total >= 0) return total;
+    }
+    f.seek(0);
+  }
+  return -1;
+}
+
+int32_t Storage::readAdpcm(StreamHandle& h, uint32_t offsetSamples, int16_t* dst, uint32_t samples) {
+  const uint32_t spb = ImaAdpcm::SAMPLES_PER_BLOCK;
+  if (h.posSamples != offsetSamples) {
+    // Blocks restart the predictor, so jump to the one holding the offset
+    // and decode forward from its header.
+    uint32_t block = offsetSamples / spb;
+    if (!h.file.seek(ImaAdpcm::FILE_HEADER_BYTES + block * ImaAdpcm::BLOCK_BYTES)) return -1;
+    h.posSamples = block * spb;
+    h.haveCarry = false;
+    int16_t skip[64];
+    while (h.posSamples < offsetSamples) {
+      uint32_t n = offsetSamples - h.posSamples;
+      if (n > 64u) n = 64u;
+      if (readAdpcm(h, h.posSamples, skip, n) != (int32_t)n) return -1;
+    }
+  }
+  uint32_t done = 0;
+  uint8_t bytes[64];
+  while (done < samples) {
+    uint32_t k = h.posSamples % spb;
+    if (k == 0) {
+      uint8_t hdr[ImaAdpcm::BLOCK_HEADER_BYTES];
+      if (h.file.read(hdr, sizeof(hdr)) != (int)sizeof(hdr)) return -1;
+      dst[done++] = ImaAdpcm::beginBlock(h.dec, hdr);
+      h.posSamples++;
+      h.haveCarry = false;
+      continue;
+    }
+    if (h.haveCarry) {
+      dst[done++] = ImaAdpcm::decodeNibble(h.dec, h.carry);
+      h.posSamples++;
+      h.haveCarry = false;
+      continue;
+    }
+    // Whole bytes from here to the end of the block (or of the request).
+    uint32_t want = samples - done;
+    if (want > spb - k) want = spb - k;
+    uint32_t nbytes = (want + 1u) / 2u;
+    if (nbytes > sizeof(bytes)) nbytes = sizeof(bytes);
+    if (h.file.read(bytes, (uint16_t)nbytes) != (int)nbytes) return -1;
+    for (uint32_t i = 0; i < nbytes; ++i) {
+      dst[done++] = ImaAdpcm::decodeNibble(h.dec, bytes[i] & 0x0F);
+      h.posSamples++;
+      if (done < samples) {
+        dst[done++] = ImaAdpcm::decodeNibble(h.dec, bytes[i] >> 4);
+        h.posSamples++;
+      } else {
+        h.carry = bytes[i] >> 4;
+        h.haveCarry = true;
+      }
+    }
+  }
+  return (int32_t)done;
+}
+
 void Storage::remove(const char* path) {
+  invalidatePath(path);
+  if (bank) bank->beginFlashOp();
   lfs.remove(path);
+  if (bank) bank->endFlashOp();
+}
+
+bool Storage::service() {
+  if (!mounted) return false;
+  // Traversing and blank checks are flash commands too.
+  if (bank) bank->beginFlashOp();
+  bool more = lfs.service();
+  if (bank) bank->endFlashOp();
+  return more;
+}
+
+bool Storage::overlapsBank() const {
+  return lfs.overlapsBank();
 }
 
 void Storage::ensureTree() {
@@ -81,3 +363,302 @@ void Storage::ensureTree() {
   lfs.mkdir(PATH_C);
   lfs.mkdir(PATH_D);
 }
+
+Storage::StreamHandle* Storage::acquireStream(const char* path) {
+  if (!path || !path[0]) return nullptr;
+  StreamHandle* victim = &streams[0];
+  for (uint8_t i = 0; i < STREAM_HANDLES; ++i) {
+    StreamHandle& h = streams[i];
+    if (h.path[0] && strncmp(h.path, path, MAX_PATH_LEN) == 0) {
+      h.lastUse = ++streamClock;
+      return &h;
+    }
+    // Prefer an empty slot, otherwise evict the least recently used one.
+    if (!h.path[0]) {
+      if (victim->path[0]) victim = &h;
+    } else if (victim->path[0] && h.lastUse < victim->lastUse) {
+      victim = &h;
+    }
+  }
+
+  releaseStream(*victim);
+  // A virtual slice opens its row's source.raw and reads a range of it.
+  int8_t slot = sliceSlot(path);
+  const SliceTable* table = (slot >= 0 && tables[slot / 8].valid) ? &tables[slot / 8] : nullptr;
+  char source[16];
+  if (table) snprintf(source, sizeof(source), "/%c/source.raw", path[1]);
+  File f = lfs.open(table ? source : path, FILE_O_READ);
+  if (!f) return nullptr;
+  victim->file = f;
+  strncpy(victim->path, path, MAX_PATH_LEN - 1);
+  victim->path[MAX_PATH_LEN - 1] = '\0';
+  int32_t adpcmSamples = probeAdpcm(victim->file);
+  victim->adpcm = adpcmSamples >= 0;
+  uint32_t fileSamples = victim->adpcm ? (uint32_t)adpcmSamples : f.size() / 2u;
+  victim->base = 0;
+  victim->sizeSamples = fileSamples;
+  if (table) {
+    uint32_t start = table->start[slot % 8];
+    uint32_t len = table->len[slot % 8];
+    victim->base = start < fileSamples ? start : fileSamples;
+    victim->sizeSamples = (len < fileSamples - victim->base) ? len : fileSamples - victim->base;
+  }
+  victim->posSamples = 0;
+  victim->haveCarry = false;
+  victim->lastUse = ++streamClock;
+  return victim;
+}
+
+void Storage::releaseStream(StreamHandle& h) {
+  if (h.path[0]) {
+    h.file.close();
+  }
+  h.path[0] = '\0';
+  h.base = 0;
+  h.sizeSamples = 0;
+  h.posSamples = 0;
+  h.lastUse = 0;
+  h.adpcm = false;
+  h.haveCarry = false;
+}
+
+void Storage::invalidatePath(const char* path) {
+  if (!path) return;
+  int8_t srcRow = sourceRow(path);
+  if (srcRow >= 0) {
+    // The row's virtual slices read this file; a new take invalidates its
+    // cuts too.
+    dropSliceTable((uint8_t)srcRow);
+    invalidateRow((char)('A' + srcRow));
+  }
+  contentGen++;
+  int8_t slot = sliceSlot(path);
+  if (slot >= 0) heads[slot].valid = false;
+  for (uint8_t i = 0; i < STREAM_HANDLES; ++i) {
+    if (streams[i].path[0] && strncmp(streams[i].path, path, MAX_PATH_LEN) == 0) {
+      releaseStream(streams[i]);
+    }
+  }
+}
+
+void Storage::invalidateRow(char row) {
+  contentGen++;
+  if (row >= 'A' && row <= 'D') {
+    for (uint8_t i = 0; i < 8; ++i) heads[(row - 'A') * 8 + i].valid = false;
+  }
+  // Row files all live under "/<Row>/".
+  for (uint8_t i = 0; i < STREAM_HANDLES; ++i) {
+    const char* p = streams[i].path;
+    if (p[0] == '/' && p[1] == row && p[2] == '/') {
+      releaseStream(streams[i]);
+    }
+  }
+}
+
+void Storage::closeStreams() {
+  for (uint8_t i = 0; i < STREAM_HANDLES; ++i) {
+    releaseStream(streams[i]);
+  }
+}
+
+uint32_t Storage::readSliceHead(const char* path, int16_t* dst, uint32_t maxSamples, uint32_t* total) {
+  int8_t slot = sliceSlot(path);
+  if (slot < 0) return 0;
+  return readSliceHead((SliceId)slot, dst, maxSamples, total);
+}
+
+uint32_t Storage::readSliceHead(SliceId slot, int16_t* dst, uint32_t maxSamples, uint32_t* total) {
+  if (!sliceValid(slot) || !heads[slot].valid || !dst) return 0;
+  const SliceHead& h = heads[slot];
+  uint32_t n = h.samples;
+  if (n > maxSamples) n = maxSamples;
+  memcpy(dst, headData[slot], n * sizeof(int16_t));
+  if (total) *total = h.total;
+  return n;
+}
+
+void Storage::warmSliceHeads() {
+  if (!mounted) return;
+  for (uint8_t slot = 0; slot < SLICE_HEADS; ++slot) {
+    if (heads[slot].valid) continue;
+    char row = (char)('A' + slot / 8);
+    char path[16];
+    snprintf(path, sizeof(path), "/%c/%c%d.raw", row, row, slot % 8 + 1);
+    if (tables[slot / 8].valid) {
+      int16_t head[SLICE_HEAD_SAMPLES];
+      readRawChunk(path, 0, head, SLICE_HEAD_SAMPLES);
+      continue;
+    }
+    File f = lfs.open(path, FILE_O_READ);
+    if (!f) continue;
+    int32_t adpcmSamples = probeAdpcm(f);
+    uint32_t total = adpcmSamples >= 0 ? (uint32_t)adpcmSamples : f.size() / 2u;
+    uint32_t want = (total < SLICE_HEAD_SAMPLES) ? total : SLICE_HEAD_SAMPLES;
+    bool ok;
+    if (adpcmSamples >= 0) {
+      // The head fits in the first block; decode just that.
+      static_assert(SLICE_HEAD_SAMPLES <= ImaAdpcm::SAMPLES_PER_BLOCK, "head spans ADPCM blocks");
+      uint8_t block[ImaAdpcm::BLOCK_BYTES];
+      ok = f.read(block, sizeof(block)) == (int)sizeof(block);
+      if (ok && want > 0) {
+        ImaAdpcm::State st;
+        int16_t* out = headData[slot];
+        out[0] = ImaAdpcm::beginBlock(st, block);
+        const uint8_t* data = block + ImaAdpcm::BLOCK_HEADER_BYTES;
+        for (uint32_t i = 1; i < want; ++i) {
+          uint8_t b = data[(i - 1) >> 1];
+          out[i] = ImaAdpcm::decodeNibble(st, ((i - 1) & 1u) ? (uint8_t)(b >> 4) : (uint8_t)(b & 0x0F));
+        }
+      }
+    } else {
+      ok = f.read((uint8_t*)headData[slot], (uint16_t)(want * 2u)) == (int)(want * 2u);
+    }
+    f.close();
+    if (ok) {
+      heads[slot].samples = (uint16_t)want;
+      heads[slot].total = total;
+      heads[slot].valid = true;
+    }
+  }
+}
+
+static_assert(SLICE_IDS == 32, "slice path table covers rows A..D");
+static const char* const SLICE_PATHS[SLICE_IDS] = {
+  "/A/A1.raw", "/A/A2.raw", "/A/A3.raw", "/A/A4.raw", "/A/A5.raw", "/A/A6.raw", "/A/A7.raw", "/A/A8.raw",
+  "/B/B1.raw", "/B/B2.raw", "/B/B3.raw", "/B/B4.raw", "/B/B5.raw", "/B/B6.raw", "/B/B7.raw", "/B/B8.raw",
+  "/C/C1.raw", "/C/C2.raw", "/C/C3.raw", "/C/C4.raw", "/C/C5.raw", "/C/C6.raw", "/C/C7.raw", "/C/C8.raw",
+  "/D/D1.raw", "/D/D2.raw", "/D/D3.raw", "/D/D4.raw", "/D/D5.raw", "/D/D6.raw", "/D/D7.raw", "/D/D8.raw",
+};
+
+const char* slicePath(SliceId id) {
+  return sliceValid(id) ? SLICE_PATHS[id] : nullptr;
+}
+
+int8_t Storage::sliceSlot(const char* path) {
+  if (!path || path[0] != '/' || path[2] != '/') return -1;
+  char row = path[1];
+  if (row < 'A' || row > 'D' || path[3] != row) return -1;
+  char idx = path[4];
+  if (idx < '1' || idx > '8' || strcmp(path + 5, ".raw") != 0) return -1;
+  return (int8_t)((row - 'A') * 8 + (idx - '1'));
+}
+
+int8_t Storage::sourceRow(const char* path) {
+  if (!path || path[0] != '/' || path[2] != '/') return -1;
+  char row = path[1];
+  if (row < 'A' || row > 'D' || strcmp(path + 3, "source.raw") != 0) return -1;
+  return (int8_t)(row - 'A');
+}
+
+int32_t Storage::sourceSamples(char row) {
+  char path[16];
+  snprintf(path, sizeof(path), "/%c/source.raw", row);
+  File f = lfs.open(path, FILE_O_READ);
+  if (!f) return -1;
+  int32_t adpcmSamples = probeAdpcm(f);
+  int32_t n = adpcmSamples >= 0 ? adpcmSamples : (int32_t)(f.size() / 2u);
+  f.close();
+  return n;
+}
+
+void Storage::loadSliceTables() {
+  for (uint8_t r = 0; r < 4; ++r) {
+    tables[r].valid = false;
+#if VIRTUAL_SLICES
+    char row = (char)('A' + r);
+    char path[16];
+    snprintf(path, sizeof(path), "/%c/slices.tbl", row);
+    File f = lfs.open(path, FILE_O_READ);
+    if (!f) continue;
+    SliceTableFile t;
+    bool ok = f.read((uint8_t*)&t, sizeof(t)) == (int)sizeof(t);
+    f.close();
+    if (!ok || t.magic != TABLE_MAGIC || t.version != TABLE_VERSION || t.slices != 8) continue;
+    // source.raw replaced behind our back (copied over USB, say): the cuts
+    // are for some other take.
+    if (sourceSamples(row) != (int32_t)t.sourceSamples) continue;
+    for (uint8_t i = 0; ok && i < 8; ++i) {
+      ok = t.start[i] <= t.sourceSamples && t.len[i] <= t.sourceSamples - t.start[i];
+    }
+    if (!ok) continue;
+    tables[r].sourceSamples = t.sourceSamples;
+    memcpy(tables[r].start, t.start, sizeof(t.start));
+    memcpy(tables[r].len, t.len, sizeof(t.len));
+    tables[r].valid = true;
+#endif
+  }
+}
+
+bool Storage::writeSliceTable(char row, const uint32_t* start, const uint32_t* len, uint32_t sourceSamples) {
+  if (row < 'A' || row > 'D' || !start || !len) return false;
+  SliceTableFile t;
+  t.magic = TABLE_MAGIC;
+  t.version = TABLE_VERSION;
+  t.slices = 8;
+  t.sourceSamples = sourceSamples;
+  for (uint8_t i = 0; i < 8; ++i) {
+    if (start[i] > sourceSamples || len[i] > sourceSamples - start[i]) return false;
+    t.start[i] = start[i];
+    t.len[i] = len[i];
+  }
+  char path[16];
+  snprintf(path, sizeof(path), "/%c/slices.tbl", row);
+  if (bank) bank->beginFlashOp();
+  File f = lfs.open(path, FILE_O_WRITE | FILE_O_TRUNCATE | FILE_O_CREAT);
+  bool ok = (bool)f;
+  if (ok) {
+    ok = f.write((const uint8_t*)&t, sizeof(t)) == sizeof(t);
+    f.close();
+  }
+  if (bank) bank->endFlashOp();
+  // Old heads and handles describe the old cuts either way.
+  invalidateRow(row);
+  SliceTable& mem = tables[row - 'A'];
+  mem.valid = ok;
+  if (!ok) return false;
+  mem.sourceSamples = sourceSamples;
+  memcpy(mem.start, t.start, sizeof(t.start));
+  memcpy(mem.len, t.len, sizeof(t.len));
+  warmRowHeads(row);
+  return true;
+}
+
+void Storage::clearSliceTable(char row) {
+  if (row < 'A' || row > 'D') return;
+  // Unlike dropSliceTable(), also clears out a table that failed to load.
+  tables[row - 'A'].valid = false;
+  char path[16];
+  snprintf(path, sizeof(path), "/%c/slices.tbl", row);
+  if (bank) bank->beginFlashOp();
+  lfs.remove(path);
+  if (bank) bank->endFlashOp();
+  invalidateRow(row);
+}
+
+void Storage::dropSliceTable(uint8_t row) {
+  if (!tables[row].valid) return;
+  tables[row].valid = false;
+  char path[16];
+  snprintf(path, sizeof(path), "/%c/slices.tbl", 'A' + row);
+  if (bank) bank->beginFlashOp();
+  lfs.remove(path);
+  if (bank) bank->endFlashOp();
+}
+
+void Storage::warmRowHeads(char row) {
+  int16_t head[SLICE_HEAD_SAMPLES];
+  for (uint8_t i = 0; i < 8; ++i) {
+    char path[16];
+    snprintf(path, sizeof(path), "/%c/%c%d.raw", row, row, i + 1);
+    // A cold slice's first chunk lands in its head.
+    readRawChunk(path, 0, head, SLICE_HEAD_SAMPLES);
+  }
+}
+
+void Storage::storeHead(int8_t slot, const int16_t* src, uint32_t samples, uint32_t total) {
+  uint32_t n = (samples < SLICE_HEAD_SAMPLES) ? samples : SLICE_HEAD_SAMPLES;
+  memcpy(headData[slot], src, n * sizeof(int16_t));
+  heads[slot].samples = (uint16_t)n;
+  heads[slot].total = total;
+  heads[slot].valid = true;
+}
@@ -1,30 +1,192 @@
 
 #pragma once
 #include <Arduino.h>
+#include <Adafruit_LittleFS.h>
+#include "Config.h"
+#include "ImaAdpcm.h"
+#include "SliceId.h"
+
+class SampleBank;
 
 class Storage {
 public:
   bool begin();
+  // Writes bracket themselves with the bank's flash-op guard so the ISR
+  // never reads the XIP window mid-program.
+  void attachSampleBank(SampleBank* b) { bank = b; }
+  // Slices are written as 16-bit PCM or IMA ADPCM (see ImaAdpcm.h); reads
+  // tell them apart per file and always hand back PCM.
+  enum class SliceFormat : uint8_t {
+    Pcm,
+    Adpcm,
+  };
+  void setSliceFormat(SliceFormat f) { sliceFormat = f; }
+  SliceFormat getSliceFormat() const { return sliceFormat; }
+  // What source.raw is written as: the slice format when slices are ranges
+  // of it (VIRTUAL_SLICES), PCM otherwise.
+  SliceFormat sourceFormat() const { return VIRTUAL_SLICES ? sliceFormat : SliceFormat::Pcm; }
+
   // Read RAW 16-bit little-endian mono into dst, up to maxSamples.
   // Returns number of samples read.
   int32_t readRawInto(const char* path, int16_t* dst, uint32_t maxSamples);
 
   // Read a portion of a RAW file, starting at offsetSamples, into dst.
-  // Returns number of samples copied, or negative on error.
+  // Returns number of samples copied, or negative on error. ADPCM slices
+  // decode here, seeking to the block that holds offsetSamples.
   int32_t readRawChunk(const char* path, uint32_t offsetSamples, int16_t* dst, uint32_t maxSamples);
+  int32_t readRawChunk(SliceId id, uint32_t offsetSamples, int16_t* dst, uint32_t maxSamples) {
+    return sliceValid(id) ? readRawChunk(slicePath(id), offsetSamples, dst, maxSamples) : -1;
+  }
 
   // Query the total number of 16-bit samples in a RAW file.
   int32_t rawSampleCount(const char* path);
+  int32_t rawSampleCount(SliceId id) { return sliceValid(id) ? rawSampleCount(slicePath(id)) : -1; }
 
   // Write raw buffer to path
   bool writeRaw(const char* path, const int16_t* src, uint32_t samples);
+  // Write a slice in the current slice format.
+  bool writeSlice(const char* path, const int16_t* src, uint32_t samples);
+  // Write a row's source.raw in the source format.
+  bool writeSource(const char* path, const int16_t* src, uint32_t samples);
+
+  // One file at a time can be built up in pieces (the streaming recorder),
+  // in the source format unless told otherwise. beginAppend() truncates; every append() is its
+  // own flash op, so banked voices only pause for one write at a time.
+  bool beginAppend(const char* path) { return beginAppend(path, sourceFormat()); }
+  bool beginAppend(const char* path, SliceFormat format);
+  bool append(const int16_t* src, uint32_t samples);
+  void endAppend();
 
   // Remove a file if exists
   void remove(const char* path);
 
+  // Idle-time upkeep: ready one free LittleFS block so the next writes only
+  // program (see FlashFS). Blocks for an erase; false once there's nothing
+  // left to do.
+  bool service();
+  // The drive predates the bank's reserved region (see FlashFS): leave the
+  // bank off, it would write over files.
+  bool overlapsBank() const;
+
+  // Virtual slices: a row with a slice table (/<Row>/slices.tbl) plays its
+  // slices as ranges of /<Row>/source.raw, so "/A/A3.raw" resolves through
+  // the table and no file of that name is read. Tables load in begin() and
+  // are ignored if source.raw no longer has the length they were cut for.
+  // Writing or removing a row's source.raw drops its table.
+  bool writeSliceTable(char row, const uint32_t* start, const uint32_t* len, uint32_t sourceSamples);
+  void clearSliceTable(char row);
+  bool hasSliceTable(char row) const { return row >= 'A' && row <= 'D' && tables[row - 'A'].valid; }
+  // Fill the heads of a row's slices by streaming their first chunks.
+  void warmRowHeads(char row);
+
   // Ensure row folders exist
   void ensureTree();
 
+  // Streaming reads keep a handful of files open so a voice walking through a
+  // slice reads sequentially instead of paying open/seek/close per chunk.
+  // writeRaw()/remove() drop the handle for their path; callers rewriting a
+  // whole row (Slicer, erase) drop the row up front.
+  void invalidatePath(const char* path);
+  void invalidateRow(char row);
+  void closeStreams();
+
+  // Resident heads of all 32 slices. writeRaw() refreshes a head from the
+  // samples it writes, the first chunk streamed from a cold slice fills it,
+  // and warmSliceHeads() loads the lot at boot. Copies up to maxSamples of
+  // the head into dst and returns how many (0 on a miss); *total gets the
+  // slice length.
+  uint32_t readSliceHead(const char* path, int16_t* dst, uint32_t maxSamples, uint32_t* total);
+  uint32_t readSliceHead(SliceId id, int16_t* dst, uint32_t maxSamples, uint32_t* total);
+  void warmSliceHeads();
+
+  // Bumped whenever a file may have changed; RAM copies of file contents
+  // tagged with an older value are stale.
+  uint32_t generation() const { return contentGen; }
+
 private:
+  static constexpr uint8_t STREAM_HANDLES = VOICE_COUNT + ROW_COUNT; // every voice + a prefetch per row
+  static constexpr uint8_t MAX_PATH_LEN   = 32;
+
+  struct StreamHandle {
+    Adafruit_LittleFS_Namespace::File file;
+    char     path[MAX_PATH_LEN] = {0};
+    uint32_t base = 0;         // first sample of a virtual slice in source.raw
+    uint32_t sizeSamples = 0;
+    uint32_t posSamples = 0;   // where the next sequential read lands, in the file
+    uint32_t lastUse = 0;
+    // ADPCM: decoder state at posSamples, and the high nibble of a byte
+    // whose low half the last read consumed.
+    bool     adpcm = false;
+    bool     haveCarry = false;
+    uint8_t  carry = 0;
+    ImaAdpcm::State dec;
+  };
+
+  StreamHandle* acquireStream(const char* path);
+  void releaseStream(StreamHandle& h);
+  // readRawInto() for anything that needs the stream reader.
+  int32_t readStreamInto(const char* path, int16_t* dst, uint32_t maxSamples);
+  bool flushAppendBlock();
+  int32_t readAdpcm(StreamHandle& h, uint32_t offsetSamples, int16_t* dst, uint32_t samples);
+  bool writeAdpcm(const char* path, const int16_t* src, uint32_t samples);
+  // ADPCM sample count if f is an ADPCM file (left just past its header),
+  // else -1 with f rewound.
+  static int32_t probeAdpcm(Adafruit_LittleFS_Namespace::File& f);
+
+  static constexpr uint8_t SLICE_HEADS = 32;     // rows A..D x slices 1..8
+
+  struct SliceHead {
+    bool     valid = false;
+    uint16_t samples = 0;      // cached, <= SLICE_HEAD_SAMPLES
+    uint32_t total = 0;        // whole slice
+  };
+
+  // "/B/B3.raw" -> 10; -1 for anything that isn't a slice.
+  static int8_t sliceSlot(const char* path);
+  // "/B/source.raw" -> 1; -1 otherwise.
+  static int8_t sourceRow(const char* path);
+
+  struct SliceTable {
+    bool     valid = false;
+    uint32_t sourceSamples = 0;
+    uint32_t start[8] = {};
+    uint32_t len[8] = {};
+  };
+
+  // On flash, /<Row>/slices.tbl.
+  struct SliceTableFile {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slices;
+    uint32_t sourceSamples;
+    uint32_t start[8];
+    uint32_t len[8];
+  };
+  static constexpr uint32_t TABLE_MAGIC   = 0x3154534Cu; // "LST1"
+  static constexpr uint16_t TABLE_VERSION = 1;
+
+  void loadSliceTables();
+  // Sample count of a row's source.raw, -1 if missing.
+  int32_t sourceSamples(char row);
+  void dropSliceTable(uint8_t row);
+  void storeHead(int8_t slot, const int16_t* src, uint32_t samples, uint32_t total);
+
   bool mounted = false;
+  SampleBank* bank = nullptr;
+  StreamHandle streams[STREAM_HANDLES];
+  uint32_t streamClock = 0;
+  SliceHead heads[SLICE_HEADS];
+  int16_t  headData[SLICE_HEADS][SLICE_HEAD_SAMPLES];
+  uint32_t contentGen = 0;
+  Adafruit_LittleFS_Namespace::File appendFile;
+  bool appending = false;
+  // ADPCM appends encode a block at a time; the header's sample count is
+  // patched in by endAppend().
+  bool appendAdpcm = false;
+  uint16_t appendPending = 0;
+  uint32_t appendTotal = 0;
+  ImaAdpcm::State appendState;
+  int16_t appendPcm[ImaAdpcm::SAMPLES_PER_BLOCK];
+  SliceTable tables[4];
+  SliceFormat sliceFormat = SLICE_ADPCM ? SliceFormat::Adpcm : SliceFormat::Pcm;
 };
@@ -0,0 +1,123 @@
+#include "Telemetry.h"
+
+namespace {
+// Ticks in `frames` of audio: the deadlines the probes are held to.
+uint32_t framesToTicks(uint32_t frames) {
+  return (uint32_t)((uint64_t)frames * Telemetry::tickHz() / SAMPLE_RATE_HZ);
+}
+
+uint8_t bucketOf(uint32_t elapsed) {
+  uint32_t v = elapsed >> Telemetry::BUCKET_SHIFT;
+  uint8_t b = 0;
+  while (v && b < Telemetry::BUCKETS - 1) {
+    v >>= 1;
+    b++;
+  }
+  return b;
+}
+
+uint8_t* put16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  return p + 2;
+}
+
+uint8_t* put32(uint8_t* p, uint32_t v) {
+  p = put16(p, (uint16_t)v);
+  return put16(p, (uint16_t)(v >> 16));
+}
+}
+
+Telemetry::Telemetry() {
+  // The mixer has to finish before the DAC needs its output. Anything on the
+  // loop that takes longer than the schedule-ahead window makes the next
+  // step late, and a read slower than even the smallest chunk plays is
+  // losing ground on its voice.
+  budgets[(uint8_t)Probe::Mix]       = framesToTicks(AUDIO_BLOCK_RENDER ? AUDIO_BLOCK_FRAMES : 1);
+  budgets[(uint8_t)Probe::Service]   = framesToTicks(SCHEDULE_AHEAD_FRAMES);
+  budgets[(uint8_t)Probe::Pump]      = framesToTicks(SCHEDULE_AHEAD_FRAMES);
+  budgets[(uint8_t)Probe::ReadChunk] = framesToTicks(STREAM_CHUNK_MIN);
+  budgets[(uint8_t)Probe::UiDraw]    = framesToTicks(SCHEDULE_AHEAD_FRAMES);
+  budgets[(uint8_t)Probe::Loop]      = framesToTicks(SCHEDULE_AHEAD_FRAMES);
+  reset();
+}
+
+void Telemetry::begin() {
+#if !defined(LOFI_HOST_BUILD)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+uint32_t Telemetry::tickHz() {
+#if defined(LOFI_HOST_BUILD)
+  return 1000000000u;
+#else
+  return F_CPU;
+#endif
+}
+
+void Telemetry::reset() {
+  noInterrupts();
+  for (uint8_t p = 0; p < PROBES; ++p) stats[p] = Stat();
+  for (uint8_t c = 0; c < COUNTERS; ++c) counters[c] = 0;
+  interrupts();
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) lowWater[v] = NO_LOW_WATER;
+}
+
+void Telemetry::record(Probe p, uint32_t elapsed) {
+  Stat& s = stats[(uint8_t)p];
+  s.count++;
+  s.total += elapsed;
+  if (elapsed > s.max) s.max = elapsed;
+  if (elapsed > budgets[(uint8_t)p]) s.over++;
+  s.hist[bucketOf(elapsed)]++;
+}
+
+void Telemetry::snapshot(Snapshot& out) const {
+  noInterrupts();
+  memcpy(out.stats, stats, sizeof(stats));
+  for (uint8_t c = 0; c < COUNTERS; ++c) out.counters[c] = counters[c];
+  interrupts();
+  memcpy(out.lowWater, lowWater, sizeof(lowWater));
+}
+
+size_t Telemetry::serialize(uint8_t* out, size_t cap) const {
+  static_assert(DUMP_BYTES <= 0xFFFF, "telemetry frame length is 16-bit");
+  if (cap < DUMP_BYTES) return 0;
+  Snapshot snap;
+  snapshot(snap);
+  // Header, then per probe its budget and stats with the histogram
+  // saturated to 16 bits, the counters, the voices' low-water marks and a
+  // 16-bit sum of every byte before it.
+  uint8_t* p = out;
+  p = put32(p, MAGIC);
+  p = put16(p, (uint16_t)DUMP_BYTES);
+  *p++ = VERSION;
+  *p++ = PROBES;
+  *p++ = COUNTERS;
+  *p++ = VOICE_COUNT;
+  *p++ = BUCKETS;
+  *p++ = BUCKET_SHIFT;
+  p = put32(p, tickHz());
+  p = put32(p, millis());
+  for (uint8_t i = 0; i < PROBES; ++i) {
+    const Stat& s = snap.stats[i];
+    p = put32(p, budgets[i]);
+    p = put32(p, s.count);
+    p = put32(p, s.over);
+    p = put32(p, s.max);
+    p = put32(p, (uint32_t)s.total);
+    p = put32(p, (uint32_t)(s.total >> 32));
+    for (uint8_t b = 0; b < BUCKETS; ++b) {
+      p = put16(p, s.hist[b] > 0xFFFFu ? 0xFFFFu : (uint16_t)s.hist[b]);
+    }
+  }
+  for (uint8_t c = 0; c < COUNTERS; ++c) p = put32(p, snap.counters[c]);
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) p = put16(p, snap.lowWater[v]);
+  uint16_t sum = 0;
+  for (const uint8_t* q = out; q < p; ++q) sum = (uint16_t)(sum + *q);
+  p = put16(p, sum);
+  return (size_t)(p - out);
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+#if defined(LOFI_HOST_BUILD)
+#include <chrono>
+#endif
+
+// Always-on timing and underrun counters, so a set that glitches live says
+// which stage missed its deadline. Each probe keeps a count, a running total,
+// the worst case, a log2 histogram and how often it ran over its budget (the
+// deadline that stage has to meet; see Telemetry.cpp). Ticks are DWT cycles
+// on the board and steady_clock nanoseconds on the host; tickHz() says which.
+//
+// The mixer records from interrupt context and everything else from the
+// loop, each into its own probe or counter, so nothing needs a lock; only
+// snapshot() and reset() mask interrupts, to copy the mixer's half whole.
+//
+// serialize() packs the lot into a DUMP_BYTES little-endian frame ("LTM1");
+// the sketch writes one to Serial on request and tools/telemetry_dump.py
+// decodes it.
+class Telemetry {
+public:
+  enum class Probe : uint8_t {
+    Mix,        // isr() per frame, or render() per block
+    Service,    // AudioEngine::service()
+    Pump,       // AudioEngine::pumpStreams()
+    ReadChunk,  // Storage::readRawChunk()
+    UiDraw,     // TrellisUI::draw()
+    Loop,       // one whole loop() pass
+    Count,
+  };
+
+  enum class Counter : uint8_t {
+    Underruns,       // a streaming voice's ring ran dry under the mixer
+    JobsSuperseded,  // a mailbox rewritten before service() took it
+    EventsFull,      // event list full, applied early
+    ReadFails,       // a stream read failed and the voice gave up
+    StreamsDeferred, // a voice's refill left for the next pass, over budget
+    Count,
+  };
+
+  static constexpr uint8_t PROBES       = (uint8_t)Probe::Count;
+  static constexpr uint8_t COUNTERS     = (uint8_t)Counter::Count;
+  // Bucket 0 is under 2^BUCKET_SHIFT ticks, bucket i under 2^(BUCKET_SHIFT+i);
+  // the last one takes everything longer.
+  static constexpr uint8_t BUCKETS      = 16;
+  static constexpr uint8_t BUCKET_SHIFT = 6;
+  static constexpr uint16_t NO_LOW_WATER = 0xFFFF;
+  static constexpr uint32_t MAGIC   = 0x314D544Cu;  // "LTM1"
+  static constexpr uint8_t  VERSION = 1;
+  static constexpr size_t DUMP_BYTES =
+      20 + PROBES * (24 + 2 * BUCKETS) + COUNTERS * 4 + VOICE_COUNT * 2 + 2;
+
+  struct Stat {
+    uint32_t count = 0;
+    uint32_t over = 0;     // ran past the probe's budget
+    uint32_t max = 0;
+    uint64_t total = 0;
+    uint32_t hist[BUCKETS] = {};
+  };
+
+  struct Snapshot {
+    Stat     stats[PROBES];
+    uint32_t counters[COUNTERS];
+    uint16_t lowWater[VOICE_COUNT];
+  };
+
+  Telemetry();
+
+  // Starts the cycle counter on the board.
+  void begin();
+  void reset();
+
+  static uint32_t ticks();
+  static uint32_t tickHz();
+  // Per-call budget of a probe, in ticks.
+  uint32_t budget(Probe p) const { return budgets[(uint8_t)p]; }
+
+  void record(Probe p, uint32_t elapsed);
+  void count(Counter c) {
+#if TELEMETRY_ENABLED
+    counters[(uint8_t)c] = counters[(uint8_t)c] + 1;
+#else
+    (void)c;
+#endif
+  }
+  // A voice's ring fill just before the loop tops it up.
+  void fill(uint8_t voice, uint32_t samples) {
+#if TELEMETRY_ENABLED
+    if (samples < lowWater[voice]) lowWater[voice] = (uint16_t)samples;
+#else
+    (void)voice; (void)samples;
+#endif
+  }
+
+  void snapshot(Snapshot& out) const;
+  // Writes one frame; returns its length, or 0 if `cap` is too small.
+  size_t serialize(uint8_t* out, size_t cap) const;
+
+  // Times its own lifetime into a probe.
+  class Scope {
+  public:
+    explicit Scope(Probe p) : probe(p), t0(ticks()) {}
+    ~Scope();
+  private:
+    Probe probe;
+    uint32_t t0;
+  };
+
+private:
+  Stat     stats[PROBES];
+  uint32_t budgets[PROBES];
+  volatile uint32_t counters[COUNTERS];
+  uint16_t lowWater[VOICE_COUNT];
+};
+
+// Defined in lofi_sampler.ino (HostGlobals.cpp on the host).
+extern Telemetry telemetry;
+
+inline uint32_t Telemetry::ticks() {
+#if defined(LOFI_HOST_BUILD)
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+  return DWT->CYCCNT;
+#endif
+}
+
+inline Telemetry::Scope::~Scope() { telemetry.record(probe, ticks() - t0); }
+
+#if TELEMETRY_ENABLED
+#define TELEMETRY_SCOPE(probe) Telemetry::Scope telemetryScope_(Telemetry::Probe::probe)
+#define TELEMETRY_COUNT(counter) telemetry.count(Telemetry::Counter::counter)
+#else
+#define TELEMETRY_SCOPE(probe) do {} while (0)
+#define TELEMETRY_COUNT(counter) do {} while (0)
+#endif
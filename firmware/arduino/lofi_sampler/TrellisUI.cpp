@@ -1,12 +1,24 @@
 
 #include "TrellisUI.h"
+#include "Telemetry.h"
 
 bool TrellisUI::begin() {
   trellis.begin();
   trellis.setBrightness(255);
-  for (uint8_t r=0;r<4;r++)
-    for (uint8_t c=0;c<8;c++)
+  for (uint8_t r=0;r<4;r++) {
+    const float level[SHADE_REC] = {BRIGHT_OFF, BRIGHT_ON, BRIGHT_STEP, 0.0f};
+    for (uint8_t s=0;s<SHADE_REC;s++) {
+      float m = level[s];
+      palette[r][s] = trellis.Color(ROW_COLOR[r].r*m, ROW_COLOR[r].g*m, ROW_COLOR[r].b*m);
+    }
+    // red pulse overlay
+    palette[r][SHADE_REC] = trellis.Color(255, 40, 40);
+    for (uint8_t c=0;c<8;c++) {
       setGate(r,c,false);
+      shown[r][c] = SHADE_NONE;
+    }
+  }
+  lastFrameMs = millis() - UI_FRAME_MS;
   draw(255,-1);
   return true;
 }
@@ -15,20 +27,29 @@ void TrellisUI::setGate(uint8_t row, uint8_t col, bool on) {
   gates[row][col] = on;
 }
 
-void TrellisUI::draw(uint8_t step, int recRow) {
+void TrellisUI::draw(uint8_t step, int recRow, int busyRow, uint8_t busyPercent) {
+  uint32_t now = millis();
+  if ((uint32_t)(now - lastFrameMs) < UI_FRAME_MS) return;
+  lastFrameMs = now;
+  TELEMETRY_SCOPE(UiDraw);
+  // Pads lit left to right as a commit gets through its row.
+  uint8_t busyPads = (uint8_t)(((uint16_t)busyPercent * 8 + 50) / 100);
+  bool dirty = false;
   for (uint8_t r=0;r<4;r++) {
     for (uint8_t c=0;c<8;c++) {
-      float m = gates[r][c] ? BRIGHT_ON : BRIGHT_OFF;
-      if (c == step) m = BRIGHT_STEP;
-      uint32_t color = trellis.Color(ROW_COLOR[r].r*m, ROW_COLOR[r].g*m, ROW_COLOR[r].b*m);
-      if (recRow == r) {
-        // red pulse overlay
-        color = trellis.Color(255, 40, 40);
-      }
-      trellis.setPixelColor(c, r, color);
+      uint8_t s = gates[r][c] ? SHADE_ON : SHADE_OFF;
+      if (c == step) s = SHADE_STEP;
+      if (busyRow == r) s = c < busyPads ? SHADE_STEP : SHADE_DARK;
+      if (recRow == r) s = SHADE_REC;
+      if (s == shown[r][c]) continue;
+      shown[r][c] = s;
+      trellis.setPixelColor(c, r, palette[r][s]);
+      dirty = true;
     }
   }
-  trellis.show();
+  // show() clocks out the whole strip with interrupts off; skip it when
+  // nothing moved.
+  if (dirty) trellis.show();
 }
 
 int32_t TrellisUI::pollEvent() {
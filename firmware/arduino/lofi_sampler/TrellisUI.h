@@ -9,11 +9,21 @@ public:
   bool begin();
   void setGate(uint8_t row, uint8_t col, bool on);
   bool getGate(uint8_t row, uint8_t col) const { return gates[row][col]; }
-  void draw(uint8_t step, int recRow); // recRow = -1 if none
+  // recRow / busyRow = -1 if none; busyRow shows busyPercent as a bar.
+  // Cheap to call every pass: at most one frame per UI_FRAME_MS, and the
+  // strip is only pushed when a pad changed.
+  void draw(uint8_t step, int recRow, int busyRow = -1, uint8_t busyPercent = 0);
   // returns -1 if no event; otherwise packed (row<<8) | col | (0x8000 for press)
   int32_t pollEvent();
 
 private:
+  // What a pad shows; indexes the per-row palette built in begin().
+  enum Shade : uint8_t { SHADE_OFF, SHADE_ON, SHADE_STEP, SHADE_DARK, SHADE_REC, SHADES };
+  static const uint8_t SHADE_NONE = 0xFF;  // not pushed yet
+
   Adafruit_NeoTrellisM4 trellis;
   bool gates[4][8] = {{0}};
+  uint32_t palette[4][SHADES] = {};
+  uint8_t shown[4][8];
+  uint32_t lastFrameMs = 0;
 };
@@ -0,0 +1,126 @@
+#include "VoiceFx.h"
+#include <math.h>
+
+namespace {
+inline int16_t toQ(float v, float one) {
+  float q = v * one + 0.5f;
+  if (q > 32767.0f) q = 32767.0f;
+  if (q < 0.0f) q = 0.0f;
+  return (int16_t)q;
+}
+
+inline int32_t clamp16(int32_t v) {
+  if (v < -32767) return -32767;
+  if (v > 32767) return 32767;
+  return v;
+}
+}
+
+VoiceFx::Params VoiceFx::compile(const Settings& s) {
+  Params out;
+  uint8_t bits = s.bits < 1 ? 1 : (s.bits > 16 ? 16 : s.bits);
+  out.crush = (uint8_t)(16 - bits);
+  out.hold = s.hold < 1 ? 1 : (s.hold > HOLD_MAX ? HOLD_MAX : s.hold);
+  out.filter = s.filter;
+  if (s.filter != Filter::Off) {
+    // Zavalishin/Simper trapezoidal SVF: stable right up to Nyquist and
+    // under modulation, unlike the Chamberlin form, and every coefficient
+    // stays under one.
+    float fc = s.cutoffHz;
+    float top = SAMPLE_RATE_HZ * 0.45f;
+    if (fc < CUTOFF_MIN_HZ) fc = CUTOFF_MIN_HZ;
+    if (fc > top) fc = top;
+    float q = s.resonance;
+    if (q < RESONANCE_MIN) q = RESONANCE_MIN;
+    if (q > RESONANCE_MAX) q = RESONANCE_MAX;
+    float g = tanf(3.14159265f * fc / SAMPLE_RATE_HZ);
+    float k = 1.0f / q;
+    float a1 = 1.0f / (1.0f + g * (g + k));
+    out.a1 = toQ(a1, 32768.0f);
+    out.a2 = toQ(g * a1, 32768.0f);
+    out.a3 = toQ(g * g * a1, 32768.0f);
+    out.k = toQ(k, 16384.0f);
+  }
+  if (s.drive > 0.0f) {
+    // The clipper's slope at zero is 1.5, so 2/3 of the drive goes in.
+    float d = s.drive < 1.0f ? 1.0f : (s.drive > DRIVE_MAX ? DRIVE_MAX : s.drive);
+    out.drive = toQ(d * (2.0f / 3.0f), 4096.0f);
+  }
+  return out;
+}
+
+void VoiceFx::reset(const Params& params) {
+  holdLeft = 0;
+  held = 0;
+  ic1 = ic2 = 0;
+  p = Params();
+  set(params);
+}
+
+void VoiceFx::set(const Params& params) {
+  if (params.filter != p.filter) ic1 = ic2 = 0;
+  if (holdLeft > params.hold) holdLeft = params.hold;
+  p = params;
+  active = p.crush || p.hold > 1 || p.filter != Filter::Off || p.drive;
+}
+
+void VoiceFx::process(int32_t* x, uint32_t n) {
+  if (!active) return;
+
+  if (p.hold > 1) {
+    uint8_t left = holdLeft;
+    int32_t h = held;
+    for (uint32_t i = 0; i < n; ++i) {
+      if (left == 0) {
+        h = x[i];
+        left = p.hold;
+      }
+      x[i] = h;
+      left--;
+    }
+    holdLeft = left;
+    held = h;
+  }
+
+  if (p.crush) {
+    int32_t mask = ~((1 << p.crush) - 1);
+    for (uint32_t i = 0; i < n; ++i) x[i] &= mask;
+  }
+
+  if (p.filter != Filter::Off) {
+    // States run past 16 bits at high Q, so the products go through 64 bits
+    // (one SMLAL each on the M4).
+    int32_t s1 = ic1, s2 = ic2;
+    const int64_t a1 = p.a1, a2 = p.a2, a3 = p.a3;
+    const int64_t k = p.k;
+    Filter mode = p.filter;
+    for (uint32_t i = 0; i < n; ++i) {
+      int32_t v3 = x[i] - s2;
+      int32_t v1 = (int32_t)((a1 * s1 + a2 * v3) >> 15);
+      int32_t v2 = s2 + (int32_t)((a2 * s1 + a3 * v3) >> 15);
+      s1 = 2 * v1 - s1;
+      s2 = 2 * v2 - s2;
+      int32_t y;
+      if (mode == Filter::LowPass) {
+        y = v2;
+      } else if (mode == Filter::BandPass) {
+        y = (int32_t)((k * v1) >> 14);
+      } else {
+        y = x[i] - v2 - (int32_t)((k * v1) >> 14);
+      }
+      x[i] = clamp16(y);
+    }
+    ic1 = s1;
+    ic2 = s2;
+  }
+
+  if (p.drive) {
+    // y = 1.5t - 0.5t^3 on the driven input, flat from full scale on.
+    const int32_t d = p.drive;
+    for (uint32_t i = 0; i < n; ++i) {
+      int32_t t = clamp16((x[i] * d) >> 12);
+      int32_t t3 = (((t * t) >> 15) * t) >> 15;
+      x[i] = clamp16((3 * t - t3) >> 1);
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <Arduino.h>
+#include "Config.h"
+
+// One voice's lo-fi chain: sample-and-hold decimation, bit-depth reduction,
+// a state-variable filter and drive into a soft clipper, in that order. The
+// mixer runs it over each run of a voice's samples before the gain, one
+// stage at a time across the whole run, all integer; a stage that's off
+// costs nothing and a voice with everything off skips it entirely.
+//
+// The loop turns Settings into Params (the float math, filter coefficients
+// included) with compile(); the mixer only ever sees Params.
+class VoiceFx {
+public:
+  static constexpr uint8_t  HOLD_MAX       = 32;
+  static constexpr uint16_t CUTOFF_MIN_HZ  = 40;
+  static constexpr float    RESONANCE_MIN  = 0.5f;
+  static constexpr float    RESONANCE_MAX  = 8.0f;
+  static constexpr float    DRIVE_MAX      = 8.0f;
+
+  enum class Filter : uint8_t {
+    Off,
+    LowPass,
+    BandPass,   // normalised to unity at the peak
+    HighPass,
+  };
+
+  struct Settings {
+    uint8_t  bits = 16;          // 1..16 kept
+    uint8_t  hold = 1;           // frames each sample is held, 1..HOLD_MAX
+    Filter   filter = Filter::Off;
+    uint16_t cutoffHz = 2000;    // CUTOFF_MIN_HZ..0.45 * SAMPLE_RATE_HZ
+    float    resonance = 0.707f; // filter Q
+    float    drive = 0.0f;       // 0 off, else small-signal gain 1..DRIVE_MAX
+  };
+
+  // Settings as the mixer runs them.
+  struct Params {
+    uint8_t crush = 0;           // low bits cleared
+    uint8_t hold = 1;
+    Filter  filter = Filter::Off;
+    int16_t a1 = 0, a2 = 0, a3 = 0;  // trapezoidal SVF, Q15
+    int16_t k = 0;               // damping 1/Q, Q14
+    int16_t drive = 0;           // Q12 gain into the clipper, 0 = none
+  };
+
+  static Params compile(const Settings& s);
+
+  // A freshly staged voice: new params, filter and hold state cleared.
+  void reset(const Params& params);
+  // New params on a sounding voice. The filter keeps its state unless its
+  // mode changed, so a cutoff sweep doesn't click.
+  void set(const Params& params);
+  bool on() const { return active; }
+  // In place; the result fits int16.
+  void process(int32_t* x, uint32_t n);
+
+private:
+  Params p;
+  bool    active = false;
+  uint8_t holdLeft = 0;
+  int32_t held = 0;
+  int32_t ic1 = 0, ic2 = 0;      // SVF integrator states
+};
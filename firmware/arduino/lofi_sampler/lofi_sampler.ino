@@ -3,7 +3,11 @@
 #include "Config.h"
 #include "AudioEngine.h"
 #include "Storage.h"
+#include "SampleBank.h"
 #include "Slicer.h"
+#include "CommitJob.h"
+#include "ClockSync.h"
+#include "Telemetry.h"
 #include "RecorderADC.h"
 #include "TrellisUI.h"
 #include "PadInput.h"
@@ -12,18 +16,34 @@
 Adafruit_USBD_MIDI usb_midi;
 AudioEngine audio;
 Storage storage;
+SampleBank sampleBank;
 RecorderADC rec;
 TrellisUI ui;
-
-volatile bool playing = false;
-volatile uint8_t stepIndex = 0;
-volatile uint16_t midiClockCount = 0;
+CommitJob commitJob;
+ClockSync clockSync;
+Telemetry telemetry;
 
 bool gates[4][8] = {{0}}; // rows A..D
 ModifierTracker modifierTracker;
 
 static const float DEFAULT_VOICE_LEVEL = 0.9f;
 static uint32_t stutterReleaseAt[4] = {0,0,0,0};
+// Alt held + a tap of Shift steps a row through these; MIDI pitch bend
+// scales the result and CC MIDI_CC_REVERSE flips it.
+static const float RATE_PRESETS[] = {1.0f, 2.0f, 0.5f, -1.0f};
+static const uint8_t RATE_PRESET_COUNT = sizeof(RATE_PRESETS) / sizeof(RATE_PRESETS[0]);
+static uint8_t rowRatePreset[4] = {0,0,0,0};
+static float rowBend[4] = {1.0f,1.0f,1.0f,1.0f};
+static bool rowReversed[4] = {false,false,false,false};
+// The MIDI_CC_FX_* CCs edit these; playStep() hands an edited one over with
+// the row's next step.
+static VoiceFx::Settings rowFx[4];
+static bool rowFxEdited[4] = {false,false,false,false};
+#if RECORD_STREAM_TO_FLASH
+static int8_t recRow = -1;   // row whose source.raw the take is streaming into
+static bool recStopping = false;  // stopped; the ring is still draining
+static bool recDrained = false;   // all in source.raw, waiting for the commit job
+#endif
 
 // ---------- Helpers ----------
 static const char* rowPath(char row) {
@@ -36,32 +56,101 @@ static const char* rowPath(char row) {
   return PATH_A;
 }
 
-static void playStep() {
-  const char rowL[4] = {'A','B','C','D'};
+// A row whose files are being rewritten (recording into it, or a commit
+// that isn't just a new slice table) sits out: its steps stop it, its
+// prefetches and stutters are skipped. Gates still toggle.
+static bool rowBusy(uint8_t r) {
+#if RECORD_STREAM_TO_FLASH
+  if (recRow == (int8_t)r) return true;
+#endif
+  return commitJob.mutes(r);
+}
+
+// One timestamp for the whole step: every row starts/stops on the frame
+// ClockSync predicted for it.
+static void playStep(uint8_t step, uint32_t at) {
   for (uint8_t r=0; r<4; r++) {
-    if (gates[r][stepIndex]) {
-      char path[16];
-      snprintf(path, sizeof(path), "/%c/%c%d.raw", rowL[r], rowL[r], stepIndex+1);
-      audio.preloadAndPlay(r, path);
+    if (rowFxEdited[r]) {
+      audio.setFx(r, rowFx[r], at);
+      rowFxEdited[r] = false;
+    }
+    if (gates[r][step] && !rowBusy(r)) {
+      audio.preloadAndPlay(r, sliceId(r, step), at);
     } else {
-      audio.stopVoice(r);
+      audio.stopRow(r, at);
     }
   }
 }
 
+// Stage the heads of a step's gated slices ahead of playStep() so they swap
+// in on the step frame without a gap.
+static void prefetchStep(uint8_t step) {
+  for (uint8_t r=0; r<4; r++) {
+    if (!gates[r][step] || rowBusy(r)) continue;
+    audio.prefetch(r, sliceId(r, step));
+  }
+}
+
+// Runs as a commit job; the row keeps playing its old cuts meanwhile
+// (VIRTUAL_SLICES) or sits out until the new slices are written. Not while
+// a take is recording: its commit needs the job when it stops.
 static bool resliceRow(uint8_t row) {
   if (row >= 4) return false;
-  int16_t* scratch = rec.mutableData();
-  if (!scratch) return false;
-  char rowL = "ABCD"[row];
-  char src[16];
-  snprintf(src, sizeof(src), "/%c/source.raw", rowL);
-  int32_t count = storage.readRawInto(src, scratch, MAX_RECORD_SAMPLES);
-  if (count <= 0) {
-    return false;
+#if RECORD_STREAM_TO_FLASH
+  if (recRow >= 0) return false;
+#else
+  if (rec.isRecording()) return false;
+#endif
+  if (!commitJob.beginReslice(row)) return false;
+  if (commitJob.mutes(row)) audio.stopRow(row);
+  return true;
+}
+
+#if RECORD_STREAM_TO_FLASH
+// Move what the recorder has captured into source.raw, a page per write.
+// A stopped take drains the rest within the commit budget.
+static bool flushRecording(bool all) {
+  int16_t page[RECORD_FLUSH_SAMPLES];
+  uint32_t t0 = micros();
+  while (rec.pending() >= RECORD_FLUSH_SAMPLES || (all && rec.pending() > 0)) {
+    uint32_t n = rec.drain(page, RECORD_FLUSH_SAMPLES);
+    if (!storage.append(page, n)) return false;
+    if (all && micros() - t0 >= COMMIT_BUDGET_US) break;
+  }
+  return true;
+}
+
+static void finishRecording() {
+  rec.stop();
+  recStopping = true;
+}
+
+static void serviceRecording() {
+  if (recRow < 0) return;
+  if (!recStopping) {
+    rec.service();
+    // Flash full, or the take ran to MAX_STREAM_RECORD_SECONDS: keep what we have.
+    if (!flushRecording(false) || !rec.isRecording()) {
+      finishRecording();
+    }
+    return;
   }
-  return Slicer::writeEight(&rowL, scratch, (uint32_t)count);
+  if (!recDrained) {
+    // On flash full the rest of the ring is lost.
+    if (flushRecording(true) && rec.pending() > 0) return;
+    storage.endAppend();
+    recDrained = true;
+  }
+  // Cutting it is a commit job; the row stays muted until the table lands.
+  // The take waits (and the row with it) while another job holds it.
+  if (commitJob.busy()) return;
+  // Fails only on an empty source.raw: nothing to cut.
+  commitJob.beginRecorded((uint8_t)recRow, &rec.onsets());
+  recRow = -1;
+  recStopping = false;
+  recDrained = false;
 }
+#endif
 
 static void serviceStutterDecay() {
   uint32_t now = millis();
@@ -74,6 +163,36 @@ static void serviceStutterDecay() {
   }
 }
 
+static void applyRowRate(uint8_t r) {
+  float rate = RATE_PRESETS[rowRatePreset[r]] * rowBend[r];
+  audio.setRate(r, rowReversed[r] ? -rate : rate);
+}
+
+static void editRowFx(uint8_t r, uint8_t cc, uint8_t v) {
+  VoiceFx::Settings& fx = rowFx[r];
+  if (cc == MIDI_CC_FX_BITS) {
+    fx.bits = (uint8_t)(1 + v * 15 / 127);
+  } else if (cc == MIDI_CC_FX_HOLD) {
+    fx.hold = (uint8_t)(1 + v * (VoiceFx::HOLD_MAX - 1) / 127);
+  } else if (cc == MIDI_CC_FX_FILTER) {
+    fx.filter = (VoiceFx::Filter)(v >> 5);
+  } else if (cc == MIDI_CC_FX_CUTOFF) {
+    fx.cutoffHz = (uint16_t)(VoiceFx::CUTOFF_MIN_HZ * powf(2.0f, v * 8.0f / 127.0f));
+  } else if (cc == MIDI_CC_FX_RESONANCE) {
+    fx.resonance = VoiceFx::RESONANCE_MIN * powf(VoiceFx::RESONANCE_MAX / VoiceFx::RESONANCE_MIN, v / 127.0f);
+  } else if (cc == MIDI_CC_FX_DRIVE) {
+    fx.drive = v ? 1.0f + v * (VoiceFx::DRIVE_MAX - 1.0f) / 127.0f : 0.0f;
+  } else {
+    return;
+  }
+  rowFxEdited[r] = true;
+}
+
+static void cycleRowRate(uint8_t r) {
+  rowRatePreset[r] = (uint8_t)((rowRatePreset[r] + 1) % RATE_PRESET_COUNT);
+  applyRowRate(r);
+}
+
 // ---------- Combo actions ----------
 
 // SHIFT+ALT combo: reload the saved source + carve new slices without touching gates.
@@ -81,9 +200,8 @@ static PadActionResult actionReslice(uint8_t row, uint8_t col, const PadModifier
   (void)col;
   if (row >= 4) return PadActionResult::NoMatch;
   if (!mods.alt || !mods.shift) return PadActionResult::NoMatch;
-  if (resliceRow(row)) {
-    return PadActionResult::MatchedStop;
-  }
+  // One commit at a time; a reslice while one runs is dropped.
+  resliceRow(row);
   return PadActionResult::MatchedStop;
 }
 
@@ -93,13 +211,11 @@ static PadActionResult actionStutter(uint8_t row, uint8_t col, const PadModifier
   if (!mods.shift || mods.alt) return PadActionResult::NoMatch;
   if (col >= STEPS_PER_BAR) return PadActionResult::NoMatch;
   if (!gates[row][col]) return PadActionResult::NoMatch; // treat stutter as "riff on an active gate"
-  char rowL = "ABCD"[row];
-  char path[16];
-  snprintf(path, sizeof(path), "/%c/%c%d.raw", rowL, rowL, col + 1);
+  if (rowBusy(row)) return PadActionResult::MatchedStop;
   float velocity = 0.35f + (0.08f * col);
   if (velocity > 1.0f) velocity = 1.0f;
   audio.setLevel(row, velocity);
-  if (audio.preloadAndPlay(row, path)) {
+  if (audio.preloadAndPlay(row, sliceId(row, col))) {
     stutterReleaseAt[row] = millis() + 160;
     return PadActionResult::MatchedStop;
   }
@@ -114,15 +230,33 @@ static PadActionResult actionRecord(uint8_t row, uint8_t col, const PadModifiers
   if (!mods.shift || mods.alt) return PadActionResult::NoMatch;
   // SHIFT press on an "empty" step still arms recording; stutter handlers bail
   // early when they detect an unlit gate, so we get the classic hold-Shift-then-pad flow.
+#if RECORD_STREAM_TO_FLASH
+  // The take streams into the row it started on; any row pad stops it. A
+  // new take waits for the last one's commit to finish.
+  if (recRow < 0) {
+    if (commitJob.busy()) return PadActionResult::MatchedStop;
+    char src[16];
+    snprintf(src, sizeof(src), "/%c/source.raw", "ABCD"[row]);
+    if (storage.beginAppend(src)) {
+      recRow = (int8_t)row;
+      audio.stopRow(row);
+      rec.start();
+    }
+  } else if (!recStopping) {
+    finishRecording();
+  }
+#else
   if (!rec.isRecording()) {
+    // The last take's commit still reads the capture buffer.
+    if (commitJob.busy()) return PadActionResult::MatchedStop;
     rec.start();
   } else {
     uint32_t n = rec.stop();
-    if (n > 0) {
-      char rowL = "ABCD"[row];
-      Slicer::writeEight(&rowL, rec.data(), n);
+    if (n > 0 && commitJob.beginTake(row, rec.data(), n, &rec.onsets())) {
+      audio.stopRow(row);
     }
   }
+#endif
   return PadActionResult::MatchedStop;
 }
 
@@ -131,12 +265,16 @@ static PadActionResult actionErase(uint8_t row, uint8_t col, const PadModifiers&
   if (row >= 4) return PadActionResult::NoMatch;
   if (!mods.alt || mods.shift) return PadActionResult::NoMatch;
   char rowL = "ABCD"[row];
+  if (commitJob.row() == (int8_t)row) commitJob.cancel();
+  storage.invalidateRow(rowL);
+  sampleBank.clearRow(row);
   for (uint8_t i=0;i<8;i++) {
     char path[16]; snprintf(path,sizeof(path),"/%c/%c%d.raw",rowL,rowL,i+1);
     storage.remove(path);
   }
   char src[16]; snprintf(src,sizeof(src),"/%c/source.raw",rowL);
   storage.remove(src);
+  storage.clearSliceTable(rowL);
   return PadActionResult::MatchedStop;
 }
 
@@ -148,35 +286,92 @@ void handleMidi() {
     uint8_t b0 = packet[1];
     // Realtime messages can appear anywhere
     if (b0 == 0xF8) { // Timing Clock
-      if (playing) {
-        midiClockCount++;
-        if (midiClockCount >= CLOCKS_PER_STEP) {
-          midiClockCount = 0;
-          stepIndex = (stepIndex + 1) % STEPS_PER_BAR;
-          playStep();
-        }
-      }
+      clockSync.midiClock(audio.now());
     } else if (b0 == 0xFA) { // Start
-      playing = true;
-      midiClockCount = 0;
-      stepIndex = STEPS_PER_BAR - 1; // so first clock advance goes to step 0
+      clockSync.midiStart();
     } else if (b0 == 0xFB) { // Continue
-      playing = true;
+      clockSync.midiContinue();
     } else if (b0 == 0xFC) { // Stop
-      playing = false;
+      clockSync.midiStop();
+    } else if ((b0 & 0xF0) == 0xE0 && (b0 & 0x0F) < 4) { // Pitch bend, channel 1..4 = row A..D
+      uint8_t r = b0 & 0x0F;
+      int16_t bend = (int16_t)(((uint16_t)packet[3] << 7) | packet[2]) - 8192;
+      rowBend[r] = powf(2.0f, (float)bend * RATE_BEND_SEMITONES / (8192.0f * 12.0f));
+      applyRowRate(r);
+    } else if ((b0 & 0xF0) == 0xB0 && (b0 & 0x0F) < 4) { // CC, channel 1..4 = row A..D
+      uint8_t r = b0 & 0x0F;
+      if (packet[2] == MIDI_CC_REVERSE) {
+        rowReversed[r] = packet[3] >= 64;
+        applyRowRate(r);
+      } else if (packet[2] == MIDI_CC_PAN) {
+        audio.setPan(r, ((float)packet[3] - 64.0f) / 63.0f);
+      } else {
+        editRowFx(r, packet[2], packet[3]);
+      }
     }
   }
 }
 
+// Steps come off the clock's predicted boundaries, not the MIDI bytes
+// themselves, so they're posted ahead and land on their frame.
+static void serviceClock() {
+  static bool hostChecked = false;
+  if (!hostChecked && millis() >= CLOCK_HOST_WAIT_MS) {
+    // Powered, but nobody enumerated us: play on the internal clock.
+    hostChecked = true;
+    if (!TinyUSBDevice.mounted() && !clockSync.playing()) {
+      clockSync.startInternal(audio.now());
+    }
+  }
+  for (;;) {
+    ClockSync::Tick t = clockSync.poll(audio.now());
+    if (t.type == ClockSync::TickType::Prefetch) {
+      prefetchStep(t.step);
+    } else if (t.type == ClockSync::TickType::Step) {
+      playStep(t.step, t.at);
+    } else {
+      break;
+    }
+  }
+}
+
+// 't' on the Serial monitor dumps a telemetry frame, 'T' dumps and clears;
+// tools/telemetry_dump.py reads either.
+static void serviceTelemetry() {
+#if TELEMETRY_ENABLED
+  if (!Serial.available()) return;
+  int c = Serial.read();
+  if (c != 't' && c != 'T') return;
+  static uint8_t frame[Telemetry::DUMP_BYTES];
+  size_t n = telemetry.serialize(frame, sizeof(frame));
+  Serial.write(frame, n);
+  if (c == 'T') telemetry.reset();
+#endif
+}
+
 // ---------- Setup ----------
 void setup() {
+  telemetry.begin();
   usb_midi.setStringDescriptor("NTM4 Sampler");
   usb_midi.begin();
 
   storage.begin();
+  storage.warmSliceHeads();
+#if SAMPLE_BANK_ENABLED
+  // A drive formatted by older firmware spans the whole chip, bank region
+  // included; it runs without the bank until it's reformatted.
+  if (!storage.overlapsBank() && sampleBank.begin()) {
+    storage.attachSampleBank(&sampleBank);
+    audio.attachSampleBank(&sampleBank);
+  }
+#endif
   ui.begin();
   audio.begin();
   audio.attachStorage(&storage);
+  for (uint8_t r=0; r<ROW_COUNT; r++) {
+    audio.setRowMode(r, (ROW_POLY_MASK >> r) & 1 ? AudioEngine::RowMode::Poly
+                                                 : AudioEngine::RowMode::Choke);
+  }
   rec.begin();
 
   modifierTracker.reset();
@@ -191,7 +386,9 @@ void setup() {
 
 // ---------- Loop ----------
 void loop() {
+  TELEMETRY_SCOPE(Loop);
   handleMidi();
+  serviceClock();
 
   // UI input
   int32_t ev = ui.pollEvent();
@@ -210,16 +407,35 @@ void loop() {
       }
     } else {
       modifierTracker.handleRelease(r, c);
+      if (modifierTracker.takeAltShiftTap(r)) cycleRowRate(r);
     }
   }
 
   // Service recorder during record
+#if RECORD_STREAM_TO_FLASH
+  serviceRecording();
+#else
   if (rec.isRecording()) {
     rec.service();
   }
+#endif
 
   serviceStutterDecay();
 
   audio.service();
-  ui.draw(playing ? stepIndex : 255, rec.isRecording() ? 0 : -1);
+  // After the refills, so a commit only spends what's left of the pass.
+  commitJob.service(COMMIT_BUDGET_US);
+#if RECORD_STREAM_TO_FLASH
+  int uiRecRow = recRow;
+#else
+  int uiRecRow = rec.isRecording() ? 0 : -1;
+#endif
+  // Erasing ahead: the bank's next slot, then LittleFS's free blocks, one
+  // erase per pass. An erase stalls every flash read, so only while nothing
+  // plays, records or commits.
+  if (audio.idle() && uiRecRow < 0 && !commitJob.busy()) {
+    if (!sampleBank.service()) storage.service();
+  }
+  ui.draw(clockSync.playing() ? clockSync.step() : 255, uiRecRow, commitJob.row(), commitJob.progress());
+  serviceTelemetry();
 }
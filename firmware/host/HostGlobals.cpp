@@ -0,0 +1,11 @@
+// Globals the sketch normally defines in lofi_sampler.ino. Slicer reaches the
+// filesystem and bank through `extern Storage storage` / `extern SampleBank
+// sampleBank`, and every probe records into `telemetry`, so host tools share
+// these.
+#include "Storage.h"
+#include "SampleBank.h"
+#include "Telemetry.h"
+
+Storage storage;
+SampleBank sampleBank;
+Telemetry telemetry;
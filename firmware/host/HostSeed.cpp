@@ -0,0 +1,23 @@
+#include "HostSeed.h"
+#include <Arduino.h>
+#include "Config.h"
+#include "Slicer.h"
+#include <math.h>
+#include <vector>
+
+void seedRows() {
+  std::vector<int16_t> take(MAX_RECORD_SAMPLES);
+  uint32_t lcg = 0x1234567u;
+  for (uint8_t r = 0; r < 4; ++r) {
+    double hz = 110.0 * (double)(r + 1);
+    for (uint32_t i = 0; i < MAX_RECORD_SAMPLES; ++i) {
+      lcg = lcg * 1664525u + 1013904223u;
+      double env = 1.0 - (double)(i % (MAX_RECORD_SAMPLES / 8)) / (double)(MAX_RECORD_SAMPLES / 8);
+      double s = 12000.0 * env * sin(2.0 * M_PI * hz * (double)i / SAMPLE_RATE_HZ);
+      s += (double)((int32_t)(lcg >> 16) - 32768) / 16.0;
+      take[i] = (int16_t)s;
+    }
+    char row = "ABCD"[r];
+    Slicer::writeEight(&row, take.data(), MAX_RECORD_SAMPLES);
+  }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Deterministic material for host tools: a decaying tone per row over LCG
+// hiss, so slices differ and nothing compresses to silence. Cuts each row
+// into eight through Slicer::writeEight(), so `storage` has to be up (and
+// set to the slice format wanted) first. lofi_bench plays it, and the
+// golden renders are made from it.
+void seedRows();
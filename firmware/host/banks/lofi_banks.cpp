@@ -0,0 +1,457 @@
+// Bank builder: a folder of kits in, a folder of ready-to-copy row sets out.
+//
+// Each kit is a folder of WAVs; sorted by name, the first four become rows
+// A..D. Every WAV is decoded (8/16/24/32-bit PCM or 32/64-bit float, any
+// channel count, any rate), downmixed to mono, resampled to SAMPLE_RATE_HZ,
+// peak-normalised and cut to the longest take the board records. Those
+// steps run on a pool of threads, one row per job. The rows are then cut
+// and written by the sketch's own Slicer::writeEight() into
+// OUT/<kit>/<Row>/ through the LittleFS stand-in, so the files (source.raw
+// + slices.tbl, or A1..A8.raw with VIRTUAL_SLICES 0; ADPCM with --adpcm)
+// and the cut points (onsets with SLICE_AT_ONSETS, unless --equal) are
+// exactly what a recording on the board makes. That part is one kit at a
+// time: Storage and the stand-in are single-threaded, like the board.
+//
+// --image also writes OUT/<kit>/bank.bin, the kit's XIP sample bank region
+// as SampleBank lays it out at the top of QSPI flash, to be programmed at
+// the offset printed. The row sets stay the source of truth on LittleFS.
+//
+// Resampling is a windowed-sinc polyphase filter: the Kaiser-windowed
+// low-pass is tabulated at RESAMPLE_PHASES offsets per input sample, and
+// each output blends the two phases around its exact position. Going down,
+// the cutoff sits just under the new Nyquist.
+//
+// Usage: lofi_banks IN OUT [--jobs N] [--peak DBFS] [--equal] [--adpcm] [--image]
+//   IN is a folder of kit folders, or a single kit folder of WAVs.
+#include "Storage.h"
+#include "SampleBank.h"
+#include "Slicer.h"
+#include "OnsetDetector.h"
+#include "HostSim.h"
+#include <Adafruit_SPIFlash.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+extern Storage storage;
+extern SampleBank sampleBank;
+extern Adafruit_SPIFlash flash;
+
+namespace {
+
+constexpr uint32_t RESAMPLE_PHASES = 256;
+constexpr uint32_t RESAMPLE_ZEROS = 16;     // sinc zero crossings each side
+constexpr double   RESAMPLE_ROLLOFF = 0.92; // cutoff, as a share of Nyquist
+constexpr double   KAISER_BETA = 8.6;       // ≈-90 dB stopband
+
+// The longest take a row can hold, as the recorder would cap it.
+constexpr uint32_t ROW_SAMPLES_MAX = RECORD_STREAM_TO_FLASH ? MAX_STREAM_RECORD_SAMPLES : MAX_RECORD_SAMPLES;
+
+struct Options {
+  const char* in = nullptr;
+  const char* out = nullptr;
+  unsigned jobs = 0;        // 0: one per core
+  double peakDb = -1.0;
+  bool equal = false;
+  bool adpcm = false;
+  bool image = false;
+};
+
+struct Row {
+  std::string wav;          // source file
+  std::string error;        // set if it couldn't be read
+  uint32_t rate = 0;
+  uint16_t channels = 0;
+  double seconds = 0.0;     // before the cap
+  double gainDb = 0.0;
+  bool capped = false;
+  std::vector<int16_t> samples;
+  OnsetDetector onsets;
+};
+
+struct Kit {
+  std::string name;
+  std::vector<Row> rows;    // up to ROW_COUNT, A first
+  std::atomic<uint32_t> pending{0};
+};
+
+// ---------- WAV ----------
+
+uint32_t le(const uint8_t* p, uint8_t bytes) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < bytes; ++i) v |= (uint32_t)p[i] << (8 * i);
+  return v;
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& bytes) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  bytes.clear();
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+// Decodes and downmixes to mono, full scale at ±1.
+bool loadWav(Row& row, std::vector<float>& mono) {
+  std::vector<uint8_t> b;
+  if (!readFile(row.wav, b)) { row.error = "cannot read"; return false; }
+  if (b.size() < 12 || memcmp(b.data(), "RIFF", 4) || memcmp(b.data() + 8, "WAVE", 4)) {
+    row.error = "not a WAV";
+    return false;
+  }
+  uint16_t format = 0, bits = 0, align = 0;
+  const uint8_t* data = nullptr;
+  size_t dataBytes = 0;
+  for (size_t pos = 12; pos + 8 <= b.size();) {
+    uint32_t len = le(&b[pos + 4], 4);
+    const uint8_t* body = &b[pos + 8];
+    size_t avail = std::min<size_t>(len, b.size() - pos - 8);
+    if (!memcmp(&b[pos], "fmt ", 4) && avail >= 16) {
+      format = (uint16_t)le(body, 2);
+      row.channels = (uint16_t)le(body + 2, 2);
+      row.rate = le(body + 4, 4);
+      align = (uint16_t)le(body + 12, 2);
+      bits = (uint16_t)le(body + 14, 2);
+      if (format == 0xFFFE && avail >= 26) format = (uint16_t)le(body + 24, 2); // extensible: subformat
+    } else if (!memcmp(&b[pos], "data", 4)) {
+      data = body;
+      dataBytes = avail;
+    }
+    pos += 8 + (size_t)len + (len & 1u);
+  }
+  bool pcm = format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+  bool flt = format == 3 && (bits == 32 || bits == 64);
+  if (!pcm && !flt) { row.error = "unsupported format " + std::to_string(format) + "/" + std::to_string(bits) + " bit"; return false; }
+  if (!data || !row.channels || !row.rate || align != row.channels * (bits / 8)) {
+    row.error = "malformed";
+    return false;
+  }
+  size_t frames = dataBytes / align;
+  uint8_t width = (uint8_t)(bits / 8);
+  mono.assign(frames, 0.0f);
+  for (size_t i = 0; i < frames; ++i) {
+    double sum = 0.0;
+    for (uint16_t c = 0; c < row.channels; ++c) {
+      const uint8_t* p = data + i * align + c * width;
+      double v;
+      if (flt && bits == 32) {
+        float f;
+        memcpy(&f, p, 4);
+        v = f;
+      } else if (flt) {
+        double d;
+        memcpy(&d, p, 8);
+        v = d;
+      } else if (bits == 8) {
+        v = ((int)p[0] - 128) / 128.0;
+      } else {
+        // Left-justify into 32 bits so the sign lands in place.
+        int32_t s = (int32_t)(le(p, width) << (32 - bits));
+        v = s / 2147483648.0;
+      }
+      sum += v;
+    }
+    mono[i] = (float)(sum / row.channels);
+  }
+  row.seconds = (double)frames / row.rate;
+  return true;
+}
+
+// ---------- Resampler ----------
+
+double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+
+class Resampler {
+public:
+  Resampler(uint32_t inRate, uint32_t outRate) : in(inRate), out(outRate) {
+    double scale = std::min(1.0, (double)out / in);
+    double fc = 0.5 * scale * RESAMPLE_ROLLOFF;           // cycles per input sample
+    double half = RESAMPLE_ZEROS / scale;                 // support each side, input samples
+    taps = 2u * (uint32_t)ceil(half);
+    coef.assign((size_t)(RESAMPLE_PHASES + 1) * taps, 0.0f);
+    double i0b = besselI0(KAISER_BETA);
+    for (uint32_t p = 0; p <= RESAMPLE_PHASES; ++p) {
+      float* c = &coef[(size_t)p * taps];
+      double sum = 0.0;
+      for (uint32_t j = 0; j < taps; ++j) {
+        // Tap j weighs input (i + j - taps/2 + 1) for an output at i + p/PHASES.
+        double t = (double)j - taps / 2 + 1 - (double)p / RESAMPLE_PHASES;
+        double r = t / half;
+        double w = fabs(r) < 1.0 ? besselI0(KAISER_BETA * sqrt(1.0 - r * r)) / i0b : 0.0;
+        double x = 2.0 * fc * t;
+        double h = 2.0 * fc * (fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x)) * w;
+        c[j] = (float)h;
+        sum += h;
+      }
+      // Unity at DC on every phase, so a held level doesn't ripple.
+      for (uint32_t j = 0; j < taps; ++j) c[j] = (float)(c[j] / sum);
+    }
+  }
+
+  std::vector<float> run(const std::vector<float>& x) const {
+    size_t n = (size_t)(((uint64_t)x.size() * out + in - 1) / in);
+    std::vector<float> y(n);
+    const int64_t len = (int64_t)x.size();
+    const int64_t lead = (int64_t)taps / 2 - 1;
+    for (size_t k = 0; k < n; ++k) {
+      uint64_t num = (uint64_t)k * in;
+      int64_t i = (int64_t)(num / out);
+      double pos = (double)(num % out) * RESAMPLE_PHASES / out;
+      uint32_t p = (uint32_t)pos;
+      double a = pos - p;
+      const float* c0 = &coef[(size_t)p * taps];
+      const float* c1 = c0 + taps;
+      double s0 = 0.0, s1 = 0.0;
+      int64_t first = i - lead;
+      uint32_t j0 = first < 0 ? (uint32_t)-first : 0;
+      uint32_t j1 = first + taps > len ? (uint32_t)(len - first) : taps;
+      for (uint32_t j = j0; j < j1; ++j) {
+        float v = x[(size_t)(first + j)];
+        s0 += v * c0[j];
+        s1 += v * c1[j];
+      }
+      y[k] = (float)(s0 + (s1 - s0) * a);
+    }
+    return y;
+  }
+
+private:
+  uint32_t in, out, taps;
+  std::vector<float> coef;  // (PHASES + 1) x taps
+};
+
+// One row's whole conversion; runs on a worker.
+void convert(Row& row, const Options& opt) {
+  std::vector<float> mono;
+  if (!loadWav(row, mono)) return;
+  if (row.rate != SAMPLE_RATE_HZ) mono = Resampler(row.rate, SAMPLE_RATE_HZ).run(mono);
+  if (mono.size() > ROW_SAMPLES_MAX) {
+    mono.resize(ROW_SAMPLES_MAX);
+    row.capped = true;
+  }
+  float peak = 0.0f;
+  for (float v : mono) peak = std::max(peak, fabsf(v));
+  double gain = 1.0;
+  if (peak > 1e-6f) gain = pow(10.0, opt.peakDb / 20.0) / peak;
+  row.gainDb = 20.0 * log10(gain);
+  row.samples.resize(mono.size());
+  for (size_t i = 0; i < mono.size(); ++i) {
+    long s = lrint(mono[i] * gain * 32767.0);
+    row.samples[i] = (int16_t)std::max(-32767L, std::min(32767L, s));
+  }
+  if (Slicer::cutMode() == Slicer::CutMode::Onsets) row.onsets.push(row.samples.data(), (uint32_t)row.samples.size());
+}
+
+// ---------- Folders ----------
+
+bool isDir(const std::string& p) {
+  struct stat st;
+  return stat(p.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool hasWavSuffix(const std::string& n) {
+  if (n.size() < 4) return false;
+  std::string ext = n.substr(n.size() - 4);
+  for (char& ch : ext) ch = (char)tolower((unsigned char)ch);
+  return ext == ".wav";
+}
+
+std::vector<std::string> listDir(const std::string& dir) {
+  std::vector<std::string> names;
+  if (DIR* d = opendir(dir.c_str())) {
+    while (dirent* e = readdir(d)) {
+      if (e->d_name[0] != '.') names.push_back(e->d_name);
+    }
+    closedir(d);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// A kit per subfolder holding WAVs; IN itself if it holds them directly.
+void findKits(const std::string& in, std::deque<Kit>& kits) {
+  auto addKit = [&](const std::string& dir, const std::string& name) {
+    std::vector<std::string> wavs;
+    for (const std::string& n : listDir(dir)) {
+      if (hasWavSuffix(n) && !isDir(dir + "/" + n)) wavs.push_back(dir + "/" + n);
+    }
+    if (wavs.empty()) return;
+    if (wavs.size() > ROW_COUNT) {
+      fprintf(stderr, "lofi_banks: %s has %u WAVs, using the first %u\n", name.c_str(),
+              (unsigned)wavs.size(), (unsigned)ROW_COUNT);
+      wavs.resize(ROW_COUNT);
+    }
+    kits.emplace_back();
+    kits.back().name = name;
+    kits.back().rows.resize(wavs.size());
+    for (size_t r = 0; r < wavs.size(); ++r) kits.back().rows[r].wav = wavs[r];
+  };
+  std::string base = in;
+  while (base.size() > 1 && base.back() == '/') base.pop_back();
+  size_t slash = base.find_last_of('/');
+  addKit(base, slash == std::string::npos ? base : base.substr(slash + 1));
+  if (!kits.empty()) return;
+  for (const std::string& n : listDir(base)) {
+    if (isDir(base + "/" + n)) addKit(base + "/" + n, n);
+  }
+}
+
+// ---------- Output ----------
+
+bool writeBytes(const std::string& path, const uint8_t* p, size_t n) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(p, 1, n, f) == n;
+  return fclose(f) == 0 && ok;
+}
+
+// Writes a converted kit through the sketch's own Slicer and Storage.
+bool writeKit(Kit& kit, const Options& opt) {
+  std::string dir = std::string(opt.out) + "/" + kit.name;
+  if (!HostFS::mountDirectory(dir.c_str())) {
+    fprintf(stderr, "lofi_banks: cannot use %s\n", dir.c_str());
+    return false;
+  }
+  // A fresh, erased flash per kit, so the bank holds only this kit's rows.
+  HostFlash::unmap();
+  if (!storage.begin()) return false;
+  storage.setSliceFormat(opt.adpcm ? Storage::SliceFormat::Adpcm : Storage::SliceFormat::Pcm);
+  if (opt.image && !sampleBank.begin()) {
+    fprintf(stderr, "lofi_banks: sample bank unavailable\n");
+    return false;
+  }
+
+  bool ok = true;
+  for (size_t r = 0; r < kit.rows.size(); ++r) {
+    Row& row = kit.rows[r];
+    char letter = (char)('A' + r);
+    const char* file = row.wav.c_str() + row.wav.find_last_of('/') + 1;
+    if (!row.error.empty()) {
+      printf("  %c  %s: %s, skipped\n", letter, file, row.error.c_str());
+      ok = false;
+      continue;
+    }
+    if (!Slicer::writeEight(&letter, row.samples.data(), (uint32_t)row.samples.size(),
+                            opt.equal ? nullptr : &row.onsets)) {
+      printf("  %c  %s: write failed\n", letter, file);
+      ok = false;
+      continue;
+    }
+    bool streams = opt.image && row.samples.size() > SampleBank::SLOT_SAMPLES;
+    printf("  %c  %s: %u Hz x%u, %.2f s%s, %+.1f dB%s\n", letter, file, (unsigned)row.rate,
+           (unsigned)row.channels, row.seconds, row.capped ? " (cut to fit)" : "", row.gainDb,
+           streams ? ", too long for the bank (streams)" : "");
+  }
+
+  if (opt.image) {
+    uint32_t base = (flash.size() - SAMPLE_BANK_BYTES) / SAMPLE_BANK_SECTOR * SAMPLE_BANK_SECTOR;
+    std::string path = dir + "/bank.bin";
+    if (!writeBytes(path, HostFlash::xipBase() + base, SAMPLE_BANK_BYTES)) {
+      fprintf(stderr, "lofi_banks: cannot write %s\n", path.c_str());
+      return false;
+    }
+    printf("  bank.bin: %u bytes, program at QSPI offset 0x%06X\n", (unsigned)SAMPLE_BANK_BYTES, (unsigned)base);
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  bool usage = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--jobs") && i + 1 < argc) opt.jobs = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--peak") && i + 1 < argc) opt.peakDb = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--equal")) opt.equal = true;
+    else if (!strcmp(argv[i], "--adpcm")) opt.adpcm = true;
+    else if (!strcmp(argv[i], "--image")) opt.image = true;
+    else if (argv[i][0] != '-' && !opt.in) opt.in = argv[i];
+    else if (argv[i][0] != '-' && !opt.out) opt.out = argv[i];
+    else usage = true;
+  }
+  if (usage || !opt.in || !opt.out || opt.peakDb > 0.0) {
+    fprintf(stderr, "usage: lofi_banks IN OUT [--jobs N] [--peak DBFS] [--equal] [--adpcm] [--image]\n");
+    return 2;
+  }
+  if (opt.equal) Slicer::setCutMode(Slicer::CutMode::Equal);
+
+  std::deque<Kit> kits;   // not moved once made: workers count down in them
+  findKits(opt.in, kits);
+  if (kits.empty()) {
+    fprintf(stderr, "lofi_banks: no WAVs in %s\n", opt.in);
+    return 1;
+  }
+  if (mkdir(opt.out, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "lofi_banks: cannot create %s\n", opt.out);
+    return 1;
+  }
+
+  // Workers take rows in kit order; the main thread writes each kit as soon
+  // as its last row is converted, and frees it.
+  struct Job { size_t kit, row; };
+  std::vector<Job> queue;
+  for (size_t k = 0; k < kits.size(); ++k) {
+    kits[k].pending = (uint32_t)kits[k].rows.size();
+    for (size_t r = 0; r < kits[k].rows.size(); ++r) queue.push_back({k, r});
+  }
+  unsigned threads = opt.jobs ? opt.jobs : std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<unsigned>(threads, (unsigned)queue.size());
+  std::atomic<size_t> next{0};
+  std::mutex m;
+  std::condition_variable done;
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&] {
+      for (size_t j; (j = next++) < queue.size();) {
+        Kit& kit = kits[queue[j].kit];
+        convert(kit.rows[queue[j].row], opt);
+        if (--kit.pending == 0) {
+          std::lock_guard<std::mutex> lock(m);
+          done.notify_all();
+        }
+      }
+    });
+  }
+
+  HostSim::reset();
+  bool ok = true;
+  size_t rows = 0;
+  for (Kit& kit : kits) {
+    {
+      std::unique_lock<std::mutex> lock(m);
+      done.wait(lock, [&] { return kit.pending == 0; });
+    }
+    printf("%s\n", kit.name.c_str());
+    ok = writeKit(kit, opt) && ok;
+    rows += kit.rows.size();
+    kit.rows.clear();
+    kit.rows.shrink_to_fit();
+  }
+  for (std::thread& t : pool) t.join();
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  printf("%u kits, %u rows in %.2f s on %u threads\n", (unsigned)kits.size(), (unsigned)rows, secs, threads);
+  return ok ? 0 : 1;
+}
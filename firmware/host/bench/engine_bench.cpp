@@ -0,0 +1,999 @@
+// Host benchmark for the AudioEngine hot path.
+//
+// Runs the real engine against HostSim's simulated 22.05 kHz timer and the
+// LittleFS stand-in, with 0..4 rows retriggering every step like playStep()
+// does, and reports:
+//   • audio          ns / cycles per frame of whatever drives the DAC in this
+//                    build (timer ISR, or DMA beats + block render)
+//   • isr(), render() ns per frame of each mixer alone, same voice state,
+//                    plus render() cycles per sounding pool voice
+//   • service()      ns per main-loop pass (mean + p99)
+//   • pumpStreams()  ns / cycles per chunk pulled from flash
+//   • fs opens/s, fs KiB/s  LittleFS traffic per simulated second
+//   • steals/s       triggers that had to take a sounding voice
+//
+// Under the table the all-rows run is repeated with every row off 1x (two
+// backwards), so the interpolating mixer's cost reads against the 1x path,
+// and then with each VoiceFx stage on alone and all of them at once, for
+// what each effect adds per voice and frame.
+//
+// --verify runs two engines through the same pattern, one mixed by isr()
+// frame by frame and one by render() in blocks, and fails unless every DAC
+// code matches: at 1x, at 1x with every row's effects changing each step,
+// and at varispeed rates bent mid-step with the effects changing too. It then replays
+// the pattern with uneven loop passes and fails unless every voice starts
+// on the exact frame its step scheduled and telemetry counts no underruns,
+// floods the engine with requests between two service() passes and fails
+// unless each row ends up doing only the last thing asked of it, streams 4
+// rows without prefetch from a flash that charges per read and per KiB
+// (HostFS::setReadCost) through a loop that stalls every 16th pass and
+// fails on any underrun (at 1x and at varispeed rates), runs ClockSync
+// against a jittery host clock, records a streamed take into LittleFS and
+// commits it the way the sketch does, failing unless it erases nothing once
+// Storage::service() has had its idle passes (skipped with --dir, which
+// would rewrite row D there), mounts a drive formatted across the whole
+// chip by older firmware without reformatting it (skipped with --dir and
+// --flash), and finally commits takes into the sample
+// bank, failing unless a commit after SampleBank::service() has had its idle
+// passes programs pages without a single sector erase (skipped with --flash,
+// which would clobber the image's bank).
+//
+// --bank plays every slice from the mmap'd XIP sample bank instead of
+// LittleFS (pump columns then read 0: there is nothing to stream).
+//
+// --roll retriggers the same slice on every row each step, like a
+// stutter roll; triggers reuse the row's shadow, and rewind when the
+// voice rings hold a whole slice.
+//
+// --poly lets every row's hits overlap instead of choking.
+//
+// --no-prefetch skips the lookahead prefetch a few clocks before each step,
+// so every retrigger stages from scratch when its job is handled.
+//
+// --adpcm seeds the slices as IMA ADPCM, so the pump columns include the
+// decode and fs KiB/s drops to about a quarter.
+//
+// --telemetry FILE writes the firmware's telemetry frame (Telemetry.h) for
+// the all-rows firmware-cadence pass, bench loop passes standing in for
+// loop(); decode it with tools/telemetry_dump.py. The probes are always
+// compiled in, as on the board; here each one costs a pair of steady_clock
+// reads (tens of ns), which shows most in the per-frame isr() column.
+//
+// --rate R plays every row at R (negative: backwards).
+//
+// --fx puts every row through the whole effects chain (FULL_FX).
+//
+// Usage: lofi_bench [--seconds S] [--bpm B] [--loop-frames N] [--dir PATH]
+//                   [--bank] [--flash IMAGE] [--roll] [--no-prefetch] [--poly]
+//                   [--adpcm] [--verify] [--telemetry FILE] [--rate R] [--fx]
+#include "AudioEngine.h"
+#include "CommitJob.h"
+#include "FlashFS.h"
+#include "Storage.h"
+#include "SampleBank.h"
+#include "ClockSync.h"
+#include "Telemetry.h"
+#include "HostSim.h"
+#include "HostSeed.h"
+#include <Adafruit_SPIFlash.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LOFI_HAVE_TSC 1
+#endif
+
+extern Storage storage;
+extern SampleBank sampleBank;
+extern FlashFS lfs;
+extern Adafruit_SPIFlash flash;
+
+struct AudioEngineProbe {
+  static void isr(AudioEngine& e) { e.isr(); }
+  static void render(AudioEngine& e, uint16_t* outL, uint16_t* outR, uint16_t frames) {
+    e.render(outL, outR, frames);
+  }
+  static void pumpStreams(AudioEngine& e) { e.pumpStreams(); }
+  static uint32_t available(const AudioEngine& e, uint8_t v) { return e.vavailable[v]; }
+  static uint32_t startFrame(const AudioEngine& e, uint8_t v) { return e.voiceStartFrame[v]; }
+  static bool sounding(const AudioEngine& e, uint8_t v) { return e.voiceRunning[v] && e.voicePrimed[v]; }
+  static uint32_t steals(const AudioEngine& e) { return e.voiceSteals; }
+  static uint8_t row(const AudioEngine& e, uint8_t v) { return e.voiceRow[v]; }
+  static SliceId slice(const AudioEngine& e, uint8_t v) { return e.voiceSlice[v]; }
+  static void setRunning(AudioEngine& e, bool on) { e.running = on; }
+};
+
+namespace {
+
+AudioEngine engine;
+AudioEngine engineB; // --verify's second mixer
+
+struct Options {
+  double   seconds = 8.0;
+  uint32_t bpm = 140;
+  uint32_t loopFrames = 32; // ≈1.45 ms main loop
+  const char* dir = nullptr;
+  bool bank = false;
+  const char* flashImage = nullptr; // mmap this file as the raw QSPI array
+  bool roll = false;
+  bool prefetch = true;
+  bool poly = false;
+  bool adpcm = false;
+  bool verify = false;
+  const char* telemetryFile = nullptr;
+  float rates[ROW_COUNT] = {1.0f, 1.0f, 1.0f, 1.0f};  // per row, AudioEngine::setRate
+  VoiceFx::Settings fx;                                // every row, AudioEngine::setFx
+  float pans[ROW_COUNT] = {-0.75f, 0.75f, -0.25f, 0.25f}; // AudioEngine::setPan
+};
+
+// Every row off 1x, two of them backwards: what the varispeed passes play.
+const float VARISPEED_RATES[ROW_COUNT] = {1.5f, 0.75f, -1.0f, -2.25f};
+
+// Every stage of the chain on: what --fx and the effects line run.
+VoiceFx::Settings fullFx() {
+  VoiceFx::Settings fx;
+  fx.bits = 8;
+  fx.hold = 3;
+  fx.filter = VoiceFx::Filter::LowPass;
+  fx.cutoffHz = 1800;
+  fx.resonance = 2.0f;
+  fx.drive = 3.0f;
+  return fx;
+}
+
+bool fxOn(const VoiceFx::Settings& fx) {
+  return fx.bits < 16 || fx.hold > 1 || fx.filter != VoiceFx::Filter::Off || fx.drive > 0.0f;
+}
+
+// A different setting on every row and step, like per-step parameter locks:
+// stages switch in and out, the filter changes mode and sweeps.
+VoiceFx::Settings stepFx(uint8_t step, uint8_t row) {
+  VoiceFx::Settings fx;
+  fx.bits = (uint8_t)(4 + (step + row) % 13);
+  fx.hold = (uint8_t)(1 + (step * 3u + row) % 5);
+  fx.filter = (VoiceFx::Filter)((step + row) % 4);
+  fx.cutoffHz = (uint16_t)(150 + 1100 * ((step + 2u * row) % 9));
+  fx.resonance = 0.6f + (float)(step % 4) * 2.4f;
+  fx.drive = ((step + row) % 3) ? 0.0f : 1.0f + row;
+  return fx;
+}
+
+bool g_roll = false; // --roll, read by triggerStep()/prefetchStep()
+
+inline uint64_t nowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t nowCycles() {
+#ifdef LOFI_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Stat {
+  std::vector<double> v;
+  void add(double x) { v.push_back(x); }
+  double mean() const {
+    if (v.empty()) return 0.0;
+    double s = 0.0;
+    for (double x : v) s += x;
+    return s / (double)v.size();
+  }
+  double pct(double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (double)(v.size() - 1));
+    return v[i];
+  }
+};
+
+SliceId benchSlice(uint8_t r, uint8_t step) {
+  uint8_t slice = g_roll ? r : (uint8_t)((step + r) % STEPS_PER_BAR);
+  return sliceId(r, slice);
+}
+
+uint32_t triggerStep(AudioEngine& e, uint8_t voices, uint8_t step) {
+  // Mirrors playStep(): gated rows preload, the rest get a stop, all for the
+  // same frame SCHEDULE_AHEAD_FRAMES out.
+  uint32_t at = e.now() + SCHEDULE_AHEAD_FRAMES;
+  for (uint8_t r = 0; r < 4; ++r) {
+    if (r < voices) {
+      e.preloadAndPlay(r, benchSlice(r, step), at);
+    } else {
+      e.stopRow(r, at);
+    }
+  }
+  return at;
+}
+
+// Mirrors prefetchStep(): the gated rows of the coming step.
+void prefetchStep(AudioEngine& e, uint8_t voices, uint8_t step) {
+  for (uint8_t r = 0; r < voices; ++r) {
+    e.prefetch(r, benchSlice(r, step));
+  }
+}
+
+uint32_t stepFramesFor(const Options& opt) {
+  return (uint32_t)((uint64_t)SAMPLE_RATE_HZ * 60u / opt.bpm * BEATS_PER_BAR / STEPS_PER_BAR);
+}
+
+// The MIDI clock as handleMidi() sees it: a prefetch PREFETCH_CLOCKS clocks
+// before each step, then the step itself.
+struct StepClock {
+  enum Tick { None, Prefetch, Step };
+  uint32_t stepFrames;
+  uint32_t prefetchFrames;
+  uint64_t nextStep = 0;
+  uint8_t step = 0;      // the step the next Prefetch/Step is for
+  bool prefetched = false;
+
+  StepClock(const Options& opt)
+    : stepFrames(stepFramesFor(opt)),
+      prefetchFrames(opt.prefetch ? stepFramesFor(opt) * PREFETCH_CLOCKS / CLOCKS_PER_STEP : 0) {}
+
+  Tick poll(uint64_t frame) {
+    if (frame >= nextStep) {
+      nextStep += stepFrames;
+      prefetched = false;
+      return Step;
+    }
+    if (prefetchFrames && !prefetched && frame + prefetchFrames >= nextStep) {
+      prefetched = true;
+      return Prefetch;
+    }
+    return None;
+  }
+
+  // Drives one engine; returns true when a step fired (its frame in *at).
+  bool drive(AudioEngine& e, uint8_t voices, uint64_t frame, uint32_t* at = nullptr) {
+    switch (poll(frame)) {
+      case Prefetch:
+        prefetchStep(e, voices, step);
+        return false;
+      case Step: {
+        uint32_t t = triggerStep(e, voices, step++);
+        if (at) *at = t;
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+};
+
+void bootEngine(AudioEngine& e, const Options& opt) {
+  e.begin();
+  e.attachStorage(&storage);
+  e.attachSampleBank(opt.bank ? &sampleBank : nullptr);
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    e.setRowMode(r, opt.poly ? AudioEngine::RowMode::Poly : AudioEngine::RowMode::Choke);
+    e.setRate(r, opt.rates[r]);
+    e.setFx(r, opt.fx);
+    e.setPan(r, opt.pans[r]);
+  }
+}
+
+struct Result {
+  double audioNs = 0, audioCyc = 0;
+  double isrNs = 0, renderNs = 0;
+  double renderCyc = 0, liveVoices = 0, renderCycPerVoice = 0;
+  double serviceNs = 0, serviceP99 = 0;
+  double pumpNs = 0, pumpCyc = 0;
+  double opensPerSec = 0;
+  double kibPerSec = 0;
+  double stealsPerSec = 0;
+};
+
+bool writeTelemetry(const char* path) {
+  uint8_t frame[Telemetry::DUMP_BYTES];
+  size_t n = telemetry.serialize(frame, sizeof(frame));
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(frame, 1, n, f) == n;
+  return fclose(f) == 0 && ok;
+}
+
+// render() cycles per frame with every voice free: the fixed part of a
+// block (events, clamp, DAC codes) that the per-voice column leaves out.
+double floorCyc = 0.0;
+
+Result runVoices(uint8_t voices, const Options& opt) {
+  Result res;
+  const uint64_t totalFrames = (uint64_t)(opt.seconds * SAMPLE_RATE_HZ);
+
+  // Pass 1: the firmware's cadence — timer ticks (ISR or DMA) between
+  // main-loop service() passes.
+  bootEngine(engine, opt);
+  engine.start();
+  HostFS::resetStats();
+  telemetry.reset();
+  Stat audioNs, audioCyc, serviceNs;
+  StepClock clock(opt);
+  uint64_t frame = 0;
+  while (frame < totalFrames) {
+    uint32_t loopT0 = Telemetry::ticks();
+    clock.drive(engine, voices, frame);
+    uint64_t t0 = nowNs(), c0 = nowCycles();
+    HostSim::tick(opt.loopFrames);
+    uint64_t c1 = nowCycles(), t1 = nowNs();
+    audioNs.add((double)(t1 - t0) / opt.loopFrames);
+    audioCyc.add((double)(c1 - c0) / opt.loopFrames);
+    frame += opt.loopFrames;
+
+    t0 = nowNs();
+    engine.service();
+    serviceNs.add((double)(nowNs() - t0));
+    telemetry.record(Telemetry::Probe::Loop, Telemetry::ticks() - loopT0);
+  }
+  if (opt.telemetryFile && voices == ROW_COUNT && !writeTelemetry(opt.telemetryFile)) {
+    fprintf(stderr, "lofi_bench: cannot write %s\n", opt.telemetryFile);
+  }
+  res.audioNs = audioNs.mean();
+  res.audioCyc = audioCyc.mean();
+  res.serviceNs = serviceNs.mean();
+  res.serviceP99 = serviceNs.pct(0.99);
+  res.opensPerSec = (double)HostFS::stats().opens / opt.seconds;
+  res.kibPerSec = (double)HostFS::stats().bytesRead / 1024.0 / opt.seconds;
+  res.stealsPerSec = (double)AudioEngineProbe::steals(engine) / opt.seconds;
+  engine.stop();
+
+  // Pass 2: isolate pumpStreams(). Let the ISR drain a chunk's worth, then
+  // time one refill pass and divide by the voices that actually pulled data.
+  bootEngine(engine, opt);
+  engine.start();
+  Stat pumpNs, pumpCyc;
+  clock = StepClock(opt);
+  frame = 0;
+  while (frame < totalFrames) {
+    if (clock.drive(engine, voices, frame)) engine.service();
+    HostSim::tick(256);
+    frame += 256;
+
+    uint32_t before[VOICE_COUNT];
+    for (uint8_t v = 0; v < VOICE_COUNT; ++v) before[v] = AudioEngineProbe::available(engine, v);
+    uint64_t t0 = nowNs(), c0 = nowCycles();
+    AudioEngineProbe::pumpStreams(engine);
+    uint64_t c1 = nowCycles(), t1 = nowNs();
+    uint32_t chunks = 0;
+    for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+      if (AudioEngineProbe::available(engine, v) > before[v]) chunks++;
+    }
+    if (chunks) {
+      pumpNs.add((double)(t1 - t0) / chunks);
+      pumpCyc.add((double)(c1 - c0) / chunks);
+    }
+    engine.service();
+  }
+  res.pumpNs = pumpNs.mean();
+  res.pumpCyc = pumpCyc.mean();
+  engine.stop();
+
+  // Pass 3: the two mixers alone. Alternate blocks between isr() and
+  // render() with service() in between, so both see the same kind of state.
+  // render() cycles are also split over the voices sounding in the block,
+  // minus the empty-pool floor, for a per-voice cost.
+  bootEngine(engine, opt);
+  AudioEngineProbe::setRunning(engine, true);
+  Stat isrNs, renderNs, renderCyc, live;
+  uint16_t blockL[AUDIO_BLOCK_FRAMES], blockR[AUDIO_BLOCK_FRAMES];
+  clock = StepClock(opt);
+  frame = 0;
+  bool useIsr = true;
+  while (frame < totalFrames) {
+    clock.drive(engine, voices, frame);
+    engine.service();
+    uint32_t sounding = 0;
+    for (uint8_t v = 0; v < VOICE_COUNT; ++v) sounding += AudioEngineProbe::sounding(engine, v);
+    uint64_t t0 = nowNs(), c0 = nowCycles();
+    if (useIsr) {
+      for (uint16_t i = 0; i < AUDIO_BLOCK_FRAMES; ++i) AudioEngineProbe::isr(engine);
+    } else {
+      AudioEngineProbe::render(engine, blockL, blockR, AUDIO_BLOCK_FRAMES);
+      renderCyc.add((double)(nowCycles() - c0) / AUDIO_BLOCK_FRAMES);
+      live.add((double)sounding);
+    }
+    double perFrame = (double)(nowNs() - t0) / AUDIO_BLOCK_FRAMES;
+    (useIsr ? isrNs : renderNs).add(perFrame);
+    useIsr = !useIsr;
+    frame += AUDIO_BLOCK_FRAMES;
+  }
+  res.isrNs = isrNs.mean();
+  res.renderNs = renderNs.mean();
+  res.renderCyc = renderCyc.mean();
+  res.liveVoices = live.mean();
+  if (res.liveVoices > 0.0) {
+    res.renderCycPerVoice = (res.renderCyc - floorCyc) / res.liveVoices;
+    if (res.renderCycPerVoice < 0.0) res.renderCycPerVoice = 0.0;
+  }
+  AudioEngineProbe::setRunning(engine, false);
+  return res;
+}
+
+// Same pattern through both mixers; every DAC code has to match. With
+// `bend`, every row's rate also moves by a semitone halfway through each
+// step, so a rate change lands mid-block; with `fxSteps` each row gets new
+// effects (stepFx()) on every step frame. Both DAC channels are compared.
+bool verifyBlockMixer(const Options& opt, bool bend, bool fxSteps) {
+  const uint64_t totalFrames = (uint64_t)(opt.seconds * SAMPLE_RATE_HZ);
+  bootEngine(engine, opt);
+  bootEngine(engineB, opt);
+  AudioEngineProbe::setRunning(engine, true);
+  AudioEngineProbe::setRunning(engineB, true);
+
+  uint16_t blockL[AUDIO_BLOCK_FRAMES], blockR[AUDIO_BLOCK_FRAMES];
+  StepClock clock(opt);
+  uint64_t frame = 0, mismatches = 0, firstBad = 0, audible = 0;
+  while (frame < totalFrames) {
+    StepClock::Tick tick = clock.poll(frame);
+    if (tick == StepClock::Prefetch) {
+      prefetchStep(engine, 4, clock.step);
+      prefetchStep(engineB, 4, clock.step);
+    } else if (tick == StepClock::Step) {
+      uint32_t at = triggerStep(engine, 4, clock.step);
+      triggerStep(engineB, 4, clock.step);
+      for (uint8_t r = 0; fxSteps && r < ROW_COUNT; ++r) {
+        VoiceFx::Settings fx = stepFx(clock.step, r);
+        engine.setFx(r, fx, at);
+        engineB.setFx(r, fx, at);
+      }
+      if (bend) {
+        uint32_t mid = at + clock.stepFrames / 2u;
+        for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+          float rate = opt.rates[r] * ((clock.step & 1u) ? 1.0f : 1.0595f);
+          engine.setRate(r, rate, mid);
+          engineB.setRate(r, rate, mid);
+        }
+      }
+      clock.step++;
+    }
+    engine.service();
+    engineB.service();
+    AudioEngineProbe::render(engineB, blockL, blockR, AUDIO_BLOCK_FRAMES);
+    for (uint16_t i = 0; i < AUDIO_BLOCK_FRAMES; ++i) {
+      AudioEngineProbe::isr(engine);
+      if (blockL[i] != 2048 || blockR[i] != 2048) audible++;
+      if (HostSim::dacValue(DAC_PIN_L) != blockL[i] || HostSim::dacValue(DAC_PIN_R) != blockR[i]) {
+        if (!mismatches) firstBad = frame + i;
+        mismatches++;
+      }
+    }
+    frame += AUDIO_BLOCK_FRAMES;
+  }
+  AudioEngineProbe::setRunning(engine, false);
+  AudioEngineProbe::setRunning(engineB, false);
+  if (mismatches) {
+    printf("verify: FAIL, %llu of %llu frames differ (first at frame %llu)\n",
+           (unsigned long long)mismatches, (unsigned long long)frame, (unsigned long long)firstBad);
+    return false;
+  }
+  printf("verify: render() matches isr() bit for bit over %llu %s frames (%llu non-silent), 4 rows at %gx/%gx/%gx/%gx%s%s, %u-frame blocks\n",
+         (unsigned long long)frame, STEREO_OUT ? "stereo" : "mono", (unsigned long long)audible, opt.rates[0],
+         opt.rates[1], opt.rates[2], opt.rates[3], bend ? " bent mid-step" : "",
+         fxSteps ? ", effects changing every step" : "", (unsigned)AUDIO_BLOCK_FRAMES);
+  return audible > 0;
+}
+
+// Loop passes of random length (1..SCHEDULE_AHEAD_FRAMES-1 frames) between
+// the trigger and service(), as if the UI stalled; every voice has to start
+// on the step's timestamp anyway, whether it was staged, rewound or swapped
+// in from its shadow.
+bool verifyScheduling(const Options& opt) {
+  const uint64_t totalFrames = (uint64_t)(opt.seconds * SAMPLE_RATE_HZ);
+  bootEngine(engine, opt);
+  AudioEngineProbe::setRunning(engine, true);
+  telemetry.reset();
+
+  StepClock clock(opt);
+  uint32_t lcg = 0xC0FFEEu;
+  uint64_t frame = 0, onsets = 0, late = 0;
+  uint8_t pending = 0;
+  uint32_t at = 0;
+  while (frame < totalFrames) {
+    bool stepped = clock.drive(engine, 4, frame, &at);
+    lcg = lcg * 1664525u + 1013904223u;
+    uint32_t pass = 1u + (lcg >> 16) % (SCHEDULE_AHEAD_FRAMES - 1u);
+    for (uint32_t i = 0; i < pass; ++i) {
+      uint32_t now = engine.now();
+      AudioEngineProbe::isr(engine);
+      if (!pending || now != at) continue;
+      // Pool voices, not rows: count how many started on exactly `at`.
+      uint8_t started = 0;
+      for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+        if (AudioEngineProbe::startFrame(engine, v) == at) started++;
+      }
+      onsets += started;
+      if (started < pending) late += pending - started;
+      pending = 0;
+    }
+    frame += pass;
+    engine.service();
+    // The Starts are posted now; each must fire on frame `at`.
+    if (stepped) pending = ROW_COUNT;
+  }
+  AudioEngineProbe::setRunning(engine, false);
+  // Passes that short leave every ring well fed; telemetry must agree.
+  Telemetry::Snapshot snap;
+  telemetry.snapshot(snap);
+  uint32_t underruns = snap.counters[(uint8_t)Telemetry::Counter::Underruns];
+  if (late || onsets == 0 || underruns) {
+    printf("verify: FAIL, %llu of %llu onsets off their scheduled frame, %u underruns\n",
+           (unsigned long long)late, (unsigned long long)(onsets + late), (unsigned)underruns);
+    return false;
+  }
+  printf("verify: all %llu onsets on their scheduled frame, no underruns, loop passes 1..%u frames\n",
+         (unsigned long long)onsets, (unsigned)(SCHEDULE_AHEAD_FRAMES - 1u));
+  return true;
+}
+
+// Hundreds of requests per row, all before one service(): the last of each kind per row wins, in post order. Rows
+// 0-1 end on a trigger and must sound exactly that slice on its frame;
+// rows 2-3 end on a stop and must stay silent. Then row 0 gets a stop and
+// a level change before one service(), and must go silent.
+bool verifyBurst(const Options& opt) {
+  bootEngine(engine, opt);
+  AudioEngineProbe::setRunning(engine, true);
+  const uint8_t want = 5;
+  uint32_t at = engine.now() + SCHEDULE_AHEAD_FRAMES;
+  uint32_t calls = 0;
+  for (uint8_t i = 0; i < 64; ++i) {
+    for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+      engine.setLevel(r, 0.5f + 0.005f * i, at);
+      engine.prefetch(r, sliceId(r, (uint8_t)(i % 8)));
+      engine.preloadAndPlay(r, sliceId(r, (uint8_t)(i % 8)), at);
+      engine.stopRow(r, at);
+      calls += 4;
+    }
+  }
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    if (r < 2) {
+      engine.preloadAndPlay(r, sliceId(r, want), at);
+    } else {
+      engine.preloadAndPlay(r, sliceId(r, want), at);
+      engine.stopRow(r, at);
+    }
+    calls++;
+  }
+  engine.service();
+  while ((int32_t)(engine.now() - at) <= 0) AudioEngineProbe::isr(engine);
+  uint8_t sounding[ROW_COUNT] = {};
+  bool ok = true;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (!AudioEngineProbe::sounding(engine, v)) continue;
+    uint8_t r = AudioEngineProbe::row(engine, v);
+    if (r >= ROW_COUNT) continue;
+    sounding[r]++;
+    if (AudioEngineProbe::slice(engine, v) != sliceId(r, want) ||
+        AudioEngineProbe::startFrame(engine, v) != at) ok = false;
+  }
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    if (sounding[r] != (r < 2 ? 1u : 0u)) ok = false;
+  }
+  if (!ok) {
+    AudioEngineProbe::setRunning(engine, false);
+    printf("verify: FAIL, burst of %u requests: rows sounding %u/%u/%u/%u, expected 1/1/0/0 on slice %u\n",
+           (unsigned)calls, sounding[0], sounding[1], sounding[2], sounding[3], (unsigned)want + 1);
+    return false;
+  }
+  // A step's stop and a level change in the same loop pass (the sketch's
+  // stutter decay) are different kinds: the level must not undo the stop.
+  engine.stopRow(0, engine.now() + 128);
+  engine.setLevel(0, 0.9f);
+  engine.service();
+  for (uint32_t i = 0; i < 1280; ++i) AudioEngineProbe::isr(engine);
+  engine.service();
+  uint8_t left = 0;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) {
+    if (AudioEngineProbe::sounding(engine, v) && AudioEngineProbe::row(engine, v) == 0) left++;
+  }
+  AudioEngineProbe::setRunning(engine, false);
+  if (left) {
+    printf("verify: FAIL, stop then level before one service() left %u voice(s) on row 1\n", (unsigned)left);
+    return false;
+  }
+  printf("verify: burst of %u requests before one service(), latest per row wins; a level doesn't undo a stop\n",
+         (unsigned)calls);
+  return true;
+}
+
+// Four rows streaming from slow flash, with every 16th loop pass stalled
+// like a long UI redraw. Reads take sample-clock time here (the mixer keeps
+// draining the rings meanwhile), so the pump has to spend its reads where the
+// deadline is: any underrun fails.
+bool verifyStreaming(const Options& opt) {
+  // 20 ms stalls; no prefetch, so the voices start on their resident heads
+  // and everything after comes through the pump.
+  const uint32_t readUs = 800, kibUs = 300, stall = 441;
+  Options o = opt;
+  o.prefetch = false;
+  bootEngine(engine, o);
+  engine.start();
+  telemetry.reset();
+  HostFS::setReadCost(readUs, kibUs);
+  StepClock clock(o);
+  uint64_t frames = (uint64_t)(opt.seconds * SAMPLE_RATE_HZ);
+  uint32_t start = engine.now(), passes = 0;
+  while (engine.now() - start < frames) {
+    clock.drive(engine, 4, engine.now() - start);
+    HostSim::tick(++passes % 16 ? opt.loopFrames : stall);
+    engine.service();
+  }
+  HostFS::setReadCost(0, 0);
+  engine.stop();
+  Telemetry::Snapshot snap;
+  telemetry.snapshot(snap);
+  uint32_t underruns = snap.counters[(uint8_t)Telemetry::Counter::Underruns];
+  uint32_t low = Telemetry::NO_LOW_WATER;
+  for (uint8_t v = 0; v < VOICE_COUNT; ++v) low = std::min<uint32_t>(low, snap.lowWater[v]);
+  if (underruns) {
+    printf("verify: FAIL, %u underruns streaming 4 rows at %gx/%gx/%gx/%gx from slow flash (%u us + %u us/KiB per read, %u-frame stalls)\n",
+           (unsigned)underruns, opt.rates[0], opt.rates[1], opt.rates[2], opt.rates[3],
+           (unsigned)readUs, (unsigned)kibUs, (unsigned)stall);
+    return false;
+  }
+  printf("verify: no underruns streaming 4 rows at %gx/%gx/%gx/%gx from slow flash (%u us + %u us/KiB per read, %u-frame stalls), ring low-water %u\n",
+         opt.rates[0], opt.rates[1], opt.rates[2], opt.rates[3],
+         (unsigned)readUs, (unsigned)kibUs, (unsigned)stall, (unsigned)low);
+  return true;
+}
+
+// A host clock with USB jitter (0..1 ms) read at the start of uneven loop
+// passes, through a tempo change and a bar-long dropout. Steps from
+// ClockSync must come out in order, none missed or doubled, and once
+// settled spread at most a third as wide around the host's real step
+// times as "twelfth clock byte read + SCHEDULE_AHEAD_FRAMES" does.
+bool verifyClock() {
+  struct Span { uint32_t bars; double bpm; bool silent; };
+  const Span song[] = {{8, 140.0, false}, {8, 100.0, false}, {1, 100.0, true}, {6, 100.0, false}};
+  // Host clock times, and which steps to leave out while it settles.
+  std::vector<double> clocks;
+  std::vector<bool> received;
+  std::vector<bool> settled;
+  double t = 1000.0;
+  for (const Span& sp : song) {
+    double period = SAMPLE_RATE_HZ * 60.0 / (sp.bpm * MIDI_PPQN);
+    uint32_t n = sp.bars * STEPS_PER_BAR * CLOCKS_PER_STEP;
+    for (uint32_t i = 0; i < n; ++i) {
+      uint32_t step = (uint32_t)(i / CLOCKS_PER_STEP);
+      clocks.push_back(t);
+      received.push_back(!sp.silent);
+      if (i % CLOCKS_PER_STEP == 0) settled.push_back(!sp.silent && step >= 2u * STEPS_PER_BAR);
+      t += period;
+    }
+  }
+
+  ClockSync clock;
+  uint32_t lcg = 0x5EEDu;
+  auto rnd = [&lcg](uint32_t n) { lcg = lcg * 1664525u + 1013904223u; return (lcg >> 16) % n; };
+  std::vector<uint32_t> arrive(clocks.size());
+  for (size_t i = 0; i < clocks.size(); ++i) arrive[i] = (uint32_t)clocks[i] + rnd(SAMPLE_RATE_HZ / 1000u + 1u);
+
+  std::vector<int32_t> pll, raw;
+  uint32_t now = 0, steps = 0;
+  size_t next = 0;
+  bool ok = true;
+  clock.midiStart();
+  while (next < clocks.size()) {
+    while (next < clocks.size() && (int32_t)(arrive[next] - now) <= 0) {
+      if (received[next]) {
+        clock.midiClock(now);
+        if (next % CLOCKS_PER_STEP == 0 && settled[next / CLOCKS_PER_STEP]) {
+          raw.push_back((int32_t)(now + SCHEDULE_AHEAD_FRAMES - (uint32_t)clocks[next]));
+        }
+      }
+      next++;
+    }
+    for (;;) {
+      ClockSync::Tick tick = clock.poll(now);
+      if (tick.type == ClockSync::TickType::None) break;
+      if (tick.type != ClockSync::TickType::Step) continue;
+      uint32_t k = steps++;
+      if (tick.step != k % STEPS_PER_BAR || k >= settled.size()) {
+        ok = false;
+        continue;
+      }
+      if (settled[k]) pll.push_back((int32_t)(tick.at - (uint32_t)clocks[k * CLOCKS_PER_STEP]));
+    }
+    now += 1u + rnd(SCHEDULE_AHEAD_FRAMES - 1u);
+  }
+  auto spread = [](const std::vector<int32_t>& v) {
+    return v.empty() ? 0 : *std::max_element(v.begin(), v.end()) - *std::min_element(v.begin(), v.end());
+  };
+  int32_t pllSpread = spread(pll), rawSpread = spread(raw);
+  size_t expected = clocks.size() / CLOCKS_PER_STEP;
+  if (steps + 1 < expected) ok = false;  // the last one may still be ahead
+  if (!ok || pll.empty() || pllSpread * 3 > rawSpread) {
+    printf("verify: FAIL, clock recovery: %u of %u steps, spread %d frames (raw clock bytes %d)\n",
+           (unsigned)steps, (unsigned)expected, pllSpread, rawSpread);
+    return false;
+  }
+  printf("verify: clock recovery spread %d frames vs %d raw over %u settled steps, %u steps through a tempo change and dropout\n",
+         pllSpread, rawSpread, (unsigned)pll.size(), (unsigned)steps);
+  return true;
+}
+
+// A take streamed into row D's source.raw a page at a time and cut by a
+// CommitJob, as serviceRecording() does in the default build (no bank).
+// Straight after mounting, every block LittleFS allocates is erased inline;
+// once Storage::service() has run dry, none may be.
+bool verifyFlashCommit() {
+  const uint32_t count = SAMPLE_RATE_HZ * 5u / RECORD_FLUSH_SAMPLES * RECORD_FLUSH_SAMPLES;
+  CommitJob job;
+  auto take = [&]() {
+    lfs.resetStats();
+    bool ok = storage.beginAppend("/D/source.raw");
+    int16_t page[RECORD_FLUSH_SAMPLES];
+    uint32_t lcg = 0x7A4Eu;
+    for (uint32_t at = 0; ok && at < count; at += RECORD_FLUSH_SAMPLES) {
+      for (uint16_t i = 0; i < RECORD_FLUSH_SAMPLES; ++i) {
+        lcg = lcg * 1664525u + 1013904223u;
+        page[i] = (int16_t)(lcg >> 20);
+      }
+      ok = storage.append(page, RECORD_FLUSH_SAMPLES);
+    }
+    storage.endAppend();
+    ok = ok && job.beginRecorded(ROW_COUNT - 1, nullptr);
+    while (job.service(COMMIT_BUDGET_US)) {}
+    return ok && !job.failed() && storage.rawSampleCount("/D/source.raw") == (int32_t)count;
+  };
+  if (!storage.begin()) {
+    printf("verify: FAIL, LittleFS did not mount\n");
+    return false;
+  }
+  bool ok = take();
+  FlashFS::Stats cold = lfs.stats();
+  lfs.resetStats();
+  uint32_t passes = 0;
+  while (storage.service()) passes++;
+  uint32_t prepared = lfs.stats().prepared;
+  ok = take() && ok;
+  FlashFS::Stats warm = lfs.stats();
+  if (!ok || !cold.erasesDone || !warm.erasesAsked || warm.erasesDone) {
+    printf("verify: FAIL, streamed take: %u of %u block erases inline after idle service() (%u of %u cold), take %s\n",
+           (unsigned)warm.erasesDone, (unsigned)warm.erasesAsked, (unsigned)cold.erasesDone,
+           (unsigned)cold.erasesAsked, ok ? "committed" : "lost");
+    return false;
+  }
+  printf("verify: streamed %u-sample take and its commit erase 0 of %u blocks inline after %u idle service() passes (%u erases there), %u cold\n",
+         (unsigned)count, (unsigned)warm.erasesAsked, (unsigned)passes, (unsigned)prepared,
+         (unsigned)cold.erasesDone);
+  return true;
+}
+
+// A drive formatted by older firmware, whose LittleFS spans the whole chip:
+// it has to mount at that size, report that it overlaps the bank and get no
+// pre-erase, and a blank chip has to come back at the size below the bank.
+// Only the superblock is planted; the shim keeps files off blocks 0 and 1.
+bool verifyLegacyLayout() {
+  auto plant = [](uint32_t blockCount) {
+    uint8_t d[48];
+    memset(d, 0xFF, sizeof(d));
+    uint32_t words[] = { 1u, 48u, 2u, 3u };   // rev, size, tail[2]
+    memcpy(d, words, sizeof(words));
+    d[16] = 0x2E; d[17] = 20; d[18] = 0; d[19] = 8;
+    uint32_t sb[] = { 2u, 3u, FlashFS::BLOCK_BYTES, blockCount, 0x00010001u };
+    memcpy(d + 20, sb, sizeof(sb));
+    memcpy(d + 40, "littlefs", 8);
+    for (uint32_t b = 0; b < 2; ++b) {
+      flash.eraseSector(b);
+      flash.writeBuffer(b * FlashFS::BLOCK_BYTES, d, sizeof(d));
+    }
+  };
+  const uint32_t whole = flash.size() / FlashFS::BLOCK_BYTES;
+  plant(whole);
+  bool mounted = storage.begin();
+  bool overlaps = storage.overlapsBank();
+  bool serviced = storage.service();
+  flash.eraseSector(0);
+  flash.eraseSector(1);
+  bool remounted = storage.begin();
+  bool clear = !storage.overlapsBank();
+  if (!mounted || !overlaps || serviced || !remounted || !clear) {
+    printf("verify: FAIL, whole-chip drive: mounted %d, overlaps bank %d, pre-erased %d; blank chip mounted %d below the bank %d\n",
+           mounted, overlaps, serviced, remounted, clear);
+    return false;
+  }
+  printf("verify: a whole-chip (%u-block) drive from older firmware mounts as it is, bank and pre-erase off\n",
+         (unsigned)whole);
+  return true;
+}
+
+// Takes committed into the sample bank the way CommitJob does it, a flash
+// page per pass. With SampleBank::service() run dry beforehand the commit
+// has to be program-only; straight after another commit the same one erases
+// inline. Either way the bank then has to serve the new take.
+bool verifyBankCommit() {
+  if (!sampleBank.ready() && !sampleBank.begin()) {
+    printf("verify: FAIL, sample bank unavailable\n");
+    return false;
+  }
+  const uint8_t row = ROW_COUNT - 1;
+  const uint32_t count = SampleBank::SLOT_SAMPLES;
+  std::vector<int16_t> take(count);
+  uint32_t sliceStart[8], sliceLen[8];
+  for (uint8_t i = 0; i < 8; ++i) {
+    sliceStart[i] = i * (count / 8u);
+    sliceLen[i] = count / 8u;
+  }
+  auto commit = [&](int16_t salt) {
+    for (uint32_t i = 0; i < count; ++i) take[i] = (int16_t)(i * 7u + (uint32_t)salt);
+    HostFlash::resetStats();
+    bool ok = sampleBank.beginRow(row);
+    for (uint32_t at = 0; ok && at < count; at += RECORD_FLUSH_SAMPLES) {
+      uint32_t n = std::min<uint32_t>(RECORD_FLUSH_SAMPLES, count - at);
+      ok = sampleBank.writeRowChunk(row, at, take.data() + at, n);
+    }
+    ok = ok && sampleBank.publishRow(row, count, sliceStart, sliceLen);
+    SampleBank::Slice s;
+    for (uint8_t i = 0; ok && i < 8; ++i) {
+      ok = sampleBank.slice(row, i, s) && s.samples == sliceLen[i] &&
+           !memcmp(s.data, take.data() + sliceStart[i], sliceLen[i] * sizeof(int16_t));
+    }
+    return ok;
+  };
+  auto prepare = [] {
+    HostFlash::resetStats();
+    while (sampleBank.service()) {}
+    return HostFlash::stats().sectorErases;
+  };
+  prepare();
+  bool ok = commit(1);
+  HostFlash::Stats first = HostFlash::stats();
+  ok = commit(2) && ok;
+  HostFlash::Stats straight = HostFlash::stats();
+  uint32_t idleErases = prepare();
+  ok = commit(3) && ok;
+  HostFlash::Stats prepared = HostFlash::stats();
+  if (!ok || first.sectorErases || prepared.sectorErases || !straight.sectorErases) {
+    printf("verify: FAIL, bank commit: %u and %u sector erases after idle service() (%u without), take %s\n",
+           (unsigned)first.sectorErases, (unsigned)prepared.sectorErases,
+           (unsigned)straight.sectorErases, ok ? "served" : "lost");
+    return false;
+  }
+  printf("verify: bank commit of %u samples is %u page programs and no erases after idle service() (%u erases there), %u sector erases inline without\n",
+         (unsigned)count, (unsigned)prepared.pagePrograms, (unsigned)idleErases,
+         (unsigned)straight.sectorErases);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) opt.seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--bpm") && i + 1 < argc) opt.bpm = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--loop-frames") && i + 1 < argc) opt.loopFrames = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--dir") && i + 1 < argc) opt.dir = argv[++i];
+    else if (!strcmp(argv[i], "--bank")) opt.bank = true;
+    else if (!strcmp(argv[i], "--flash") && i + 1 < argc) opt.flashImage = argv[++i];
+    else if (!strcmp(argv[i], "--roll")) opt.roll = true;
+    else if (!strcmp(argv[i], "--no-prefetch")) opt.prefetch = false;
+    else if (!strcmp(argv[i], "--poly")) opt.poly = true;
+    else if (!strcmp(argv[i], "--adpcm")) opt.adpcm = true;
+    else if (!strcmp(argv[i], "--verify")) opt.verify = true;
+    else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc) opt.telemetryFile = argv[++i];
+    else if (!strcmp(argv[i], "--rate") && i + 1 < argc) std::fill(opt.rates, opt.rates + ROW_COUNT, (float)atof(argv[++i]));
+    else if (!strcmp(argv[i], "--fx")) opt.fx = fullFx();
+    else {
+      fprintf(stderr, "usage: %s [--seconds S] [--bpm B] [--loop-frames N] [--dir PATH] [--bank] [--flash IMAGE] [--roll] [--no-prefetch] [--poly] [--adpcm] [--verify] [--telemetry FILE] [--rate R] [--fx]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (opt.bpm == 0 || opt.loopFrames == 0 || opt.seconds <= 0.0) return 2;
+  g_roll = opt.roll;
+
+  HostSim::reset();
+  if (opt.flashImage && !HostFlash::mapFile(opt.flashImage)) {
+    fprintf(stderr, "lofi_bench: cannot map %s\n", opt.flashImage);
+    return 1;
+  }
+  if (opt.dir) {
+    if (!HostFS::mountDirectory(opt.dir)) {
+      fprintf(stderr, "lofi_bench: cannot use %s\n", opt.dir);
+      return 1;
+    }
+  } else {
+    HostFS::useRamImage();
+  }
+  if (!storage.begin()) return 1;
+  if (opt.bank) {
+    if (!sampleBank.begin()) {
+      fprintf(stderr, "lofi_bench: sample bank unavailable\n");
+      return 1;
+    }
+    storage.attachSampleBank(&sampleBank);
+  }
+  if (opt.adpcm) storage.setSliceFormat(Storage::SliceFormat::Adpcm);
+  seedRows();
+  if (opt.verify) {
+    Options vari = opt;
+    std::copy(VARISPEED_RATES, VARISPEED_RATES + ROW_COUNT, vari.rates);
+    bool ok = verifyBlockMixer(opt, false, false);
+    ok = verifyBlockMixer(opt, false, true) && ok;
+    ok = verifyBlockMixer(vari, true, true) && ok;
+    ok = verifyScheduling(opt) && ok;
+    ok = verifyBurst(opt) && ok;
+    ok = verifyStreaming(opt) && ok;
+    ok = verifyStreaming(vari) && ok;
+    ok = verifyClock() && ok;
+    if (!opt.dir) ok = verifyFlashCommit() && ok;
+    if (!opt.dir && !opt.flashImage) ok = verifyLegacyLayout() && ok;
+    if (!opt.flashImage) ok = verifyBankCommit() && ok;
+    return ok ? 0 : 1;
+  }
+
+  printf("lofi_bench: %u Hz %s, %u BPM, %.1f s per run, service() every %u frames, %s%s%s%s%s%s, %s\n",
+         (unsigned)SAMPLE_RATE_HZ, STEREO_OUT ? "stereo" : "mono", (unsigned)opt.bpm, opt.seconds, (unsigned)opt.loopFrames,
+         opt.dir ? opt.dir : "RAM image", opt.bank ? " + XIP bank" : "", opt.roll ? ", roll" : "",
+         opt.prefetch ? "" : ", no prefetch", opt.adpcm ? ", ADPCM slices" : "",
+         fxOn(opt.fx) ? ", effects on" : "", AUDIO_BLOCK_RENDER ? "DMA block render" : "per-sample ISR");
+#ifndef LOFI_HAVE_TSC
+  printf("(no cycle counter on this host; cycle columns read 0)\n");
+#endif
+  printf("rows | audio ns/frame | audio cyc/frame | isr() ns/frame | render() ns/frame | live voices | render cyc/voice | service ns/pass | service p99 ns | pump ns/chunk | pump cyc/chunk | fs opens/s | fs KiB/s | steals/s\n");
+  printf("-----+----------------+-----------------+----------------+-------------------+-------------+------------------+-----------------+----------------+---------------+----------------+------------+----------+---------\n");
+  double worstPerVoice = 0.0;
+  Result full;
+  for (uint8_t rows = 0; rows <= ROW_COUNT; ++rows) {
+    Result r = runVoices(rows, opt);
+    full = r;
+    if (rows == 0) floorCyc = r.renderCyc;
+    if (r.renderCycPerVoice > worstPerVoice) worstPerVoice = r.renderCycPerVoice;
+    printf("%4u | %14.1f | %15.1f | %14.1f | %17.1f | %11.2f | %16.1f | %15.0f | %14.0f | %13.0f | %14.0f | %10.0f | %8.0f | %8.1f\n",
+           rows, r.audioNs, r.audioCyc, r.isrNs, r.renderNs, r.liveVoices, r.renderCycPerVoice,
+           r.serviceNs, r.serviceP99, r.pumpNs, r.pumpCyc, r.opensPerSec, r.kibPerSec, r.stealsPerSec);
+  }
+  // The all-rows run again with every row off 1x (two of them backwards),
+  // against the one above: what interpolation costs per voice. Skipped when
+  // --rate already put the table off 1x.
+  if (std::all_of(opt.rates, opt.rates + ROW_COUNT, [](float r) { return r == 1.0f; })) {
+    Options vari = opt;
+    std::copy(VARISPEED_RATES, VARISPEED_RATES + ROW_COUNT, vari.rates);
+    vari.telemetryFile = nullptr;
+    Result r = runVoices(ROW_COUNT, vari);
+    if (r.renderCycPerVoice > worstPerVoice) worstPerVoice = r.renderCycPerVoice;
+    printf("varispeed (%s) at %gx/%gx/%gx/%gx: render() %.1f cyc/voice vs %.1f at 1x, isr() %.1f ns/frame vs %.1f, pump %.0f ns/chunk vs %.0f, %.0f fs KiB/s vs %.0f\n",
+           VARISPEED_CUBIC ? "4-point" : "linear", vari.rates[0], vari.rates[1], vari.rates[2], vari.rates[3],
+           r.renderCycPerVoice, full.renderCycPerVoice, r.isrNs, full.isrNs, r.pumpNs, full.pumpNs,
+           r.kibPerSec, full.kibPerSec);
+  }
+  // The board gets F_CPU / SAMPLE_RATE_HZ cycles per frame for everything.
+  // Host cycles only stand in for SAMD51 ones, so this is a ratio to watch
+  // between builds, not a headroom guarantee.
+  double budget = (double)F_CPU / SAMPLE_RATE_HZ;
+  // Each effect alone on every row, then all of them, against the dry 1x
+  // run: what a stage adds per voice and frame. Skipped when --fx or --rate
+  // already changed the table.
+  if (!fxOn(opt.fx) && std::all_of(opt.rates, opt.rates + ROW_COUNT, [](float r) { return r == 1.0f; })) {
+    VoiceFx::Settings fx[5];
+    VoiceFx::Settings all = fullFx();
+    fx[0].bits = all.bits;
+    fx[1].hold = all.hold;
+    fx[2].filter = all.filter;
+    fx[2].cutoffHz = all.cutoffHz;
+    fx[2].resonance = all.resonance;
+    fx[3].drive = all.drive;
+    fx[4] = all;
+    double perVoice[5];
+    for (uint8_t i = 0; i < 5; ++i) {
+      Options o = opt;
+      o.fx = fx[i];
+      o.telemetryFile = nullptr;
+      perVoice[i] = runVoices(ROW_COUNT, o).renderCycPerVoice;
+    }
+    printf("effects: render() cyc/voice over %.1f dry: bits +%.1f, hold +%.1f, svf +%.1f, drive +%.1f, all +%.1f;"
+           " %u voices with all = %.1f%% of budget\n",
+           full.renderCycPerVoice, perVoice[0] - full.renderCycPerVoice, perVoice[1] - full.renderCycPerVoice,
+           perVoice[2] - full.renderCycPerVoice, perVoice[3] - full.renderCycPerVoice,
+           perVoice[4] - full.renderCycPerVoice, (unsigned)ROW_COUNT,
+           100.0 * (floorCyc + perVoice[4] * ROW_COUNT) / budget);
+  }
+  printf("budget: %.0f cyc/frame; full pool of %u voices at %.1f cyc/voice + %.1f floor = %.1f%%\n",
+         budget, (unsigned)VOICE_COUNT, worstPerVoice, floorCyc,
+         100.0 * (floorCyc + worstPerVoice * VOICE_COUNT) / budget);
+  return 0;
+}
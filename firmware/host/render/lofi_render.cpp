@@ -0,0 +1,322 @@
+// Offline renderer: the real AudioEngine, driven through a gate pattern on
+// HostSim's simulated clock, with every DAC frame written to a WAV file.
+//
+// Steps land on exact frames (step k of the pattern at k * 60 * 22050 /
+// (BPM * 2) from the start, rounded), scheduled SCHEDULE_AHEAD_FRAMES out
+// and prefetched PREFETCH_CLOCKS clocks early the way handleMidi() and
+// playStep() do it, with service() once per main-loop pass. Nothing here
+// reads the wall clock, so the same arguments give the same file on every
+// run; the wall clock only prices it (the "x realtime" figure).
+//
+// A pattern is the 4 x STEPS_PER_BAR gate grid, rows A..D separated by '/',
+// one character per step: '.' off, anything else on. A gated step plays the
+// row's slice for that step, as on the pads. It repeats for --bars bars.
+//
+// --dir PATH plays the row banks in PATH (/A/source.raw + /A/slices.tbl or
+// A1..A8.raw, and so on; see the README folder layout) instead of
+// HostSeed's synthetic rows.
+//
+// --golden DIR renders the reference patterns below into DIR/<name>.wav;
+// --check DIR renders them again and exits non-zero unless every byte
+// matches. Goldens belong to the default configuration: builds with
+// VARISPEED_CUBIC or STEREO_OUT 0 sound different on purpose.
+//
+// The WAV is always two channels, A0 then A1, each DAC code scaled back to
+// 16 bits.
+//
+// Usage: lofi_render [--pattern P] [--bpm B] [--bars N] [--dir PATH]
+//                    [--rates a,b,c,d] [--pans a,b,c,d] [--fx] [--poly]
+//                    [--loop-frames N] [--out FILE]
+//        lofi_render --golden DIR | --check DIR
+#include "AudioEngine.h"
+#include "Storage.h"
+#include "HostSim.h"
+#include "HostSeed.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+extern Storage storage;
+
+namespace {
+
+AudioEngine engine;
+
+struct Render {
+  const char* name = "render";
+  const char* pattern = "x...x.../..x...x./x.x.x.x./xxxxxxxx";
+  uint32_t bpm = 140;
+  uint32_t bars = 2;
+  uint32_t loopFrames = 32; // ≈1.45 ms main loop
+  float rates[ROW_COUNT] = {1.0f, 1.0f, 1.0f, 1.0f};
+  float pans[ROW_COUNT] = {0.0f, 0.0f, 0.0f, 0.0f};
+  bool fx = false;
+  bool poly = false;
+};
+
+// What the goldens cover: choke crossfades and streaming at 1x, the
+// interpolating mixer both ways with the rows panned apart, and overlapping
+// hits through the whole effects chain.
+const Render REFERENCES[] = {
+  {"straight", "x...x.../..x...x./x.x.x.x./xxxxxxxx", 140, 2, 32,
+   {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, false, false},
+  {"varispeed", "x..x..x./.x..x..x/x.x..xx./..xx..xx", 120, 1, 32,
+   {1.5f, 0.75f, -1.0f, -2.25f}, {-0.75f, 0.75f, -0.25f, 0.25f}, false, false},
+  {"fx_poly", "xx..xx../x.x.x.x./...x...x/.xxx.xxx", 160, 1, 32,
+   {1.0f, 0.5f, 2.0f, -1.0f}, {-1.0f, 1.0f, -0.5f, 0.5f}, true, true},
+};
+
+VoiceFx::Settings fullFx() {
+  VoiceFx::Settings fx;
+  fx.bits = 8;
+  fx.hold = 3;
+  fx.filter = VoiceFx::Filter::LowPass;
+  fx.cutoffHz = 1800;
+  fx.resonance = 2.0f;
+  fx.drive = 3.0f;
+  return fx;
+}
+
+bool parseGates(const char* pattern, bool gates[ROW_COUNT][STEPS_PER_BAR]) {
+  uint8_t r = 0, c = 0;
+  for (const char* p = pattern; *p; ++p) {
+    if (*p == '/') {
+      if (c != STEPS_PER_BAR || ++r >= ROW_COUNT) return false;
+      c = 0;
+      continue;
+    }
+    if (c >= STEPS_PER_BAR) return false;
+    gates[r][c++] = *p != '.';
+  }
+  return r == ROW_COUNT - 1 && c == STEPS_PER_BAR;
+}
+
+bool parseList(const char* s, float out[ROW_COUNT]) {
+  for (uint8_t r = 0; r < ROW_COUNT; ++r) {
+    char* end = nullptr;
+    out[r] = strtof(s, &end);
+    if (end == s) return false;
+    s = end;
+    if (r + 1 < ROW_COUNT) {
+      if (*s != ',') return false;
+      ++s;
+    }
+  }
+  return *s == 0;
+}
+
+// Frame of step k from the start, exact for any tempo: no drift over a set.
+uint32_t stepFrame(const Render& r, uint32_t k) {
+  uint64_t num = (uint64_t)k * SAMPLE_RATE_HZ * 60u * BEATS_PER_BAR;
+  uint64_t den = (uint64_t)r.bpm * STEPS_PER_BAR;
+  return (uint32_t)((num + den / 2) / den);
+}
+
+// The DAC stream of one render, A0/A1 interleaved as HostSim captures it.
+bool render(const Render& r, std::vector<uint16_t>& dac) {
+  bool gates[ROW_COUNT][STEPS_PER_BAR] = {};
+  if (!parseGates(r.pattern, gates)) {
+    fprintf(stderr, "lofi_render: bad pattern \"%s\" (want %u rows of %u steps, '/' between)\n",
+            r.pattern, (unsigned)ROW_COUNT, (unsigned)STEPS_PER_BAR);
+    return false;
+  }
+  engine.begin();
+  engine.attachStorage(&storage);
+  for (uint8_t row = 0; row < ROW_COUNT; ++row) {
+    engine.setRowMode(row, r.poly ? AudioEngine::RowMode::Poly : AudioEngine::RowMode::Choke);
+    engine.setRate(row, r.rates[row]);
+    engine.setPan(row, r.pans[row]);
+    if (r.fx) engine.setFx(row, fullFx());
+  }
+
+  const uint32_t steps = r.bars * STEPS_PER_BAR;
+  // One more step's worth after the last, so its hits ring out.
+  const uint32_t lead = SCHEDULE_AHEAD_FRAMES;
+  const uint32_t total = lead + stepFrame(r, steps + 1);
+  const uint32_t prefetchFrames = (stepFrame(r, 1) * PREFETCH_CLOCKS) / CLOCKS_PER_STEP;
+
+  dac.clear();
+  dac.reserve((size_t)total * 2u);
+  engine.start();
+  HostSim::captureDac(&dac);
+  uint32_t next = 0;
+  bool prefetched = false;
+  for (uint32_t frame = 0; frame < total; frame += r.loopFrames) {
+    uint32_t now = engine.now();
+    if (next < steps) {
+      uint32_t at = lead + stepFrame(r, next);
+      uint8_t step = (uint8_t)(next % STEPS_PER_BAR);
+      if (!prefetched && now + SCHEDULE_AHEAD_FRAMES + prefetchFrames >= at) {
+        for (uint8_t row = 0; row < ROW_COUNT; ++row) {
+          if (gates[row][step]) engine.prefetch(row, sliceId(row, step));
+        }
+        prefetched = true;
+      }
+      if (now + SCHEDULE_AHEAD_FRAMES >= at) {
+        for (uint8_t row = 0; row < ROW_COUNT; ++row) {
+          if (gates[row][step]) {
+            engine.preloadAndPlay(row, sliceId(row, step), at);
+          } else {
+            engine.stopRow(row, at);
+          }
+        }
+        next++;
+        prefetched = false;
+      }
+    }
+    engine.service();
+    HostSim::tick(r.loopFrames);
+  }
+  HostSim::captureDac(nullptr);
+  engine.stop();
+  dac.resize((size_t)total * 2u);
+  return true;
+}
+
+void putLE(std::vector<uint8_t>& out, uint32_t v, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; ++i) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+// 16-bit PCM, two channels.
+std::vector<uint8_t> wavBytes(const std::vector<uint16_t>& dac) {
+  const uint32_t data = (uint32_t)dac.size() * 2u;
+  std::vector<uint8_t> out;
+  out.reserve(44 + data);
+  out.insert(out.end(), {'R', 'I', 'F', 'F'});
+  putLE(out, 36 + data, 4);
+  out.insert(out.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+  putLE(out, 16, 4);
+  putLE(out, 1, 2);                        // PCM
+  putLE(out, 2, 2);                        // A0, A1
+  putLE(out, SAMPLE_RATE_HZ, 4);
+  putLE(out, SAMPLE_RATE_HZ * 4u, 4);
+  putLE(out, 4, 2);
+  putLE(out, 16, 2);
+  out.insert(out.end(), {'d', 'a', 't', 'a'});
+  putLE(out, data, 4);
+  for (uint16_t code : dac) putLE(out, (uint32_t)(uint16_t)(int16_t)(((int32_t)code - 2048) * 16), 2);
+  return out;
+}
+
+bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+  return fclose(f) == 0 && ok;
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& bytes) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  bytes.clear();
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+double nowSeconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Renders `r` and writes it to `path`, with the speed on stdout.
+bool renderToFile(const Render& r, const std::string& path) {
+  std::vector<uint16_t> dac;
+  double t0 = nowSeconds();
+  if (!render(r, dac)) return false;
+  double took = nowSeconds() - t0;
+  if (!writeFile(path, wavBytes(dac))) {
+    fprintf(stderr, "lofi_render: cannot write %s\n", path.c_str());
+    return false;
+  }
+  double secs = (double)(dac.size() / 2) / SAMPLE_RATE_HZ;
+  printf("%s: %.2f s of audio in %.3f s (%.0fx realtime)\n", path.c_str(), secs, took,
+         took > 0.0 ? secs / took : 0.0);
+  return true;
+}
+
+// Renders `r` again and compares it byte for byte with the golden in `dir`.
+bool checkGolden(const Render& r, const std::string& dir) {
+  std::string path = dir + "/" + r.name + ".wav";
+  std::vector<uint8_t> golden;
+  if (!readFile(path, golden)) {
+    printf("check: FAIL, cannot read %s\n", path.c_str());
+    return false;
+  }
+  std::vector<uint16_t> dac;
+  if (!render(r, dac)) return false;
+  std::vector<uint8_t> now = wavBytes(dac);
+  if (now == golden) {
+    printf("check: %s matches bit for bit (%u frames)\n", r.name, (unsigned)(dac.size() / 2));
+    return true;
+  }
+  if (now.size() != golden.size()) {
+    printf("check: FAIL, %s is %u bytes, rendered %u\n", r.name, (unsigned)golden.size(), (unsigned)now.size());
+    return false;
+  }
+  size_t differ = 0, first = 0;
+  for (size_t i = 44; i < now.size(); i += 2) {
+    if (now[i] != golden[i] || now[i + 1] != golden[i + 1]) {
+      if (!differ) first = i;
+      differ++;
+    }
+  }
+  printf("check: FAIL, %s differs in %u samples (first at frame %u, %s)\n", r.name, (unsigned)differ,
+         (unsigned)((first - 44) / 4), ((first - 44) / 2) % 2 ? "A1" : "A0");
+  return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Render opt;
+  const char* dir = nullptr;
+  const char* out = "render.wav";
+  const char* golden = nullptr;
+  const char* check = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    bool ok = true;
+    if (!strcmp(argv[i], "--pattern") && i + 1 < argc) opt.pattern = argv[++i];
+    else if (!strcmp(argv[i], "--bpm") && i + 1 < argc) opt.bpm = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bars") && i + 1 < argc) opt.bars = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--dir") && i + 1 < argc) dir = argv[++i];
+    else if (!strcmp(argv[i], "--rates") && i + 1 < argc) ok = parseList(argv[++i], opt.rates);
+    else if (!strcmp(argv[i], "--pans") && i + 1 < argc) ok = parseList(argv[++i], opt.pans);
+    else if (!strcmp(argv[i], "--fx")) opt.fx = true;
+    else if (!strcmp(argv[i], "--poly")) opt.poly = true;
+    else if (!strcmp(argv[i], "--loop-frames") && i + 1 < argc) opt.loopFrames = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+    else if (!strcmp(argv[i], "--golden") && i + 1 < argc) golden = argv[++i];
+    else if (!strcmp(argv[i], "--check") && i + 1 < argc) check = argv[++i];
+    else ok = false;
+    if (!ok) {
+      fprintf(stderr, "usage: %s [--pattern P] [--bpm B] [--bars N] [--dir PATH] [--rates a,b,c,d] [--pans a,b,c,d] [--fx] [--poly] [--loop-frames N] [--out FILE]\n"
+                      "       %s --golden DIR | --check DIR\n", argv[0], argv[0]);
+      return 2;
+    }
+  }
+  if (opt.bpm == 0 || opt.bars == 0 || opt.loopFrames == 0 || opt.loopFrames >= SCHEDULE_AHEAD_FRAMES) return 2;
+
+  HostSim::reset();
+  if (dir && !golden && !check) {
+    if (!HostFS::mountDirectory(dir)) {
+      fprintf(stderr, "lofi_render: cannot use %s\n", dir);
+      return 1;
+    }
+  } else {
+    HostFS::useRamImage();
+  }
+  if (!storage.begin()) return 1;
+  if (!dir || golden || check) seedRows();
+
+  if (golden || check) {
+    bool ok = true;
+    for (const Render& r : REFERENCES) {
+      ok = (golden ? renderToFile(r, std::string(golden) + "/" + r.name + ".wav")
+                   : checkGolden(r, check)) && ok;
+    }
+    return ok ? 0 : 1;
+  }
+  return renderToFile(opt, out) ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#pragma once
+// Host stand-in for Adafruit LittleFS on QSPI. Files live in a RAM image
+// (default) or, after HostFS::mountDirectory(), in a directory on disk that is
+// loaded on open and written back on close. Every call is counted so benches
+// can report filesystem traffic next to timings.
+//
+// Data blocks are modelled on top: a file that grows takes the next free
+// block round-robin, like littlefs's allocator, and erases and programs it
+// through the lfs_config hooks, so a block device sees the erases a write
+// would cost on the board. A file's first write after reopening it relocates
+// its partly filled last block, as littlefs does. Directory metadata isn't
+// modelled, and a full disk just stops modelling (writes still land).
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+
+// The littlefs (v1) block-device interface Adafruit LittleFS mounts with.
+typedef uint32_t lfs_block_t;
+typedef uint32_t lfs_off_t;
+typedef uint32_t lfs_size_t;
+
+enum {
+  LFS_ERR_OK = 0,
+  LFS_ERR_IO = -5,
+};
+
+struct lfs_config {
+  void* context;
+  int (*read)(const lfs_config* c, lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size);
+  int (*prog)(const lfs_config* c, lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size);
+  int (*erase)(const lfs_config* c, lfs_block_t block);
+  int (*sync)(const lfs_config* c);
+  lfs_size_t read_size;
+  lfs_size_t prog_size;
+  lfs_size_t block_size;
+  lfs_size_t block_count;
+  lfs_size_t lookahead;
+  void* read_buffer;
+  void* prog_buffer;
+  void* lookahead_buffer;
+  void* file_buffer;
+};
+
+struct lfs_t {
+  const lfs_config* cfg = nullptr;
+};
+
+// Calls cb for every block in use: the superblock pair and file data.
+int lfs_traverse(lfs_t* lfs, int (*cb)(void*, lfs_block_t), void* data);
+
+namespace Adafruit_LittleFS_Namespace {
+
+enum : uint8_t {
+  FILE_O_READ     = 0x00,
+  FILE_O_WRITE    = 0x01,
+  FILE_O_TRUNCATE = 0x02,
+  FILE_O_CREAT    = 0x04,
+};
+
+struct HostNode;
+
+class File {
+public:
+  File() {}
+  File(std::shared_ptr<HostNode> node, uint8_t mode);
+
+  explicit operator bool() const { return node != nullptr; }
+  bool isOpen() const { return node != nullptr; }
+
+  uint32_t size() const;
+  uint32_t position() const { return pos; }
+  uint32_t available() const;
+  bool seek(uint32_t position);
+  // Matches the library: one read is capped at a 16-bit byte count.
+  int read(void* buf, uint16_t nbyte);
+  size_t write(const uint8_t* buf, size_t size);
+  void flush();
+  void close();
+
+private:
+  std::shared_ptr<HostNode> node;
+  uint32_t pos = 0;
+  uint8_t  mode = FILE_O_READ;
+  bool     writing = false;   // written since open (no relocation due)
+};
+
+} // namespace Adafruit_LittleFS_Namespace
+
+class Adafruit_LittleFS {
+public:
+  explicit Adafruit_LittleFS(lfs_config* cfg) : config(cfg) {}
+  // One filesystem at a time: begin() and format() make this the one whose
+  // hooks see block traffic.
+  bool begin(lfs_config* cfg = nullptr);
+  bool format();
+  Adafruit_LittleFS_Namespace::File open(const char* path, uint8_t mode = Adafruit_LittleFS_Namespace::FILE_O_READ);
+  bool exists(const char* path);
+  bool mkdir(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+  lfs_t* _getFS() { return &fs; }
+
+private:
+  lfs_config* config;
+  lfs_t fs;
+};
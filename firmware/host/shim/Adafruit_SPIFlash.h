@@ -0,0 +1,43 @@
+#pragma once
+// Host stand-in for Adafruit_SPIFlash. The raw flash array is an mmap'd
+// region (anonymous by default, or a file via HostFlash::mapFile) so the
+// sample bank can hand out pointers into it the way QSPI XIP does on the
+// board. Erase sets bytes to 0xFF and programming can only clear bits, same
+// as NOR flash. LittleFS has its own stand-in and does not live in here.
+#include <Arduino.h>
+
+class Adafruit_FlashTransport_QSPI {};
+
+class Adafruit_SPIFlash {
+public:
+  static constexpr uint32_t SECTOR_BYTES = 4096;
+
+  explicit Adafruit_SPIFlash(Adafruit_FlashTransport_QSPI*) {}
+  bool begin();
+  uint32_t size() const;
+  bool eraseSector(uint32_t sectorNumber);
+  uint32_t writeBuffer(uint32_t address, const uint8_t* buffer, uint32_t len);
+  uint32_t readBuffer(uint32_t address, uint8_t* buffer, uint32_t len);
+  bool waitUntilReady() { return true; }
+};
+
+namespace HostFlash {
+
+struct Stats {
+  uint32_t sectorErases = 0;
+  uint32_t pagePrograms = 0;
+  uint64_t bytesProgrammed = 0;
+};
+
+// Back the flash array with a file (created/extended to `bytes`). Must be
+// called before Adafruit_SPIFlash::begin(); otherwise an anonymous map is used.
+bool mapFile(const char* path, uint32_t bytes = 8u * 1024u * 1024u);
+void unmap();
+
+// Start of the flash array in host memory: the XIP window stand-in.
+const uint8_t* xipBase();
+
+const Stats& stats();
+void resetStats();
+
+} // namespace HostFlash
@@ -0,0 +1,76 @@
+#pragma once
+// Host stand-in for Adafruit_ZeroDMA, limited to what the DAC ping-pong and
+// the ADC capture need: a looped descriptor chain, one beat per trigger, and
+// a callback at the end of each block. HostSim::tick() issues the TC3
+// trigger once per sample period while that timer is enabled, and an ADC
+// result-ready trigger for each conversion a timer starts.
+#include <Arduino.h>
+#include <deque>
+
+enum ZeroDMAstatus { DMA_STATUS_OK = 0, DMA_STATUS_ERR_NOT_FOUND, DMA_STATUS_ERR_NOT_INITIALIZED };
+enum dma_beat_size { DMA_BEAT_SIZE_BYTE = 0, DMA_BEAT_SIZE_HWORD, DMA_BEAT_SIZE_WORD };
+enum dma_transfer_trigger_action { DMA_TRIGGER_ACTON_BLOCK = 0, DMA_TRIGGER_ACTON_BEAT = 2, DMA_TRIGGER_ACTON_TRANSACTION = 3 };
+enum dma_callback_type { DMA_CALLBACK_TRANSFER_DONE = 0 };
+enum dma_block_action { DMA_BLOCK_ACTION_NOACT = 0, DMA_BLOCK_ACTION_INT = 1 };
+
+// The triggers HostSim knows how to issue (SAMD51 numbering).
+static const uint8_t TC3_DMAC_ID_OVF     = 0x1C;
+static const uint8_t ADC0_DMAC_ID_RESRDY = 0x44;
+static const uint8_t ADC1_DMAC_ID_RESRDY = 0x46;
+
+struct DmacDescriptor {
+  union {
+    struct {
+      uint16_t VALID : 1;
+      uint16_t EVOSEL : 2;
+      uint16_t BLOCKACT : 2;
+      uint16_t : 3;
+      uint16_t BEATSIZE : 2;
+      uint16_t SRCINC : 1;
+      uint16_t DSTINC : 1;
+      uint16_t STEPSEL : 1;
+      uint16_t STEPSIZE : 3;
+    } bit;
+    uint16_t reg;
+  } BTCTRL;
+  uint16_t BTCNT;
+};
+
+class Adafruit_ZeroDMA;
+typedef void (*dma_callback_t)(Adafruit_ZeroDMA*);
+
+class Adafruit_ZeroDMA {
+public:
+  ZeroDMAstatus allocate() { return DMA_STATUS_OK; }
+  void setTrigger(uint8_t trigger) { trig = trigger; }
+  void setAction(dma_transfer_trigger_action a) { action = a; }
+  DmacDescriptor* addDescriptor(void* src, void* dst, uint32_t count,
+                                dma_beat_size size = DMA_BEAT_SIZE_BYTE,
+                                bool srcInc = true, bool dstInc = true);
+  void loop(bool on) { looping = on; }
+  void setCallback(dma_callback_t cb, dma_callback_type = DMA_CALLBACK_TRANSFER_DONE) { callback = cb; }
+  ZeroDMAstatus startJob();
+  void abort();
+
+  // HostSim hook: one trigger → one beat, if it's the channel's trigger.
+  void hostBeat(uint8_t trigger);
+
+private:
+  struct Entry {
+    DmacDescriptor desc;
+    uint8_t* src;
+    uint8_t* dst;
+    uint32_t count;
+    uint8_t beatBytes;
+    bool srcInc;
+    bool dstInc;
+  };
+  std::deque<Entry> chain; // deque: descriptor pointers stay valid
+  size_t cur = 0;
+  uint32_t beat = 0;
+  uint8_t trig = 0;
+  dma_transfer_trigger_action action = DMA_TRIGGER_ACTON_BEAT;
+  bool looping = false;
+  bool active = false;
+  dma_callback_t callback = nullptr;
+};
@@ -0,0 +1,28 @@
+#pragma once
+// Host stand-in for Adafruit_ZeroTimer. Nothing free-runs: HostSim::tick()
+// fires every enabled timer once per simulated sample period (the sketch
+// only ever runs them at SAMPLE_RATE_HZ), in the order they were set up.
+#include <Arduino.h>
+
+typedef void (*tc_callback_t)(void);
+
+enum tc_clock_prescaler { TC_CLOCK_PRESCALER_DIV1 = 0 };
+enum tc_counter_size { TC_COUNTER_SIZE_16BIT = 0 };
+enum tc_wave_generation { TC_WAVE_GENERATION_MATCH_FREQ = 0 };
+enum tc_callback { TC_CALLBACK_CC_CHANNEL0 = 0 };
+
+class Adafruit_ZeroTimer {
+public:
+  explicit Adafruit_ZeroTimer(uint8_t tc) : tcNum(tc) {}
+  void configure(tc_clock_prescaler, tc_counter_size, tc_wave_generation) {}
+  void setCompare(uint8_t, uint32_t value) { compare = value; }
+  void setCallback(bool enable, tc_callback, tc_callback_t cb);
+  void enable(bool on);
+
+  uint8_t  timerNumber() const { return tcNum; }
+  uint32_t compareValue() const { return compare; }
+
+private:
+  uint8_t  tcNum;
+  uint32_t compare = 0;
+};
@@ -0,0 +1,117 @@
+#pragma once
+// Host stand-in for the bits of the Arduino SAMD core the sketch actually
+// touches. Just enough surface to compile AudioEngine/Storage/Slicer/Recorder
+// on Linux; timing, DAC and ADC are routed through HostSim so benches stay
+// deterministic.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#ifndef F_CPU
+#define F_CPU 120000000UL
+#endif
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+enum : uint8_t { A0 = 14, A1, A2, A3, A4, A5 };
+enum : uint8_t { INPUT = 0, OUTPUT = 1, INPUT_PULLUP = 2 };
+enum : uint8_t { AR_DEFAULT = 0, AR_INTERNAL1V0, AR_EXTERNAL };
+
+// ---------- Pins / DAC / ADC ----------
+void pinMode(uint8_t pin, uint8_t mode);
+void analogWriteResolution(int bits);
+void analogWrite(uint8_t pin, int value);
+void analogReadResolution(int bits);
+void analogReadAveraging(uint32_t samples);
+void analogReference(uint8_t mode);
+int  analogRead(uint8_t pin);
+
+// The SAMD51 DAC data registers, so DMA descriptors can target
+// &DAC->DATA[n].reg exactly as on the board. analogWrite() lands here too.
+struct HostDacRegs {
+  struct { volatile uint16_t reg; } DATA[2];
+};
+extern HostDacRegs HostDac;
+#define DAC (&HostDac)
+
+// ADC result registers, the source address for DMA capture. A timer routed
+// with HostSim::routeTimerToAdc() converts into ADC0 once per tick.
+struct HostAdcRegs {
+  struct { volatile uint16_t reg; } RESULT;
+};
+extern HostAdcRegs HostAdc0;
+extern HostAdcRegs HostAdc1;
+#define ADC0 (&HostAdc0)
+#define ADC1 (&HostAdc1)
+
+// ---------- Time ----------
+uint32_t millis();
+uint32_t micros();
+void     delay(uint32_t ms);
+
+// ---------- Interrupt masking ----------
+// The host runs the "ISR" on the same thread as service(), so masking is a
+// no-op; HostSim only fires ticks between foreground calls.
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// ---------- Flash strings ----------
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+// ---------- String ----------
+class String {
+public:
+  String() {}
+  String(const char* s) : str(s ? s : "") {}
+  String(char c) : str(1, c) {}
+  String(int v) : str(std::to_string(v)) {}
+  String(unsigned int v) : str(std::to_string(v)) {}
+  String(long v) : str(std::to_string(v)) {}
+  String(unsigned long v) : str(std::to_string(v)) {}
+
+  String& operator+=(const String& o) { str += o.str; return *this; }
+  String& operator+=(const char* s) { str += (s ? s : ""); return *this; }
+  String& operator+=(char c) { str += c; return *this; }
+
+  friend String operator+(String a, const String& b) { a += b; return a; }
+  friend String operator+(String a, const char* b) { a += b; return a; }
+  friend String operator+(String a, char b) { a += b; return a; }
+
+  const char* c_str() const { return str.c_str(); }
+  unsigned int length() const { return (unsigned int)str.size(); }
+
+private:
+  std::string str;
+};
+
+// ---------- Serial ----------
+// Silent unless HostSim::setSerialEcho(true); the firmware's diagnostics still
+// run so their cost shows up in the bench.
+class HostSerial {
+public:
+  void begin(unsigned long) {}
+  operator bool() const { return true; }
+  size_t print(const __FlashStringHelper* s);
+  size_t print(const char* s);
+  size_t print(char c);
+  size_t print(int v);
+  size_t print(unsigned int v);
+  size_t print(long v);
+  size_t print(unsigned long v);
+  size_t print(double v);
+  size_t println();
+  template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  size_t write(const uint8_t* buf, size_t len);
+  // Nothing ever arrives on the host.
+  int available() { return 0; }
+  int read() { return -1; }
+};
+
+extern HostSerial Serial;
+#define SERIAL_PORT_MONITOR Serial
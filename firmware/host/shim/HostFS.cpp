@@ -0,0 +1,334 @@
+#include "HostSim.h"
+#include "Config.h"
+#include <Adafruit_LittleFS.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <errno.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+namespace Adafruit_LittleFS_Namespace {
+struct HostNode {
+  std::string path;
+  std::vector<uint8_t> data;
+  std::vector<lfs_block_t> blocks;   // modelled data blocks, in file order
+  bool dirty = false;
+};
+} // namespace Adafruit_LittleFS_Namespace
+
+namespace {
+std::map<std::string, std::shared_ptr<HostNode>> s_nodes;
+std::set<std::string> s_dirs;
+std::string s_root; // empty = RAM image
+HostFS::Stats s_stats;
+uint32_t s_readUs = 0;
+uint32_t s_readUsPerKiB = 0;
+uint64_t s_readDebt = 0;   // us * 1024 * SAMPLE_RATE_HZ not yet ticked off
+
+void chargeRead(uint32_t bytes) {
+  if (!s_readUs && !s_readUsPerKiB) return;
+  s_readDebt += ((uint64_t)s_readUs * 1024u + (uint64_t)s_readUsPerKiB * bytes) * SAMPLE_RATE_HZ;
+  const uint64_t perFrame = 1024ull * 1000000ull;
+  uint32_t frames = (uint32_t)(s_readDebt / perFrame);
+  s_readDebt %= perFrame;
+  if (frames) HostSim::tick(frames);
+}
+
+// ---------- Block model ----------
+const lfs_config* s_cfg = nullptr;   // the mounted filesystem's
+std::vector<bool> s_used;
+uint32_t s_next = 0;                 // allocator cursor
+
+bool allocBlock(lfs_block_t& out) {
+  uint32_t n = (uint32_t)s_used.size();
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t b = (s_next + i) % n;
+    if (s_used[b]) continue;
+    s_used[b] = true;
+    s_next = (b + 1) % n;
+    out = b;
+    return true;
+  }
+  return false;
+}
+
+void freeBlocks(HostNode& node) {
+  for (lfs_block_t b : node.blocks) {
+    if (b < s_used.size()) s_used[b] = false;
+  }
+  node.blocks.clear();
+}
+
+// Blocks for a file that is already on flash: no erase, no program.
+void placeBlocks(HostNode& node) {
+  if (!s_cfg) return;
+  while ((uint64_t)node.blocks.size() * s_cfg->block_size < node.data.size()) {
+    lfs_block_t b;
+    if (!allocBlock(b)) return;
+    node.blocks.push_back(b);
+  }
+}
+
+// What littlefs does to the block device for `len` bytes written at pos:
+// relocate a partly filled last block on the first write since open, take
+// and erase a block for each one the file grows into, program the bytes.
+void writeBlocks(HostNode& node, uint32_t pos, uint32_t len, bool& writing) {
+  if (!s_cfg || !len) return;
+  const uint32_t bs = s_cfg->block_size;
+  const uint8_t* data = node.data.data();
+  if (!writing && pos % bs && pos / bs < node.blocks.size()) {
+    lfs_block_t& last = node.blocks[pos / bs];
+    lfs_block_t b;
+    if (allocBlock(b)) {
+      s_used[last] = false;
+      last = b;
+      s_cfg->erase(s_cfg, b);
+      s_cfg->prog(s_cfg, b, 0, data + (pos / bs) * bs, pos % bs);
+    }
+  }
+  writing = true;
+  uint32_t end = pos + len;
+  while ((uint64_t)node.blocks.size() * bs < end) {
+    lfs_block_t b;
+    if (!allocBlock(b)) break;
+    s_cfg->erase(s_cfg, b);
+    node.blocks.push_back(b);
+  }
+  for (uint32_t at = pos; at < end; ) {
+    uint32_t idx = at / bs;
+    if (idx >= node.blocks.size()) break;
+    uint32_t off = at % bs;
+    uint32_t n = std::min(bs - off, end - at);
+    s_cfg->prog(s_cfg, node.blocks[idx], off, data + at, n);
+    at += n;
+  }
+}
+
+void resetBlocks(const lfs_config* cfg) {
+  s_cfg = cfg;
+  s_used.assign(cfg ? cfg->block_count : 0, false);
+  // The superblock pair.
+  for (uint32_t b = 0; b < 2 && b < s_used.size(); ++b) s_used[b] = true;
+  s_next = s_used.size() > 2 ? 2 : 0;
+  for (auto& kv : s_nodes) {
+    kv.second->blocks.clear();
+    placeBlocks(*kv.second);
+  }
+}
+
+std::string diskPath(const std::string& path) { return s_root + path; }
+
+bool loadFromDisk(const std::string& path, std::shared_ptr<HostNode>& out) {
+  FILE* f = fopen(diskPath(path).c_str(), "rb");
+  if (!f) return false;
+  out = std::make_shared<HostNode>();
+  out->path = path;
+  uint8_t tmp[4096];
+  size_t n;
+  while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) out->data.insert(out->data.end(), tmp, tmp + n);
+  fclose(f);
+  placeBlocks(*out);
+  return true;
+}
+
+void flushToDisk(HostNode& node) {
+  if (s_root.empty() || !node.dirty) return;
+  FILE* f = fopen(diskPath(node.path).c_str(), "wb");
+  if (!f) return;
+  if (!node.data.empty()) fwrite(node.data.data(), 1, node.data.size(), f);
+  fclose(f);
+  node.dirty = false;
+}
+
+std::shared_ptr<HostNode> findNode(const std::string& path) {
+  auto it = s_nodes.find(path);
+  if (it != s_nodes.end()) return it->second;
+  std::shared_ptr<HostNode> node;
+  if (!s_root.empty() && loadFromDisk(path, node)) {
+    s_nodes[path] = node;
+    return node;
+  }
+  return nullptr;
+}
+} // namespace
+
+// ---------- HostFS ----------
+void HostFS::useRamImage() {
+  s_nodes.clear();
+  s_dirs.clear();
+  s_root.clear();
+  resetBlocks(s_cfg);
+  resetStats();
+}
+
+bool HostFS::mountDirectory(const char* root) {
+  useRamImage();
+  if (!root || !root[0]) return false;
+  s_root = root;
+  while (s_root.size() > 1 && s_root.back() == '/') s_root.pop_back();
+  if (::mkdir(s_root.c_str(), 0755) != 0 && errno != EEXIST) {
+    s_root.clear();
+    return false;
+  }
+  return true;
+}
+
+const HostFS::Stats& HostFS::stats() { return s_stats; }
+
+void HostFS::setReadCost(uint32_t usPerRead, uint32_t usPerKiB) {
+  s_readUs = usPerRead;
+  s_readUsPerKiB = usPerKiB;
+  s_readDebt = 0;
+}
+void HostFS::resetStats() { s_stats = Stats(); }
+
+// ---------- File ----------
+File::File(std::shared_ptr<HostNode> n, uint8_t m) : node(std::move(n)), mode(m) {}
+
+uint32_t File::size() const { return node ? (uint32_t)node->data.size() : 0; }
+
+uint32_t File::available() const {
+  uint32_t sz = size();
+  return pos < sz ? sz - pos : 0;
+}
+
+bool File::seek(uint32_t position) {
+  if (!node) return false;
+  s_stats.seeks++;
+  if (position > node->data.size()) return false;
+  pos = position;
+  return true;
+}
+
+int File::read(void* buf, uint16_t nbyte) {
+  if (!node) return -1;
+  s_stats.reads++;
+  uint32_t n = available();
+  if (n > nbyte) n = nbyte;
+  if (n) memcpy(buf, node->data.data() + pos, n);
+  pos += n;
+  s_stats.bytesRead += n;
+  chargeRead(n);
+  return (int)n;
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+  if (!node || !(mode & FILE_O_WRITE)) return 0;
+  s_stats.writes++;
+  if (pos + len > node->data.size()) node->data.resize(pos + len);
+  if (len) memcpy(node->data.data() + pos, buf, len);
+  writeBlocks(*node, pos, (uint32_t)len, writing);
+  pos += (uint32_t)len;
+  node->dirty = true;
+  s_stats.bytesWritten += len;
+  return len;
+}
+
+void File::flush() {
+  if (node) flushToDisk(*node);
+}
+
+void File::close() {
+  if (!node) return;
+  s_stats.closes++;
+  flushToDisk(*node);
+  node.reset();
+  pos = 0;
+  writing = false;
+}
+
+// ---------- Adafruit_LittleFS ----------
+int lfs_traverse(lfs_t* lfs, int (*cb)(void*, lfs_block_t), void* data) {
+  if (!lfs || !lfs->cfg || lfs->cfg != s_cfg) return LFS_ERR_IO;
+  for (lfs_block_t b = 0; b < 2 && b < s_used.size(); ++b) {
+    int err = cb(data, b);
+    if (err) return err;
+  }
+  for (auto& kv : s_nodes) {
+    for (lfs_block_t b : kv.second->blocks) {
+      int err = cb(data, b);
+      if (err) return err;
+    }
+  }
+  return 0;
+}
+
+bool Adafruit_LittleFS::begin(lfs_config* cfg) {
+  if (cfg) config = cfg;
+  fs.cfg = config;
+  resetBlocks(config);
+  return true;
+}
+
+bool Adafruit_LittleFS::format() {
+  s_nodes.clear();
+  s_dirs.clear();
+  fs.cfg = config;
+  resetBlocks(config);
+  return true;
+}
+// ---------- LittleFS_QSPIFlash ----------
+File Adafruit_LittleFS::open(const char* path, uint8_t mode) {
+  if (!path) return File();
+  s_stats.opens++;
+  std::string p(path);
+  std::shared_ptr<HostNode> node = findNode(p);
+  if (!node) {
+    if (!(mode & FILE_O_WRITE)) return File();
+    node = std::make_shared<HostNode>();
+    node->path = p;
+    node->dirty = true;
+    s_nodes[p] = node;
+  }
+  File f(node, mode);
+  if (mode & FILE_O_WRITE) {
+    if (mode & FILE_O_TRUNCATE) {
+      node->data.clear();
+      freeBlocks(*node);
+      node->dirty = true;
+    } else {
+      f.seek((uint32_t)node->data.size()); // library appends by default
+    }
+  }
+  return f;
+}
+
+bool Adafruit_LittleFS::exists(const char* path) {
+  if (!path) return false;
+  return findNode(path) != nullptr || s_dirs.count(path) != 0;
+}
+
+bool Adafruit_LittleFS::mkdir(const char* path) {
+  if (!path) return false;
+  s_dirs.insert(path);
+  if (!s_root.empty()) ::mkdir(diskPath(path).c_str(), 0755);
+  return true;
+}
+
+bool Adafruit_LittleFS::remove(const char* path) {
+  if (!path) return false;
+  s_stats.removes++;
+  std::shared_ptr<HostNode> node = findNode(path);
+  if (node) freeBlocks(*node);
+  s_nodes.erase(path);
+  if (!s_root.empty()) ::remove(diskPath(path).c_str());
+  return node != nullptr;
+}
+
+bool Adafruit_LittleFS::rename(const char* from, const char* to) {
+  if (!from || !to) return false;
+  std::shared_ptr<HostNode> node = findNode(from);
+  if (!node) return false;
+  s_nodes.erase(from);
+  node->path = to;
+  node->dirty = true;
+  s_nodes[to] = node;
+  if (!s_root.empty()) {
+    ::remove(diskPath(from).c_str());
+    flushToDisk(*node);
+  }
+  return true;
+}
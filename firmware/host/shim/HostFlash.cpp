@@ -0,0 +1,87 @@
+#include <Adafruit_SPIFlash.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+uint8_t* s_base = nullptr;
+uint32_t s_size = 0;
+int s_fd = -1;
+HostFlash::Stats s_stats;
+const uint32_t PAGE_BYTES = 256;
+
+bool mapAnonymous(uint32_t bytes) {
+  void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return false;
+  s_base = (uint8_t*)p;
+  s_size = bytes;
+  memset(s_base, 0xFF, bytes); // factory-fresh NOR reads as erased
+  return true;
+}
+} // namespace
+
+bool HostFlash::mapFile(const char* path, uint32_t bytes) {
+  unmap();
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return false;
+  off_t cur = lseek(fd, 0, SEEK_END);
+  if (cur < (off_t)bytes) {
+    // Extend with 0xFF so new space looks erased, not zeroed.
+    uint8_t ff[PAGE_BYTES];
+    memset(ff, 0xFF, sizeof(ff));
+    while (cur < (off_t)bytes) {
+      size_t n = (size_t)((off_t)bytes - cur);
+      if (n > sizeof(ff)) n = sizeof(ff);
+      if (write(fd, ff, n) != (ssize_t)n) { close(fd); return false; }
+      cur += (off_t)n;
+    }
+  }
+  void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) { close(fd); return false; }
+  s_base = (uint8_t*)p;
+  s_size = bytes;
+  s_fd = fd;
+  return true;
+}
+
+void HostFlash::unmap() {
+  if (s_base) munmap(s_base, s_size);
+  if (s_fd >= 0) close(s_fd);
+  s_base = nullptr;
+  s_size = 0;
+  s_fd = -1;
+}
+
+const uint8_t* HostFlash::xipBase() { return s_base; }
+const HostFlash::Stats& HostFlash::stats() { return s_stats; }
+void HostFlash::resetStats() { s_stats = Stats(); }
+
+bool Adafruit_SPIFlash::begin() {
+  return s_base != nullptr || mapAnonymous(8u * 1024u * 1024u);
+}
+
+uint32_t Adafruit_SPIFlash::size() const { return s_size; }
+
+bool Adafruit_SPIFlash::eraseSector(uint32_t sectorNumber) {
+  uint32_t addr = sectorNumber * SECTOR_BYTES;
+  if (!s_base || addr + SECTOR_BYTES > s_size) return false;
+  memset(s_base + addr, 0xFF, SECTOR_BYTES);
+  s_stats.sectorErases++;
+  return true;
+}
+
+uint32_t Adafruit_SPIFlash::writeBuffer(uint32_t address, const uint8_t* buffer, uint32_t len) {
+  if (!s_base || address + len > s_size) return 0;
+  for (uint32_t i = 0; i < len; ++i) s_base[address + i] &= buffer[i];
+  uint32_t firstPage = address / PAGE_BYTES;
+  uint32_t lastPage = len ? (address + len - 1) / PAGE_BYTES : firstPage;
+  s_stats.pagePrograms += len ? (lastPage - firstPage + 1) : 0;
+  s_stats.bytesProgrammed += len;
+  return len;
+}
+
+uint32_t Adafruit_SPIFlash::readBuffer(uint32_t address, uint8_t* buffer, uint32_t len) {
+  if (!s_base || address + len > s_size) return 0;
+  memcpy(buffer, s_base + address, len);
+  return len;
+}
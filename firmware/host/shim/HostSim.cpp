@@ -0,0 +1,175 @@
+#include "HostSim.h"
+#include "Config.h"
+#include <Adafruit_ZeroTimer.h>
+#include <Adafruit_ZeroDMA.h>
+#include <algorithm>
+
+HostSerial Serial;
+HostDacRegs HostDac = {{{2048}, {2048}}};
+HostAdcRegs HostAdc0 = {{2048}};
+HostAdcRegs HostAdc1 = {{2048}};
+
+namespace {
+struct Timer {
+  uint8_t tc;
+  tc_callback_t cb;
+  bool on;
+  int adcPin;   // routeTimerToAdc(), -1 if none
+};
+
+uint64_t s_frames = 0;
+uint64_t s_extraMicros = 0;
+std::vector<Timer> s_timers;          // in set-up order
+std::vector<Adafruit_ZeroDMA*> s_dma; // channels with a running job
+std::vector<uint16_t>* s_capture = nullptr;
+HostSim::AnalogSource s_analog = nullptr;
+bool s_echo = false;
+
+uint64_t nowMicros() {
+  return (s_frames * 1000000ull) / SAMPLE_RATE_HZ + s_extraMicros;
+}
+
+Timer& timerFor(uint8_t tc) {
+  for (Timer& t : s_timers) {
+    if (t.tc == tc) return t;
+  }
+  s_timers.push_back(Timer{tc, nullptr, false, -1});
+  return s_timers.back();
+}
+
+void beat(uint8_t trigger) {
+  // A callback may abort/start jobs; index rather than iterate.
+  for (size_t c = 0; c < s_dma.size(); ++c) s_dma[c]->hostBeat(trigger);
+}
+} // namespace
+
+// ---------- HostSim ----------
+void HostSim::reset() {
+  s_frames = 0;
+  s_extraMicros = 0;
+  HostDac.DATA[0].reg = HostDac.DATA[1].reg = 2048;
+  s_capture = nullptr;
+  s_analog = nullptr;
+}
+
+void HostSim::tick(uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    for (size_t k = 0; k < s_timers.size(); ++k) {
+      const Timer t = s_timers[k];   // a callback may set up another timer
+      if (!t.on) continue;
+      // TC3 match: the ISR callback (per-sample mode) and the DMA trigger
+      // (block mode) both hang off the same timer event.
+      if (t.cb) t.cb();
+      if (t.tc == 3) beat(TC3_DMAC_ID_OVF);
+      if (t.adcPin >= 0) {
+        HostAdc0.RESULT.reg = (uint16_t)analogRead((uint8_t)t.adcPin);
+        beat(ADC0_DMAC_ID_RESRDY);
+      }
+    }
+    if (s_capture) {
+      s_capture->push_back((uint16_t)HostDac.DATA[0].reg);
+      s_capture->push_back((uint16_t)HostDac.DATA[1].reg);
+    }
+    ++s_frames;
+  }
+}
+
+void HostSim::advanceMicros(uint32_t us) { s_extraMicros += us; }
+uint64_t HostSim::frames() { return s_frames; }
+bool HostSim::timerEnabled() { return timerFor(3).on; }
+uint16_t HostSim::dacValue(uint8_t pin) { return HostDac.DATA[pin == DAC_PIN_R ? 1 : 0].reg; }
+void HostSim::captureDac(std::vector<uint16_t>* out) { s_capture = out; }
+void HostSim::setAnalogSource(AnalogSource src) { s_analog = src; }
+void HostSim::routeTimerToAdc(uint8_t tc, int pin) { timerFor(tc).adcPin = pin; }
+void HostSim::setSerialEcho(bool on) { s_echo = on; }
+bool HostSim::serialEcho() { return s_echo; }
+
+// ---------- Arduino core ----------
+void pinMode(uint8_t, uint8_t) {}
+void analogWriteResolution(int) {}
+void analogReadResolution(int) {}
+void analogReadAveraging(uint32_t) {}
+void analogReference(uint8_t) {}
+
+void analogWrite(uint8_t pin, int value) {
+  HostDac.DATA[(pin == DAC_PIN_R) ? 1 : 0].reg = (uint16_t)value;
+}
+
+int analogRead(uint8_t pin) {
+  return s_analog ? s_analog(pin, s_frames) : 2048;
+}
+
+uint32_t micros() { return (uint32_t)nowMicros(); }
+uint32_t millis() { return (uint32_t)(nowMicros() / 1000ull); }
+void delay(uint32_t ms) { s_extraMicros += (uint64_t)ms * 1000ull; }
+
+// ---------- ZeroTimer ----------
+void Adafruit_ZeroTimer::setCallback(bool en, tc_callback, tc_callback_t cb) {
+  timerFor(tcNum).cb = en ? cb : nullptr;
+}
+
+void Adafruit_ZeroTimer::enable(bool on) { timerFor(tcNum).on = on; }
+
+// ---------- Serial ----------
+size_t HostSerial::print(const __FlashStringHelper* s) { return print(reinterpret_cast<const char*>(s)); }
+size_t HostSerial::print(const char* s) { return s_echo ? (size_t)fputs(s, stderr) : strlen(s); }
+size_t HostSerial::print(char c) { if (s_echo) fputc(c, stderr); return 1; }
+size_t HostSerial::print(int v) { return s_echo ? (size_t)fprintf(stderr, "%d", v) : 1; }
+size_t HostSerial::print(unsigned int v) { return s_echo ? (size_t)fprintf(stderr, "%u", v) : 1; }
+size_t HostSerial::print(long v) { return s_echo ? (size_t)fprintf(stderr, "%ld", v) : 1; }
+size_t HostSerial::print(unsigned long v) { return s_echo ? (size_t)fprintf(stderr, "%lu", v) : 1; }
+size_t HostSerial::print(double v) { return s_echo ? (size_t)fprintf(stderr, "%.2f", v) : 1; }
+size_t HostSerial::println() { if (s_echo) fputc('\n', stderr); return 1; }
+size_t HostSerial::write(const uint8_t* buf, size_t len) { return s_echo ? fwrite(buf, 1, len, stderr) : len; }
+
+// ---------- ZeroDMA ----------
+DmacDescriptor* Adafruit_ZeroDMA::addDescriptor(void* src, void* dst, uint32_t count,
+                                                dma_beat_size size, bool srcInc, bool dstInc) {
+  Entry e;
+  memset(&e.desc, 0, sizeof(e.desc));
+  e.desc.BTCTRL.bit.VALID = 1;
+  e.desc.BTCTRL.bit.BEATSIZE = size;
+  e.desc.BTCNT = (uint16_t)count;
+  e.src = (uint8_t*)src;
+  e.dst = (uint8_t*)dst;
+  e.count = count;
+  e.beatBytes = (uint8_t)(1u << size);
+  e.srcInc = srcInc;
+  e.dstInc = dstInc;
+  chain.push_back(e);
+  return &chain.back().desc;
+}
+
+ZeroDMAstatus Adafruit_ZeroDMA::startJob() {
+  if (chain.empty()) return DMA_STATUS_ERR_NOT_INITIALIZED;
+  cur = 0;
+  beat = 0;
+  active = true;
+  if (std::find(s_dma.begin(), s_dma.end(), this) == s_dma.end()) s_dma.push_back(this);
+  return DMA_STATUS_OK;
+}
+
+void Adafruit_ZeroDMA::abort() {
+  active = false;
+  s_dma.erase(std::remove(s_dma.begin(), s_dma.end(), this), s_dma.end());
+}
+
+void Adafruit_ZeroDMA::hostBeat(uint8_t trigger) {
+  if (!active || trig != trigger || chain.empty()) return;
+  Entry& e = chain[cur];
+  const uint8_t* s = e.src + (e.srcInc ? beat * e.beatBytes : 0);
+  uint8_t* d = e.dst + (e.dstInc ? beat * e.beatBytes : 0);
+  memcpy(d, s, e.beatBytes);
+  if (++beat < e.count) return;
+
+  beat = 0;
+  bool interrupt = e.desc.BTCTRL.bit.BLOCKACT == DMA_BLOCK_ACTION_INT;
+  bool last = (cur + 1 == chain.size());
+  if (last && !looping) {
+    active = false;
+  } else {
+    cur = last ? 0 : cur + 1;
+  }
+  // Block-end interrupt, or the end of a non-looping transfer.
+  if (callback && (interrupt || !active)) callback(this);
+}
@@ -0,0 +1,72 @@
+#pragma once
+// Deterministic stand-in for the board's clocks and analog pins.
+//
+// Time only moves when a driver calls tick(): each tick is one 22.05 kHz
+// sample period, advances micros()/millis(), and fires the ZeroTimer callback
+// if the engine enabled it. Foreground work (service(), UI) is "free" unless
+// the driver charges it with advanceMicros().
+#include <Arduino.h>
+#include <vector>
+
+namespace HostSim {
+
+typedef int (*AnalogSource)(uint8_t pin, uint64_t frame);
+
+void reset();
+
+// Run `frames` sample periods, firing the timer ISR once per period.
+void tick(uint32_t frames = 1);
+// Charge foreground time to the clock without firing the ISR.
+void advanceMicros(uint32_t us);
+
+uint64_t frames();
+// Whether the engine's timer (TC3) is running.
+bool timerEnabled();
+
+// Latest value written to a DAC pin (12-bit, 0..4095).
+uint16_t dacValue(uint8_t pin);
+// Append both DAC channels to `out` every frame, left then right (nullptr
+// to stop capturing).
+void captureDac(std::vector<uint16_t>* out);
+
+// Feed analogRead(); default is a mid-rail 2048.
+void setAnalogSource(AnalogSource src);
+
+// Stand-in for TCn overflow → EVSYS → ADC start: while timer `tc` is
+// enabled, every tick converts `pin` into ADC0->RESULT and issues
+// ADC0_DMAC_ID_RESRDY. Pass pin -1 to unroute.
+void routeTimerToAdc(uint8_t tc, int pin);
+
+void setSerialEcho(bool on);
+bool serialEcho();
+
+} // namespace HostSim
+
+namespace HostFS {
+
+struct Stats {
+  uint32_t opens = 0;
+  uint32_t closes = 0;
+  uint32_t seeks = 0;
+  uint32_t reads = 0;
+  uint64_t bytesRead = 0;
+  uint32_t writes = 0;
+  uint64_t bytesWritten = 0;
+  uint32_t removes = 0;
+};
+
+// Drop every file and go back to the RAM image.
+void useRamImage();
+// Back the filesystem with a host directory (created if missing).
+bool mountDirectory(const char* root);
+
+const Stats& stats();
+void resetStats();
+
+// Make every File::read() take sample-clock time, as a QSPI LittleFS read
+// does on the board: usPerRead for the call plus usPerKiB for the data.
+// The timer keeps firing meanwhile (HostSim::tick()), so a slow read drains
+// the voice rings like it would on the board. 0, 0 (the default) is free.
+void setReadCost(uint32_t usPerRead, uint32_t usPerKiB);
+
+} // namespace HostFS
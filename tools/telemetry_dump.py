@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+import argparse, os, stat, struct, sys, time
+
+# Telemetry frame layout; must match firmware/arduino/lofi_sampler/Telemetry.h
+MAGIC = b'LTM1'
+VERSION = 1
+PROBES = ['mix', 'service', 'pump', 'readChunk', 'uiDraw', 'loop']
+COUNTERS = ['underruns', 'jobsSuperseded', 'eventsFull', 'readFails', 'streamsDeferred']
+NO_LOW_WATER = 0xFFFF
+
+def parse(frame):
+    magic, length, ver, nprobes, ncounters, nvoices, nbuckets, shift, hz, ms = \
+        struct.unpack_from('<4sHBBBBBBII', frame, 0)
+    if magic != MAGIC or ver != VERSION:
+        raise ValueError('not a version %d telemetry frame' % VERSION)
+    if sum(frame[:length - 2]) & 0xFFFF != struct.unpack_from('<H', frame, length - 2)[0]:
+        raise ValueError('checksum mismatch')
+    off = 20
+    probes = []
+    for i in range(nprobes):
+        budget, count, over, mx, lo, hi = struct.unpack_from('<6I', frame, off)
+        off += 24
+        hist = struct.unpack_from('<%dH' % nbuckets, frame, off)
+        off += 2 * nbuckets
+        name = PROBES[i] if i < len(PROBES) else 'probe%d' % i
+        probes.append(dict(name=name, budget=budget, count=count, over=over,
+                           max=mx, total=lo | (hi << 32), hist=hist))
+    counters = struct.unpack_from('<%dI' % ncounters, frame, off)
+    off += 4 * ncounters
+    low = struct.unpack_from('<%dH' % nvoices, frame, off)
+    names = COUNTERS + ['counter%d' % i for i in range(len(COUNTERS), ncounters)]
+    return dict(tickHz=hz, uptimeMs=ms, shift=shift, probes=probes,
+                counters=dict(zip(names, counters)), lowWater=low)
+
+def frames_in(data):
+    # A Serial capture also carries the sketch's text diagnostics; skip to
+    # each magic and take whatever checks out.
+    at = data.find(MAGIC)
+    while at >= 0:
+        if at + 6 <= len(data):
+            length = struct.unpack_from('<H', data, at + 4)[0]
+            if length >= 22 and at + length <= len(data):
+                try:
+                    yield parse(data[at:at + length])
+                    at = data.find(MAGIC, at + length)
+                    continue
+                except (ValueError, struct.error):
+                    pass
+        at = data.find(MAGIC, at + 1)
+
+def us(ticks, hz):
+    return ticks * 1e6 / hz
+
+def report(t):
+    hz = t['tickHz']
+    print('uptime %.1f s, ticks at %g Hz' % (t['uptimeMs'] / 1000.0, hz))
+    print('probe     |    calls |   mean us |    max us | budget us |  over')
+    print('----------+----------+-----------+-----------+-----------+------')
+    for p in t['probes']:
+        mean = p['total'] / p['count'] if p['count'] else 0
+        print('%-9s | %8d | %9.2f | %9.2f | %9.1f | %5d' % (
+            p['name'], p['count'], us(mean, hz), us(p['max'], hz), us(p['budget'], hz), p['over']))
+    print('histograms (calls per bucket, upper bound in us):')
+    for p in t['probes']:
+        if not p['count']:
+            continue
+        used = [i for i, n in enumerate(p['hist']) if n]
+        cells = []
+        for i in range(used[0], used[-1] + 1):
+            top = '>' if i == len(p['hist']) - 1 else '<%.3g' % us(1 << (t['shift'] + i), hz)
+            cells.append('%s:%d' % (top, p['hist'][i]))
+        print('  %-9s %s' % (p['name'], ' '.join(cells)))
+    print('counters: ' + ', '.join('%s %d' % kv for kv in t['counters'].items()))
+    print('ring low-water (samples): ' + ' '.join(
+        '-' if n == NO_LOW_WATER else str(n) for n in t['lowWater']))
+
+def read_port(path, clear, timeout=2.0):
+    import serial  # pyserial, only needed to talk to the board
+    with serial.Serial(path, 115200, timeout=0.1) as port:
+        port.reset_input_buffer()
+        port.write(b'T' if clear else b't')
+        data = b''
+        end = time.time() + timeout
+        while time.time() < end:
+            data += port.read(4096)
+            if any(True for _ in frames_in(data)):
+                break
+        return data
+
+if __name__ == '__main__':
+    ap = argparse.ArgumentParser(
+        description='Decode the sampler\'s telemetry frames from a Serial port or a file')
+    ap.add_argument('source', help='serial port of the board, or a dump/capture file (- for stdin)')
+    ap.add_argument('--clear', action='store_true', help='ask the board to reset its counters after dumping')
+    args = ap.parse_args()
+    if args.source == '-':
+        data = sys.stdin.buffer.read()
+    elif stat.S_ISCHR(os.stat(args.source).st_mode):
+        data = read_port(args.source, args.clear)
+    else:
+        with open(args.source, 'rb') as f:
+            data = f.read()
+    found = list(frames_in(data))
+    if not found:
+        raise SystemExit('no telemetry frame found')
+    for i, t in enumerate(found):
+        if i:
+            print()
+        report(t)
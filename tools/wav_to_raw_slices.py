@@ -1,8 +1,63 @@
-
 #!/usr/bin/env python3
 import argparse, os, wave, struct
 
-def convert_and_slice(wav_path, outdir, prefix, segments=8):
+# IMA ADPCM slice layout; must match firmware/arduino/lofi_sampler/ImaAdpcm.h
+IMA_MAGIC = 0x34414D49  # "IMA4"
+IMA_BLOCK_BYTES = 256
+IMA_SAMPLES_PER_BLOCK = (IMA_BLOCK_BYTES - 4) * 2 + 1  # 505
+
+# slices.tbl; must match Storage::SliceTableFile
+TABLE_MAGIC = 0x3154534C  # "LST1"
+TABLE_VERSION = 1
+
+IMA_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767]
+IMA_INDEX = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+def ima_encode(samples):
+    # Bit-exact with ImaAdpcm::encodeBlock, so the firmware and this tool
+    # write identical files for the same audio.
+    out = bytearray(struct.pack('<IIHHI', IMA_MAGIC, len(samples),
+                                IMA_BLOCK_BYTES, IMA_SAMPLES_PER_BLOCK, 0))
+    index = 0
+    for b in range(0, len(samples), IMA_SAMPLES_PER_BLOCK):
+        blk = samples[b:b + IMA_SAMPLES_PER_BLOCK]
+        pred = blk[0]
+        block = bytearray(IMA_BLOCK_BYTES)
+        struct.pack_into('<hBB', block, 0, pred, index, 0)
+        for i, x in enumerate(blk[1:]):
+            step = IMA_STEPS[index]
+            diff = x - pred
+            nib = 0
+            if diff < 0:
+                nib, diff = 8, -diff
+            if diff >= step: nib |= 4; diff -= step
+            if diff >= step >> 1: nib |= 2; diff -= step >> 1
+            if diff >= step >> 2: nib |= 1
+            d = step >> 3
+            if nib & 4: d += step
+            if nib & 2: d += step >> 1
+            if nib & 1: d += step >> 2
+            pred = max(-32768, min(32767, pred - d if nib & 8 else pred + d))
+            index = max(0, min(88, index + IMA_INDEX[nib & 7]))
+            block[4 + (i >> 1)] |= (nib << 4) if i & 1 else nib
+        out += block
+    return bytes(out)
+
+def slice_table(total, segments=8):
+    seg = total // segments
+    starts = [i * seg for i in range(segments)]
+    lens = [seg] * (segments - 1) + [total - seg * (segments - 1)]
+    return struct.pack('<IHHI%dI%dI' % (segments, segments), TABLE_MAGIC,
+                       TABLE_VERSION, segments, total, *starts, *lens)
+
+def convert_and_slice(wav_path, outdir, prefix, segments=8, adpcm=False, table_only=False):
     w = wave.open(wav_path, 'rb')
     ch = w.getnchannels()
     sw = w.getsampwidth()
@@ -14,24 +69,40 @@ def convert_and_slice(wav_path, outdir, prefix, segments=8):
     nf = w.getnframes()
     seg = nf // segments
     os.makedirs(outdir, exist_ok=True)
-    # write source.raw
+    # write source.raw; with VIRTUAL_SLICES the slices are ranges of it
     src = os.path.join(outdir, 'source.raw')
+    frames = w.readframes(nf)
+    if adpcm:
+        frames = ima_encode(list(struct.unpack('<%dh' % nf, frames)))
     with open(src, 'wb') as f:
-        f.write(w.readframes(nf))
-    # slice
+        f.write(frames)
+    with open(os.path.join(outdir, 'slices.tbl'), 'wb') as f:
+        f.write(slice_table(nf, segments))
+    if table_only:
+        w.close()
+        print('Wrote', src, 'and slices.tbl.')
+        return
+    # slice files, for VIRTUAL_SLICES 0 builds (a table shadows them otherwise)
     w.rewind()
     for i in range(segments):
         w.setpos(i*seg)
         frames = w.readframes(seg)
+        if adpcm:
+            frames = ima_encode(list(struct.unpack('<%dh' % (len(frames) // 2), frames)))
         with open(os.path.join(outdir, f'{prefix}{i+1}.raw'), 'wb') as o:
             o.write(frames)
     w.close()
-    print('Wrote', src, 'and', segments, 'slices.')
+    print('Wrote', src, 'slices.tbl and', segments, 'ADPCM slices.' if adpcm else 'slices.')
 
 if __name__ == '__main__':
     ap = argparse.ArgumentParser()
     ap.add_argument('wav', help='mono 16-bit PCM @ 22050 Hz')
     ap.add_argument('--outdir', required=True)
     ap.add_argument('--prefix', required=True, help='Row letter: A, B, C, or D')
+    ap.add_argument('--adpcm', action='store_true',
+                    help='write source.raw and slices as 4-bit IMA ADPCM (~4:1, same .raw names)')
+    ap.add_argument('--table-only', action='store_true',
+                    help='skip the 8 slice files; source.raw + slices.tbl is all VIRTUAL_SLICES needs')
     args = ap.parse_args()
-    convert_and_slice(args.wav, args.outdir, args.prefix)
+    convert_and_slice(args.wav, args.outdir, args.prefix, adpcm=args.adpcm,
+                      table_only=args.table_only)